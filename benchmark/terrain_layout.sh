@@ -0,0 +1,44 @@
+#!/bin/sh
+# Compares the terrain layouts (-layout columns and -layout bricks) on a world.
+# Renders it RUNS times with each layout and prints the fastest prepare (occlusion) and draw stage of both.
+# Any further arguments go to mcmap, for example -threads 4 or -from/-to for a smaller area.
+#
+# usage: terrain_layout.sh MCMAP WORLD [RUNS] [mcmap options...]
+
+if [ $# -lt 2 ]; then
+	echo "usage: $0 MCMAP WORLD [RUNS] [mcmap options...]" >&2
+	exit 1
+fi
+MCMAP=$1
+WORLD=$2
+RUNS=${3:-3}
+[ $# -ge 3 ] && shift 3 || shift 2
+
+OUT=$(mktemp -d) || exit 1
+trap 'rm -rf "$OUT"' EXIT
+
+for LAYOUT in columns bricks; do
+	BEST_PREPARE=
+	BEST_DRAW=
+	i=0
+	while [ $i -lt "$RUNS" ]; do
+		STAGES=$("$MCMAP" "$@" -layout $LAYOUT -file "$OUT/$LAYOUT.png" "$WORLD" 2>/dev/null | tr '\r' '\n' | grep '^Render stages')
+		if [ -z "$STAGES" ]; then
+			echo "mcmap failed with -layout $LAYOUT" >&2
+			exit 1
+		fi
+		# Render stages: load 1.2s, prepare 0.5s, draw 0.7s
+		PREPARE=$(echo "$STAGES" | sed 's/.*prepare \([0-9.e-]*\)s.*/\1/')
+		DRAW=$(echo "$STAGES" | sed 's/.*draw \([0-9.e-]*\)s.*/\1/')
+		BEST_PREPARE=$(echo "$BEST_PREPARE $PREPARE" | awk '{ print (NF == 1 || $2 < $1) ? $NF : $1 }')
+		BEST_DRAW=$(echo "$BEST_DRAW $DRAW" | awk '{ print (NF == 1 || $2 < $1) ? $NF : $1 }')
+		i=$((i + 1))
+	done
+	echo "$LAYOUT: prepare ${BEST_PREPARE}s, draw ${BEST_DRAW}s (best of $RUNS)"
+done
+
+if cmp -s "$OUT/columns.png" "$OUT/bricks.png"; then
+	echo "Both layouts drew the same image"
+else
+	echo "The images differ, expected only with -noise"
+fi
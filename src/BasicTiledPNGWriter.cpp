@@ -4,20 +4,22 @@
 #include <array>
 #include <cmath> //pow (for g++)
 #include <cstring> //memcpy (for g++)
+#include <deque>
+#include <future>
+#include <algorithm>
+#include <sstream>
 //My-Header
 #include "BasicTiledPNGWriter.h"
 #include "helper.h"
-#include "filesystem.h"
+#include "TileStore.h"
+#include "TilePyramid.h"
+#include "TileDeduplicator.h"
+#include "globals.h"
 
 namespace
 {
-	//Function to write png data to disc
-	void userWriteData(png_structp pngPtr, png_bytep data, png_size_t length)
-	{
-		png_voidp a = png_get_io_ptr(pngPtr);
-		//Cast the pointer to std::ifstream* and read 'length' bytes into 'data'
-		static_cast<std::fstream*>(a)->write(reinterpret_cast<char*>(data), static_cast<std::streamsize>(length));
-	}
+	// Upper bound of tiles waiting for an encoder thread, they only hold their name until they are started
+	constexpr size_t MAX_PENDING_TILES{ 256 };
 }
 
 namespace image
@@ -27,119 +29,164 @@ namespace image
 	{
 		std::cout << "Writing to files...\n";
 
-		if (!Dir::createDir(path)) {
-			std::cerr << "Could not create " << path << " folder\n";
+		std::unique_ptr<TileStore> store = TileStore::create(path, Global::settings.pyramid);
+		if (!store->prepare()) {
 			return false;
 		}
 
-		// Prepare a temporary buffer to copy the current line to, since we need the width to be a multiple of 4096
-		// and adjusting the whole image to that would be a waste of memory
-		const size_t tempWidth = ((m_width - 5) / 4096 + 1) * 4096;
-		const size_t tempWidthChans = tempWidth * CHANSPERPIXEL;
-		const size_t LineWidthChans = m_width * CHANSPERPIXEL;
+		if (Global::settings.pyramid) {
+			return writePyramid(*store);
+		}
 
-#ifdef _DEBUG
-		std::cout << "Temp width: " << tempWidthChans << ", original width: " << LineWidthChans << '\n';
-#endif
-		std::vector<uint8_t> tempLine(tempWidthChans, 0);
-		// Source pointer
-		size_t srcLine = 0;
-		// Prepare an array of png structs that will output simultaneously to the various tiles
+		// Tiles of every size are cut from the image in bands of 128 rows, in the same order the tiles used
+		// to be opened in, so -dedup picks the same originals. Each tile only holds its file and encoder
+		// while it is being encoded, so there are never more open than there are threads.
+		const size_t tempWidth = ((m_width - 5) / 4096 + 1) * 4096;
 		std::array<size_t, 7> sizeOffset;
 		size_t last = 0;
 		for (size_t i = 0; i < 7; ++i) {
 			sizeOffset[i] = last;
 			last += ((tempWidth - 1) / static_cast<size_t>(pow(2, 12 - i))) + 1;
 		}
-		std::vector<ImageTile> tile(sizeOffset[6]);
-		for (size_t y = 0; y < m_height; ++y) {
-			if (y % 25 == 0) {
-				helper::printProgress(y, m_height);
-			}
-			std::memcpy(tempLine.data(), &m_buffer[srcLine], LineWidthChans);
-			srcLine += LineWidthChans;
-			// Handle all png files
-			if (y % 128 == 0) {
-				size_t start;
-				if (y % 4096 == 0) start = 0;
-				else if (y % 2048 == 0) start = 1;
-				else if (y % 1024 == 0) start = 2;
-				else if (y % 512 == 0) start = 3;
-				else if (y % 256 == 0) start = 4;
-				else start = 5;
-				for (size_t tileSize = start; tileSize < 6; ++tileSize) {
-					const size_t tileWidth = static_cast<size_t>(pow(2, 12 - tileSize));
-					for (size_t tileIndex = sizeOffset[tileSize]; tileIndex < sizeOffset[tileSize + 1]; ++tileIndex) {
-						ImageTile& t = tile[tileIndex];
-						if (t.fileHandle.is_open()) { // Unload/close first
-							png_write_end(t.pngPtr, NULL);
-							png_destroy_write_struct(&(t.pngPtr), &(t.pngInfo));
-							t.fileHandle.close();
+		std::unique_ptr<TileDeduplicator> dedup;
+		if (Global::settings.dedup != DEDUP_OFF) {
+			dedup = std::make_unique<TileDeduplicator>();
+		}
+		std::deque<std::future<bool>> jobs;
+		std::vector<Channel> dedupRow(4096 * CHANSPERPIXEL);
+		bool success = true;
+		for (size_t y = 0; y < m_height && success; y += 128) {
+			helper::printProgress(y, m_height);
+			size_t start;
+			if (y % 4096 == 0) start = 0;
+			else if (y % 2048 == 0) start = 1;
+			else if (y % 1024 == 0) start = 2;
+			else if (y % 512 == 0) start = 3;
+			else if (y % 256 == 0) start = 4;
+			else start = 5;
+			for (size_t tileSize = start; tileSize < 6 && success; ++tileSize) {
+				const size_t tileWidth = static_cast<size_t>(pow(2, 12 - tileSize));
+				for (size_t tileX = 0; tileX < sizeOffset[tileSize + 1] - sizeOffset[tileSize] && tileWidth * tileX < m_width && success; ++tileX) {
+					const std::string tileName = "x" + std::to_string(int(tileX)) + 'y' + std::to_string(int(y / tileWidth)) + 'z' + std::to_string(int(tileSize)) + ImageEncoder::extension();
+					const TileId id{ tileSize, tileX, y / tileWidth };
+					if (dedup) {
+						std::string original;
+						const size_t left = tileWidth * id.x;
+						const auto result = m_canvas.isEmpty(left, y, tileWidth, tileWidth) ? dedup->skipEmpty()
+							: dedup->check(tileName, tileWidth, [this, &dedupRow, left, y, tileWidth](const size_t row) {
+								copyTileRow(left, y + row, tileWidth, dedupRow.data());
+								return dedupRow.data();
+							}, original);
+						if (result == TileDeduplicator::TILE_DUPLICATE) {
+							store->duplicate(id, tileName, original);
+						}
+						if (result != TileDeduplicator::TILE_NEW) {
+							continue;
 						}
-						if (tileWidth * (tileIndex - sizeOffset[tileSize]) < m_width) {
-							// Open new tile file for a while
-							const std::string tmpString = path + "/x" + std::to_string(int(tileIndex - sizeOffset[tileSize])) + 'y' + std::to_string(int((y / pow(2, 12 - tileSize)))) + 'z' + std::to_string(int(tileSize)) + ".png";
+					}
 #ifdef _DEBUG
-							std::cout << "Starting tile " << tmpString << " of size " << (int) pow(2, 12 - tileSize) << "...\n";
+					std::cout << "Starting tile " << tileName << " of size " << tileWidth << "...\n";
 #endif
-							t.fileHandle.open(tmpString, std::ios::out | std::ios::binary);
-							if (t.fileHandle.fail()) {
-								std::cerr << "Error opening file!\n";
-								return false;
-							}
-							t.pngPtr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-							if (t.pngPtr == nullptr) {
-								std::cerr << "Error creating png write struct!\n";
-								return false;
-							}
-							if (setjmp(png_jmpbuf(t.pngPtr))) {
-								std::cerr << "Something went wrong with pngLib\n";
-								return false;
-							}
-							t.pngInfo = png_create_info_struct(t.pngPtr);
-							if (t.pngInfo == nullptr) {
-								std::cerr << "Error creating png info struct!\n";
-								png_destroy_write_struct(&(t.pngPtr), NULL);
-								return false;
-							}
-
-							png_set_write_fn(t.pngPtr, static_cast<png_voidp>(&t.fileHandle), userWriteData, NULL);
-							//png_init_io(t.pngPtr, t.fileHandle);
-							png_set_IHDR(t.pngPtr, t.pngInfo,
-								uint32_t(pow(2, 12 - tileSize)), uint32_t(pow(2, 12 - tileSize)),
-								8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-								PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-							png_write_info(t.pngPtr, t.pngInfo);
-						}
+					if (!Global::threadPool) {
+						success = encodeTile(store.get(), id, tileName, tileWidth);
+						continue;
 					}
+					while (jobs.size() >= MAX_PENDING_TILES) {
+						success = jobs.front().get() && success;
+						jobs.pop_front();
+					}
+					TileStore* target = store.get();
+					jobs.push_back(Global::threadPool->enqueue([this, target, id, tileName, tileWidth]() { return encodeTile(target, id, tileName, tileWidth); }));
 				}
-			} // done preparing tiles
-			  // Write data to all current tiles
-			for (size_t tileSize = 0; tileSize < 6; ++tileSize) {
-				const size_t tileWidth = static_cast<size_t>(pow(2, 12 - tileSize));
-				for (size_t tileIndex = sizeOffset[tileSize]; tileIndex < sizeOffset[tileSize + 1]; ++tileIndex) {
-					if (tile[tileIndex].fileHandle.fail() || !tile[tileIndex].fileHandle.is_open()) continue;
-					png_write_row(tile[tileIndex].pngPtr, &tempLine[tileWidth * (tileIndex - sizeOffset[tileSize]) * CHANSPERPIXEL]);
-				}
-			} // done writing line
-		} // done with whole image
-
-		  // Now the last set of tiles is not finished, so do that manually
-		std::fill(tempLine.begin(), tempLine.end(), 0);
-		for (size_t tileSize = 0; tileSize < 6; ++tileSize) {
-			const size_t tileWidth = static_cast<size_t>(pow(2, 12 - tileSize));
-			for (size_t tileIndex = sizeOffset[tileSize]; tileIndex < sizeOffset[tileSize + 1]; ++tileIndex) {
-				if (tile[tileIndex].fileHandle.fail() || !tile[tileIndex].fileHandle.is_open()) continue;
-				const size_t imgEnd = (((m_height - 1) / tileWidth) + 1) * tileWidth;
-				for (size_t i = m_height; i < imgEnd; ++i) {
-					png_write_row(tile[tileIndex].pngPtr, tempLine.data()); //writes just 0's
-				}
-				png_write_end(tile[tileIndex].pngPtr, NULL);
-				png_destroy_write_struct(&(tile[tileIndex].pngPtr), &(tile[tileIndex].pngInfo));
 			}
 		}
+		for (auto& job : jobs) {
+			success = job.get() && success;
+		}
+		if (!success) {
+			return false;
+		}
 		helper::printProgress(10, 10);
 
-		return true;
+		if (dedup) {
+			dedup->printStats();
+		}
+		return store->finish();
+	}
+
+	bool BasicTiledPNGWriter::encodeTile(TileStore* store, const TileId id, const std::string name, const size_t tileWidth)
+	{
+		std::unique_ptr<std::iostream> stream = store->open(name);
+		if (!stream) {
+			return false;
+		}
+		const size_t left = tileWidth * id.x;
+		const size_t top = tileWidth * id.y;
+		if (m_canvas.isEmpty(left, top, tileWidth, tileWidth)) {
+			const std::string& blank = blankTile(tileWidth);
+			stream->write(blank.data(), static_cast<std::streamsize>(blank.size()));
+			return store->close(id, name, std::move(stream));
+		}
+		auto encoder = ImageEncoder::create();
+		if (!encoder->begin(*stream, tileWidth, tileWidth)) {
+			return false;
+		}
+		std::vector<Channel> row(tileWidth * CHANSPERPIXEL);
+		for (size_t y = top; y < top + tileWidth; ++y) {
+			copyTileRow(left, y, tileWidth, row.data());
+			if (!encoder->writeRow(row.data())) {
+				return false;
+			}
+		}
+		return encoder->end() && store->close(id, name, std::move(stream));
+	}
+
+	void BasicTiledPNGWriter::copyTileRow(const size_t left, const size_t y, const size_t tileWidth, Channel* dst) const
+	{
+		// Tiles reaching over the right or bottom edge are padded with transparent pixels
+		size_t visible = 0;
+		if (y < m_height && left < m_width) {
+			visible = std::min(tileWidth, m_width - left);
+			m_canvas.copyRow(y, left, visible, dst);
+		}
+		std::memset(dst + visible * CHANSPERPIXEL, 0, (tileWidth - visible) * CHANSPERPIXEL);
 	}
-}
\ No newline at end of file
+
+	const std::string& BasicTiledPNGWriter::blankTile(const size_t tileWidth)
+	{
+		std::lock_guard<std::mutex> lock(m_blankMutex);
+		auto it = m_blankTiles.find(tileWidth);
+		if (it == m_blankTiles.end()) {
+			std::stringstream data;
+			auto encoder = ImageEncoder::create();
+			const std::vector<Channel> empty(tileWidth * CHANSPERPIXEL, 0);
+			encoder->begin(data, tileWidth, tileWidth);
+			for (size_t y = 0; y < tileWidth; ++y) {
+				encoder->writeRow(empty.data());
+			}
+			encoder->end();
+			it = m_blankTiles.emplace(tileWidth, data.str()).first;
+		}
+		return it->second;
+	}
+
+	bool BasicTiledPNGWriter::writePyramid(TileStore& store)
+	{
+		TilePyramid pyramid(store, m_width, m_height);
+		if (!pyramid.prepare()) {
+			return false;
+		}
+		std::vector<Channel> row(m_width * CHANSPERPIXEL);
+		for (size_t y = 0; y < m_height; ++y) {
+			if (y % 25 == 0) {
+				helper::printProgress(y, m_height);
+			}
+			m_canvas.copyRow(y, 0, m_width, row.data());
+			if (!pyramid.addRow(row.data())) {
+				return false;
+			}
+		}
+		helper::printProgress(10, 10);
+		return pyramid.finish() && store.finish();
+	}
+}
@@ -1,9 +1,13 @@
 #pragma once
 //C++ Header
-
+#include <memory>
+#include <mutex>
+#include <map>
+#include <string>
 //My-Header
-#include "png.h"
 #include "PNGWriter.h"
+#include "ImageEncoder.h"
+#include "TileStore.h"
 
 namespace image
 {
@@ -12,17 +16,16 @@ namespace image
 	public:
 		bool write(const std::string& path) override;
 	private:
+		bool writePyramid(TileStore& store);
 
-		struct ImageTile
-		{
-			std::fstream fileHandle;
-			png_structp pngPtr;
-			png_infop pngInfo;
-
-			ImageTile()
-				: pngPtr(nullptr), pngInfo(nullptr)
-			{}
+		// Encodes one tile straight from the image, may run on any thread
+		bool encodeTile(TileStore* store, const TileId id, const std::string name, const size_t tileWidth);
+		// Row y of the tile starting at column left, padded with transparent pixels outside of the image
+		void copyTileRow(const size_t left, const size_t y, const size_t tileWidth, Channel* dst) const;
+		// Encoded fully transparent tile, only encoded once per size
+		const std::string& blankTile(const size_t tileWidth);
 
-		};
+		std::mutex m_blankMutex;
+		std::map<size_t, std::string> m_blankTiles;
 	};
 }
\ No newline at end of file
@@ -3,46 +3,36 @@
 #include <algorithm>
 #include <ctime>
 #include <fstream>
-#include <cassert>
+#include <sstream>
+#include <chrono>
+#include <memory>
+#include <cstring> //memcpy (for g++)
 //My-Header
-#include <png.h>
 #include "CachedPNGWriter.h"
+#include "ImageEncoder.h"
+#include "ImageScaler.h"
 #define NOMINMAX
 #include "filesystem.h"
 #include "helper.h"
 #include "draw_png.h"
 
-#ifndef Z_BEST_SPEED
-#	define Z_BEST_SPEED 6
-#endif
-
-
-namespace
-{
-	//Function to write png data to disc
-	void userWriteData(png_structp pngPtr, png_bytep data, png_size_t length)
-	{
-		png_voidp a = png_get_io_ptr(pngPtr);
-		//Cast the pointer to std::ifstream* and write 'length' bytes from 'data'
-		static_cast<std::fstream*>(a)->write(reinterpret_cast<char*>(data), static_cast<std::streamsize>(length));
-	}
-
-	//Function to read pngt data from disc
-	void userReadData(png_structp pngPtr, png_bytep data, png_size_t length)
-	{
-		png_voidp a = png_get_io_ptr(pngPtr);
-		//Cast the pointer to std::ifstream* and read 'length' bytes into 'data'
-		static_cast<std::fstream*>(a)->read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(length));
-	}
-}
-
 namespace image
 {
 	CachedPNGWriter::CachedPNGWriter(const size_t origW, const size_t origH)
-		: m_origW(origW), m_origH(origH), offsetX(0), offsetY(0)
+		: m_origW(origW), m_origH(origH), offsetX(0), offsetY(0), m_scratch(Global::settings.scratchDir),
+		m_decodeNanos(0), m_blendNanos(0), m_decodedBytes(0), m_writeNanos(0), m_stallNanos(0)
+	{}
+
+	CachedPNGWriter::~CachedPNGWriter()
 	{
-		if (!Dir::createDir("cache")) {
-			std::cerr << "Could not create cache directory\n";
+		for (auto& job : m_pendingWrites) {
+			job.wait();
+		}
+		// Decoders still running after a failed compose use the parts
+		for (auto& part : m_partList) {
+			if (part.decoded.valid()) {
+				part.decoded.wait();
+			}
 		}
 	}
 
@@ -74,15 +64,18 @@ namespace image
 		if (localWidth < 1 || localHeight < 1) {
 			return 1;
 		}
+		if (!m_scratch.valid()) {
+			return -1;
+		}
 
 		std::stringstream ss;
-		ss << "cache/"
+		ss << m_scratch.path() << '/'
 			<< std::to_string(localX) << '.'
 			<< std::to_string(localY) << '.'
 			<< std::to_string(localWidth) << '.'
 			<< std::to_string(localHeight) << '.'
-			<< std::to_string(time(NULL))
-			<< ".png";
+			<< m_partList.size()
+			<< ".part";
 		const std::string name = ss.str();
 
 		m_partList.emplace_back(name, localX, localY, localWidth, localHeight);
@@ -95,65 +88,75 @@ namespace image
 
 	bool CachedPNGWriter::write([[maybe_unused]] const std::string& path)
 	{
-		const auto& part = m_partList.back();
-		std::fstream fileHandle(part.filename, std::ios::out | std::ios::binary);
-		if (fileHandle.fail()) {
-			std::cerr << "Could not create temporary image at " << part.filename << "; check permissions in current dir.\n";
-			return false;
+		m_height = 0;
+		m_width = 0;
+		ImagePart* part = &m_partList.back();
+		if (Global::settings.pipelineDepth == 0) {
+			const bool success = writePart(part, &m_canvas);
+			m_canvas.release();
+			return success;
 		}
-
-		png_structp pngStruct = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-		if (pngStruct == nullptr) {
-			return false;
+		// The canvas goes with the job, the next part is drawn into a fresh one meanwhile
+		bool success = true;
+		const auto start = std::chrono::steady_clock::now();
+		while (m_pendingWrites.size() >= Global::settings.pipelineDepth) {
+			success = m_pendingWrites.front().get() && success;
+			m_pendingWrites.pop_front();
 		}
+		m_stallNanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		auto canvas = std::make_shared<ImageCanvas>(std::move(m_canvas));
+		m_canvas = ImageCanvas();
+		// Not on the thread pool, loading the next part waits for that one
+		m_pendingWrites.push_back(std::async(std::launch::async, [this, part, canvas]() { return writePart(part, canvas.get()); }));
+		return success;
+	}
 
-		png_infop pngInfo = png_create_info_struct(pngStruct);
+	bool CachedPNGWriter::writePart(ImagePart* part, const ImageCanvas* canvas)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const bool success = part->scratch.write(*canvas);
+		m_writeNanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		return success;
+	}
 
-		if (pngInfo == NULL) {
-			png_destroy_write_struct(&pngStruct, NULL);
-			return false;
+	bool CachedPNGWriter::finishParts()
+	{
+		bool success = true;
+		const auto start = std::chrono::steady_clock::now();
+		for (auto& job : m_pendingWrites) {
+			success = job.get() && success;
 		}
-
-		if (setjmp(png_jmpbuf(pngStruct))) { // libpng will issue a longjmp on error, so code flow will end up
-			png_destroy_write_struct(&pngStruct, &pngInfo); // here if something goes wrong in the code below
-			return false;
+		m_pendingWrites.clear();
+		m_stallNanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		if (!success) {
+			std::cerr << "Error saving partially rendered image.\n";
 		}
-
-		png_set_write_fn(pngStruct, static_cast<png_voidp>(&fileHandle), userWriteData, NULL);
-		png_set_compression_level(pngStruct, Z_BEST_SPEED);
-		png_set_IHDR(pngStruct, pngInfo, static_cast<uint32_t>(part.width), static_cast<uint32_t>(part.height),
-			8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-			PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-		png_write_info(pngStruct, pngInfo);
-
-		size_t line = 0;
-		for (size_t y = 0; y < part.height; ++y) {
-			png_write_row(pngStruct, &m_buffer.at(line));
-			line += m_width * CHANSPERPIXEL;
-		}
-
-		png_write_end(pngStruct, NULL);
-		png_destroy_write_struct(&pngStruct, &pngInfo);
-
-		m_height = 0;
-		m_width = 0;
-
-		return true;
+		return success;
 	}
 
 	void CachedPNGWriter::discardPart()
 	{
 		m_partList.pop_back();
+		m_canvas.release();
 		m_height = 0;
 		m_width = 0;
 	}
 
 	bool CachedPNGWriter::compose(const std::string& path, const double scale)
 	{
+		if (!finishParts()) {
+			return false;
+		}
 		std::cout << "Composing final png file...\n";
 
-		m_origH = static_cast<size_t>(static_cast<double>(m_origH) * scale);
-		m_origW = static_cast<size_t>(static_cast<double>(m_origW) * scale);
+		// Parts are composed at full size, scaling happens on the fly as composed rows stream out
+		std::unique_ptr<ImageScaler> scaler;
+		size_t outW = m_origW, outH = m_origH;
+		if (scale != 1.0) {
+			outW = static_cast<size_t>(static_cast<double>(m_origW) * scale);
+			outH = static_cast<size_t>(static_cast<double>(m_origH) * scale);
+			scaler = std::make_unique<ImageScaler>(Global::settings.scaleFilter, m_origW, m_origH, outW, outH);
+		}
 
 		std::fstream outHandle(path, std::ios::out | std::ios::binary);
 		if (outHandle.fail()) {
@@ -161,117 +164,182 @@ namespace image
 			return false;
 		}
 
-		png_structp pngStruct = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-		if (pngStruct == nullptr) {
-			return false;
-		}
-
-		png_infop pngInfo = png_create_info_struct(pngStruct);
-		if (pngInfo == nullptr) {
-			png_destroy_write_struct(&pngStruct, NULL);
-			return false;
-		}
-
-		if (setjmp(png_jmpbuf(pngStruct))) { // libpng will issue a longjmp on error, so code flow will end up
-			png_destroy_write_struct(&pngStruct, &pngInfo); // here if something goes wrong in the code below
+		auto encoder = ImageEncoder::create();
+		if (!encoder->begin(outHandle, outW, outH, true)) {
 			return false;
 		}
 
-		png_set_write_fn(pngStruct, static_cast<png_voidp>(&outHandle), userWriteData, NULL);
-
-		png_set_IHDR(pngStruct, pngInfo, static_cast<uint32_t>(m_origW), static_cast<uint32_t>(m_origH),
-			8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-			PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-
-		png_text title_text;
-		title_text.compression = PNG_TEXT_COMPRESSION_NONE;
-		title_text.key = png_charp("Software"); // we need to cast from const char* to char*
-		title_text.text = png_charp("mcmap"); // we need to cast from const char* to char*
-		png_set_text(pngStruct, pngInfo, &title_text, 1);
-
-		png_write_info(pngStruct, pngInfo);
-
-		const size_t tempWidth = (m_origW * CHANSPERPIXEL) + 1;
-		const size_t tempWidthChans = tempWidth * CHANSPERPIXEL;
-
-		std::vector<uint8_t> lineWrite(tempWidthChans, 0);
-		std::vector<uint8_t> lineRead(tempWidth, 0);
+		std::vector<Channel> line(m_origW * CHANSPERPIXEL);
+		OutputStage output(line.size(), [&encoder, &scaler](const Channel* row) {
+			if (scaler) {
+				return scaler->pushRow(row, [&encoder](const Channel* scaled) { return encoder->writeRow(scaled); });
+			}
+			return encoder->writeRow(row);
+		});
 
-		// Prepare an array of png structs that will output simultaneously to the various tiles
 		for (size_t y = 0; y < m_origH; ++y) {
 			if (y % 100 == 0) {
 				helper::printProgress(y, m_origH);
 			}
-			// paint each image on this one
-			std::fill(lineWrite.begin(), lineWrite.end(), 0);
-			// the partial images are kept in this list. they're already in the correct order in which they have to me merged and blended
-			for (auto it = m_partList.begin(); it != m_partList.end(); ++it) {
-				ImagePart& img = *it;
-				// do we have to open this image?
-				if (img.y != static_cast<int>(y) && img.pngPtr == nullptr) {
-					continue;   // Not your turn, image!
-				}
-
-				if (img.pngPtr == nullptr) {
-					assert(img.pngInfo == nullptr);
-					assert(!img.file.is_open());
-
-					img.file.open(img.filename, std::ios::in | std::ios::binary);
-					if (img.file.fail()) {
-						std::cerr << "Error opening temporary image " << img.filename << '\n';
-						return false;
-					}
-
-					img.pngPtr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-					if (img.pngPtr == nullptr) {
-						std::cerr << "Error creating read struct for temporary image " << img.filename << '\n';
-						return false; // Not really cleaning up here, but program will terminate anyways, so why bother
-					}
-					img.pngInfo = png_create_info_struct(img.pngPtr);
-					if (img.pngInfo == nullptr || setjmp(png_jmpbuf(img.pngPtr))) {
-						std::cerr << "Error reading data from temporary image " << img.filename << '\n';
-						return false; // Same here
-					}
+			std::fill(line.begin(), line.end(), 0);
+			if (!composeRow(y, line.data()) || !output.push(line.data())) {
+				return false;
+			}
+		}
 
-					png_set_read_fn(img.pngPtr, static_cast<png_voidp>(&img.file), userReadData);
-					png_read_info(img.pngPtr, img.pngInfo);
-					// Check if image dimensions match what is expected
-					int type, interlace, comp, filter, bitDepth;
-					png_uint_32 width, height;
-					png_uint_32 ret = png_get_IHDR(img.pngPtr, img.pngInfo, &width, &height, &bitDepth, &type, &interlace, &comp, &filter);
-					if (ret == 0 || width != static_cast<png_uint_32>(img.width) || height != static_cast<png_uint_32>(img.height)) {
-						std::cerr << "Temp image " << img.filename << " has wrong dimensions; expected " << img.width << 'x' << img.height << ", got " << width << 'x' << height << '\n';
-						return false;
-					}
+		if (!output.finish()) {
+			return false;
+		}
+		if (!encoder->end()) {
+			return false;
+		}
+		helper::printProgress(10, 10);
+		printComposeStats(output);
+		return true;
+	}
 
+	bool CachedPNGWriter::composeRow(const size_t y, Channel* line)
+	{
+		// the partial images are kept in this list. they're already in the correct order in which they have to me merged and blended
+		for (auto& img : m_partList) {
+			// do we have to open this image?
+			if (img.y != static_cast<int>(y) && !img.scratch.isOpen()) {
+				continue;   // Not your turn, image!
+			}
+			if (!img.scratch.isOpen()) {
+				if (!img.scratch.open()) {
+					return false;
 				}
-
-				// Read next line from current image chunk
-				png_read_row(img.pngPtr, lineRead.data(), nullptr);
-				// Now this puts all the pixels in the right spot of the current line of the final image
-				const size_t end = (static_cast<size_t>(img.x) + img.width) * CHANSPERPIXEL;
-				size_t read = 0;
-				for (size_t write = static_cast<size_t>(img.x) * CHANSPERPIXEL; write < end; write += CHANSPERPIXEL) {
-					draw::blend(&lineWrite[write], &lineRead[read]);
-					read += CHANSPERPIXEL;
+				img.undecoded = img.height;
+				img.bandPos = img.bandRows = 0;
+				queueBand(img);
+			}
+			if (img.bandPos == img.bandRows) {
+				// Switch to the band decoded meanwhile and start on the next one
+				if (!img.decoded.get()) {
+					return false;
 				}
-				// Now check if we're done with this image chunk
-				if (--(img.height) == 0) { // if so, close and discard
-					png_destroy_read_struct(&(img.pngPtr), &(img.pngInfo), NULL);
-					img.file.close();
-					img.pngPtr = nullptr;
-					remove(img.filename.c_str());
+				std::swap(img.band, img.nextBand);
+				img.bandRows = img.band.size() / (img.width * CHANSPERPIXEL);
+				img.bandPos = 0;
+				if (img.undecoded != 0) {
+					queueBand(img);
 				}
 			}
+			// Now this puts all the pixels in the right spot of the current line of the final image
+			const auto start = std::chrono::steady_clock::now();
+			draw::blendRow(line + static_cast<size_t>(img.x) * CHANSPERPIXEL, &img.band[img.bandPos * img.width * CHANSPERPIXEL], img.width);
+			m_blendNanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			++img.bandPos;
+			// Now check if we're done with this image chunk
+			if (--(img.height) == 0) { // if so, close and discard
+				img.scratch.remove();
+				img.band = decltype(img.band)();
+				img.nextBand = decltype(img.nextBand)();
+			}
+		}
+		return true;
+	}
 
-			// Done composing this line, write to final image
-			png_write_row(pngStruct, lineWrite.data());
+	void CachedPNGWriter::queueBand(ImagePart& img)
+	{
+		const size_t rows = std::min(BAND_ROWS, img.undecoded);
+		img.undecoded -= rows;
+		img.nextBand.resize(rows * img.width * CHANSPERPIXEL);
+		m_decodedBytes += img.nextBand.size();
+		ImagePart* part = &img;
+		if (Global::threadPool) {
+			img.decoded = Global::threadPool->enqueue([this, part, rows]() { return decodeBand(part, rows); });
+		} else {
+			std::promise<bool> done;
+			done.set_value(decodeBand(part, rows));
+			img.decoded = done.get_future();
+		}
+	}
 
-		}// Y-Loop
+	bool CachedPNGWriter::decodeBand(ImagePart* img, const size_t rows)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const size_t rowBytes = img->width * CHANSPERPIXEL;
+		for (size_t row = 0; row < rows; ++row) {
+			if (!img->scratch.readRow(&img->nextBand[row * rowBytes])) {
+				return false;
+			}
+		}
+		m_decodeNanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		return true;
+	}
 
-		png_write_end(pngStruct, nullptr);
-		png_destroy_write_struct(&pngStruct, &pngInfo);
-		helper::printProgress(10, 10);
+	void CachedPNGWriter::printComposeStats(const OutputStage& output) const
+	{
+		const double mib = 1024.0 * 1024.0;
+		const double decode = static_cast<double>(m_decodeNanos.load()) / 1e9;
+		const double blend = static_cast<double>(m_blendNanos) / 1e9;
+		const double bytes = static_cast<double>(m_decodedBytes) / mib;
+		std::cout << "Compose stages: decoded " << bytes << " MiB in " << decode << "s (" << (decode > 0 ? bytes / decode : 0.0) << " MiB/s), "
+			<< "blended in " << blend << "s (" << (blend > 0 ? bytes / blend : 0.0) << " MiB/s), "
+			<< "wrote " << output.rows() << " rows in " << output.seconds() << "s (" << (output.seconds() > 0 ? static_cast<double>(output.rows()) / output.seconds() : 0.0) << " rows/s)\n";
+	}
+
+	CachedPNGWriter::OutputStage::OutputStage(const size_t rowBytes, std::function<bool(const Channel*)> sink)
+		: m_rowBytes(rowBytes), m_sink(std::move(sink)), m_rows(0), m_busyNanos(0), m_rowsWritten(0)
+	{
+		if (Global::threadPool) {
+			m_filling.resize(rowBytes * BAND_ROWS);
+			m_writing.resize(rowBytes * BAND_ROWS);
+		}
+	}
+
+	CachedPNGWriter::OutputStage::~OutputStage()
+	{
+		if (m_pending.valid()) {
+			m_pending.wait();
+		}
+	}
+
+	bool CachedPNGWriter::OutputStage::push(const Channel* row)
+	{
+		if (!Global::threadPool) {
+			const auto start = std::chrono::steady_clock::now();
+			const bool success = m_sink(row);
+			m_busyNanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			++m_rowsWritten;
+			return success;
+		}
+		std::memcpy(&m_filling[m_rows * m_rowBytes], row, m_rowBytes);
+		if (++m_rows == BAND_ROWS) {
+			return flush();
+		}
 		return true;
 	}
+
+	bool CachedPNGWriter::OutputStage::flush()
+	{
+		if (m_pending.valid() && !m_pending.get()) {
+			return false;
+		}
+		std::swap(m_filling, m_writing);
+		const size_t rows = m_rows;
+		m_rows = 0;
+		// Not on the thread pool, the sink may wait for jobs of its own there
+		m_pending = std::async(std::launch::async, [this, rows]() {
+			const auto start = std::chrono::steady_clock::now();
+			bool success = true;
+			for (size_t row = 0; row < rows && success; ++row) {
+				success = m_sink(&m_writing[row * m_rowBytes]);
+			}
+			m_busyNanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			m_rowsWritten += rows;
+			return success;
+		});
+		return true;
+	}
+
+	bool CachedPNGWriter::OutputStage::finish()
+	{
+		if (m_rows != 0 && !flush()) {
+			return false;
+		}
+		return !m_pending.valid() || m_pending.get();
+	}
 }
\ No newline at end of file
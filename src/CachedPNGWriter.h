@@ -1,11 +1,15 @@
 #pragma once
 //C++ Header
 #include <vector>
+#include <deque>
 #include <array>
-#include <fstream>
+#include <future>
+#include <atomic>
+#include <functional>
 //My-Header
 #include "PNGWriter.h"
-#include "png.h"
+#include "ScratchPart.h"
+#include "MemoryTracker.h"
 
 namespace image
 {
@@ -13,50 +17,91 @@ namespace image
 	{
 	public:
 		CachedPNGWriter(const size_t origW, const size_t origH);
-		virtual ~CachedPNGWriter() = default;
+		virtual ~CachedPNGWriter();
 		int addPart(const int startx, const int starty, const int width, const int height);
 		virtual bool write(const std::string& path) override;
 		void discardPart();
 		virtual bool compose(const std::string& path, const double scale);
+		// Waits for the parts still being written, compose does that itself
+		bool finishParts();
+		// Time spent packing parts to disk, and how long drawing waited for that
+		double writeSeconds() const { return static_cast<double>(m_writeNanos.load()) / 1e9; }
+		double stallSeconds() const { return static_cast<double>(m_stallNanos) / 1e9; }
 
 	protected:
 
+		// Rows of a part are decoded this many at a time ahead of the blender, composed rows go to the output in bands as big
+		static constexpr size_t BAND_ROWS{ 32 };
+
 		struct ImagePart
 		{
 			int x, y;
-			size_t width, height;
-			std::string filename;
-			std::fstream file;
-			png_structp pngPtr;
-			png_infop pngInfo;
+			size_t width, height; // height counts down while the part is composed
+			ScratchPart scratch;
+			// The band being blended and the one that is decoded meanwhile, see composeRow
+			memory::TrackedVector<Channel, memory::MEM_IMAGE> band, nextBand;
+			size_t bandPos, bandRows, undecoded;
+			std::future<bool> decoded;
 
 			ImagePart(const std::string& _file, const int _x, const int _y, const size_t _w, const size_t _h)
-				: x(_x), y(_y), width(_w), height(_h), filename(_file), file{}, pngPtr(nullptr), pngInfo(nullptr) {}
-
-			ImagePart(const ImagePart& part)
-				: x(part.x), y(part.y), width(part.width), height(part.height), filename(part.filename), file{}, pngPtr(nullptr), pngInfo(nullptr) {}
-
-			//Not needed
-			ImagePart& operator=(const ImagePart& part)
-			{
-				this->x = part.x;
-				this->y = part.y;
-				this->width = part.width;
-				this->height = part.height;
-				this->filename = part.filename;
-				if (part.file.is_open())
-					file.open(filename);
-				pngPtr = nullptr;
-				pngInfo = nullptr;
-				return *this;
-			}
+				: x(_x), y(_y), width(_w), height(_h), scratch(_file, _w, _h), bandPos(0), bandRows(0), undecoded(0) {}
+		};
+
+		/*
+		 Last stage of compose: with a thread pool the composed rows are collected in bands and handed to 'sink' on a
+		 thread of their own, so encoding overlaps with decoding and blending the next band. Without one rows go
+		 to 'sink' right away.
+		*/
+		class OutputStage
+		{
+		public:
+			OutputStage(const size_t rowBytes, std::function<bool(const Channel*)> sink);
+			~OutputStage();
+			bool push(const Channel* row);
+			// Writes the rows still waiting, call before finishing the encoder
+			bool finish();
+			double seconds() const { return static_cast<double>(m_busyNanos) / 1e9; }
+			size_t rows() const { return m_rowsWritten; }
+
+		private:
+			bool flush();
+
+			size_t m_rowBytes;
+			std::function<bool(const Channel*)> m_sink;
+			std::vector<Channel> m_filling;
+			std::vector<Channel> m_writing;
+			size_t m_rows;
+			std::future<bool> m_pending;
+			uint64_t m_busyNanos;
+			size_t m_rowsWritten;
 		};
 
+		// Blends row y of every part covering it into 'line'
+		bool composeRow(const size_t y, Channel* line);
+		void printComposeStats(const OutputStage& output) const;
+
 		size_t m_origW;
 		size_t m_origH;
 		int offsetX;
 		int offsetY;
 
-		std::vector<ImagePart> m_partList;
+		ScratchDir m_scratch; // declared before the parts, their files are closed before it is removed
+		// A deque, background writes keep using their part while the next ones are added
+		std::deque<ImagePart> m_partList;
+
+	private:
+		bool writePart(ImagePart* part, const ImageCanvas* canvas);
+		void queueBand(ImagePart& img);
+		bool decodeBand(ImagePart* img, const size_t rows);
+
+		// Time spent in the decode and blend stages of compose
+		std::atomic<uint64_t> m_decodeNanos;
+		uint64_t m_blendNanos;
+		uint64_t m_decodedBytes;
+
+		// Parts packed to disk while the next one is drawn, at most Global::settings.pipelineDepth
+		std::deque<std::future<bool>> m_pendingWrites;
+		std::atomic<uint64_t> m_writeNanos;
+		uint64_t m_stallNanos;
 	};
 }
\ No newline at end of file
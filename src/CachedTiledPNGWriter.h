@@ -1,6 +1,9 @@
 #pragma once
 
+#include <memory>
 #include "CachedPNGWriter.h"
+#include "ImageEncoder.h"
+#include "TileStore.h"
 
 namespace image
 {
@@ -13,14 +16,10 @@ namespace image
 
 		struct ImageTile
 		{
-			std::fstream fileHandle;
-			png_structp pngPtr;
-			png_infop pngInfo;
-
-			ImageTile()
-				: pngPtr(nullptr), pngInfo(nullptr)
-			{}
-
+			std::unique_ptr<std::iostream> stream;
+			std::unique_ptr<ImageEncoder> encoder;
+			TileId id;
+			std::string name;
 		};
 
 	};
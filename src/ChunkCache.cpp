@@ -0,0 +1,93 @@
+//C++ Header
+#include <iostream>
+#include <algorithm>
+//My-Header
+#include "ChunkCache.h"
+#include "MemoryTracker.h"
+
+namespace terrain
+{
+	size_t DecodedChunk::bytes() const
+	{
+		size_t size = sizeof(DecodedChunk);
+		for (const auto& section : sections) {
+			size += sizeof(DecodedSection)
+				+ section.palette.capacity() * sizeof(StateID_t)
+				+ section.blockStates.capacity() * sizeof(uint64_t)
+				+ section.blockLight.capacity()
+				+ section.skyLight.capacity();
+		}
+		return size;
+	}
+
+	ChunkCache::ChunkCache()
+		: m_budget(0), m_used(0), m_peak(0), m_hits(0), m_misses(0), m_evicted(0)
+	{}
+
+	void ChunkCache::setBudget(const uint64_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_budget = bytes;
+		while (m_used > m_budget) {
+			evict();
+		}
+	}
+
+	std::shared_ptr<const DecodedChunk> ChunkCache::find(const int32_t x, const int32_t z)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const auto it = m_index.find(key(x, z));
+		if (it == m_index.end()) {
+			++m_misses;
+			return nullptr;
+		}
+		++m_hits;
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		return *it->second;
+	}
+
+	void ChunkCache::insert(std::shared_ptr<const DecodedChunk> chunk)
+	{
+		const uint64_t size = chunk->bytes();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (size > m_budget || m_index.count(key(chunk->x, chunk->z)) != 0) {
+			return;
+		}
+		while (m_used + size > m_budget) {
+			evict();
+		}
+		m_used += size;
+		memory::allocated(memory::MEM_CHUNKCACHE, size);
+		m_peak = std::max(m_peak, m_used);
+		m_entries.push_front(std::move(chunk));
+		m_index.emplace(key(m_entries.front()->x, m_entries.front()->z), m_entries.begin());
+	}
+
+	void ChunkCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.clear();
+		m_index.clear();
+		memory::released(memory::MEM_CHUNKCACHE, m_used);
+		m_used = 0;
+	}
+
+	void ChunkCache::evict()
+	{
+		const auto& last = m_entries.back();
+		const uint64_t size = last->bytes();
+		m_used -= size;
+		memory::released(memory::MEM_CHUNKCACHE, size);
+		m_index.erase(key(last->x, last->z));
+		m_entries.pop_back();
+		++m_evicted;
+	}
+
+	void ChunkCache::printStats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const double mib = 1024.0 * 1024.0;
+		std::cout << "Chunk cache: " << m_hits << " chunks copied, " << m_misses << " decoded, " << m_evicted << " evicted, "
+			<< "peak " << static_cast<double>(m_peak) / mib << " of " << static_cast<double>(m_budget) / mib << " MiB\n";
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+//C++ Header
+#include <cstdint>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+//My-Header
+#include "defines.h"
+
+namespace terrain
+{
+	// One section of a chunk as it is stored in the region file, with the palette already turned into block ids
+	struct DecodedSection
+	{
+		int32_t y;
+		bool denselyPacked; // block states of chunks before 20w17a, see getPalletIndex
+		std::vector<StateID_t> palette;
+		std::vector<uint64_t> blockStates;
+		std::vector<uint8_t> blockLight; // only kept when -night or -skylight need it
+		std::vector<uint8_t> skyLight; // only kept for -skylight
+	};
+
+	// A chunk after inflating and parsing, before it is placed into the terrain of the current pass
+	struct DecodedChunk
+	{
+		int32_t x, z;
+		bool valid; // false for chunks that are never drawn, like ones that aren't generated yet
+		std::vector<DecodedSection> sections;
+
+		size_t bytes() const;
+	};
+
+	/*
+	 Decoded chunks kept across the passes of an incremental render. Every pass also loads the chunks around
+	 its area, and loading a region decodes all of its chunks, so most chunks are decoded several times
+	 otherwise. Chunks stay in their packed palette form, least recently used ones go when the budget is full.
+	 Safe to use from the threads loading regions.
+	*/
+	class ChunkCache
+	{
+	public:
+		ChunkCache();
+
+		// 0 disables the cache, a smaller budget than before drops the least recently used chunks
+		void setBudget(const uint64_t bytes);
+		bool enabled() const
+		{
+			return m_budget != 0;
+		}
+		std::shared_ptr<const DecodedChunk> find(const int32_t x, const int32_t z);
+		void insert(std::shared_ptr<const DecodedChunk> chunk);
+		void clear();
+		void printStats() const;
+
+	private:
+		using Entries = std::list<std::shared_ptr<const DecodedChunk>>; // most recently used first
+
+		static uint64_t key(const int32_t x, const int32_t z)
+		{
+			return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+		}
+
+		// Drops the least recently used chunk, the mutex has to be held
+		void evict();
+
+		mutable std::mutex m_mutex;
+		uint64_t m_budget;
+		uint64_t m_used;
+		uint64_t m_peak;
+		Entries m_entries;
+		std::unordered_map<uint64_t, Entries::iterator> m_index;
+		size_t m_hits, m_misses, m_evicted;
+	};
+}
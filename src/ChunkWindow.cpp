@@ -0,0 +1,132 @@
+//C++ Header
+#include <iostream>
+#include <future>
+#include <mutex>
+#include <algorithm>
+//My-Header
+#include "ChunkWindow.h"
+
+namespace
+{
+	// Region a chunk is in, rounding negative positions down too
+	int regionOf(const int chunk)
+	{
+		return (chunk < 0 ? chunk - (REGIONSIZE - 1) : chunk) / REGIONSIZE;
+	}
+}
+
+namespace terrain
+{
+	ChunkWindow::ChunkWindow(const std::string& fromPath)
+		: m_fromPath(fromPath), m_decodedBytes(0), m_loadedChunks(0), m_missingLight(initialLight() & 0xF)
+	{
+		const size_t width = static_cast<size_t>(Global::ToChunkX - Global::FromChunkX);
+		const size_t depth = static_cast<size_t>(Global::ToChunkZ - Global::FromChunkZ);
+		// For rotation, X and Z are swapped (East and West), see the Mapsize of a pass
+		const bool swapped = (Global::settings.orientation == East || Global::settings.orientation == West);
+		m_chunksX = swapped ? depth : width;
+		m_chunksZ = swapped ? width : depth;
+		m_slots.resize(m_chunksX * m_chunksZ);
+
+		// Slots are placed with LAYOUT_COLUMNS, see placeChunkAlone
+		std::vector<size_t> worldX(CHUNKSIZE_X), worldZ(CHUNKSIZE_Z);
+		for (size_t x = 0; x < worldX.size(); ++x) {
+			worldX[x] = x * CHUNKSIZE_Z;
+		}
+		for (size_t z = 0; z < worldZ.size(); ++z) {
+			worldZ[z] = z;
+		}
+		orientColumns(Global::settings.orientation, worldX, worldZ, m_columnX, m_columnZ);
+	}
+
+	ChunkWindow::~ChunkWindow()
+	{
+		memory::released(memory::MEM_DECODE, m_decodedBytes);
+	}
+
+	std::pair<int, int> ChunkWindow::worldChunk(const size_t chunkX, const size_t chunkZ) const
+	{
+		const int x = static_cast<int>(chunkX), z = static_cast<int>(chunkZ);
+		switch (Global::settings.orientation) {
+		case North:
+			return { Global::FromChunkX + x, Global::FromChunkZ + z };
+		case East:
+			return { Global::ToChunkX - 1 - z, Global::FromChunkZ + x };
+		case South:
+			return { Global::ToChunkX - 1 - x, Global::ToChunkZ - 1 - z };
+		default:
+			return { Global::FromChunkX + z, Global::ToChunkZ - 1 - x };
+		}
+	}
+
+	void ChunkWindow::load(const size_t diagonal)
+	{
+		const size_t fromX = diagonal < m_chunksZ ? 0 : diagonal - (m_chunksZ - 1);
+		const size_t toX = std::min(diagonal + 1, m_chunksX);
+		std::set<std::pair<int, int>> regions;
+		for (size_t x = fromX; x < toX; ++x) {
+			const auto chunk = worldChunk(x, diagonal - x);
+			const std::pair<int, int> region(regionOf(chunk.first), regionOf(chunk.second));
+			if (m_regions.count(region) == 0) {
+				regions.insert(region);
+			}
+		}
+		decodeRegions(regions);
+
+		for (size_t x = fromX; x < toX; ++x) {
+			const auto it = m_decoded.find(worldChunk(x, diagonal - x));
+			if (it == m_decoded.end()) {
+				continue;
+			}
+			auto chunk = std::make_unique<ChunkSlot>();
+			placeChunkAlone(*it->second, chunk->blocks, chunk->light);
+			chunk->heights.assign(CHUNKSIZE_X * CHUNKSIZE_Z, static_cast<uint16_t>(0xff00));
+			m_slots[x * m_chunksZ + diagonal - x] = std::move(chunk);
+			const size_t bytes = it->second->bytes();
+			memory::released(memory::MEM_DECODE, bytes);
+			m_decodedBytes -= bytes;
+			m_decoded.erase(it);
+			++m_loadedChunks;
+		}
+	}
+
+	void ChunkWindow::decodeRegions(const std::set<std::pair<int, int>>& regions)
+	{
+		std::mutex decodedMutex;
+		// Chunks of this area that are not placed yet, others only turn up when a region reaches outside the area
+		const auto keep = [this, &decodedMutex](const std::shared_ptr<const DecodedChunk>& chunk) {
+			const size_t bytes = chunk->bytes();
+			std::lock_guard<std::mutex> lock(decodedMutex);
+			if (m_decoded.emplace(std::make_pair(chunk->x, chunk->z), chunk).second) {
+				memory::allocated(memory::MEM_DECODE, bytes);
+				m_decodedBytes += bytes;
+			}
+		};
+		// Region files that don't exist are fine, the area doesn't have to be all generated
+		if (Global::threadPool) {
+			std::vector<std::future<bool>> results;
+			for (const auto& region : regions) {
+				results.emplace_back(Global::threadPool->enqueue([this, &keep](const int x, const int z) {
+					return decodeRegion(m_fromPath, x, z, keep);
+				}, region.first, region.second));
+			}
+			for (auto& r : results) {
+				r.get();
+			}
+		} else {
+			for (const auto& region : regions) {
+				decodeRegion(m_fromPath, region.first, region.second, keep);
+			}
+		}
+		m_regions.insert(regions.begin(), regions.end());
+	}
+
+	void ChunkWindow::drop(const size_t diagonal)
+	{
+		const size_t fromX = diagonal < m_chunksZ ? 0 : diagonal - (m_chunksZ - 1);
+		const size_t toX = std::min(diagonal + 1, m_chunksX);
+		for (size_t x = fromX; x < toX; ++x) {
+			m_slots[x * m_chunksZ + diagonal - x].reset();
+		}
+	}
+}
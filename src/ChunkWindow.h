@@ -0,0 +1,94 @@
+#pragma once
+//C++ Header
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <utility>
+//My-Header
+#include "globals.h"
+#include "worldloader.h"
+
+namespace terrain
+{
+	// One chunk of a -stream render, blocks and light are laid out like the terrain of an area of just this chunk
+	struct ChunkSlot
+	{
+		TerrainVector blocks;
+		LightVector light;
+		memory::TrackedVector<uint16_t, memory::MEM_HEIGHTMAP> heights; // like Global::heightMap, see optimizeTerrain
+	};
+
+	/*
+	 Terrain of a -stream render. The chunks of the current area (Global::From/ToChunk, with the chunks around it)
+	 are looked at in view coordinates, where x and z run the way COLUMNAT takes them for the orientation.
+	 A diagonal is all chunks with the same view x + z, the image is drawn diagonal by diagonal from the back,
+	 so only the diagonals around the one being drawn have to be in memory. Region files are decoded as soon as
+	 a diagonal needs one of their chunks, the chunks of later diagonals wait in their decoded form until then.
+	 Missing chunks read as air with the preset light, like they do in the terrain of a pass.
+	*/
+	class ChunkWindow
+	{
+	public:
+		explicit ChunkWindow(const std::string& fromPath);
+		ChunkWindow(const ChunkWindow&) = delete;
+		ChunkWindow& operator=(const ChunkWindow&) = delete;
+		~ChunkWindow();
+
+		size_t chunksX() const noexcept { return m_chunksX; }
+		size_t chunksZ() const noexcept { return m_chunksZ; }
+		size_t diagonals() const noexcept { return m_chunksX + m_chunksZ - 1; }
+		// Places the chunks of 'diagonal', decoding the region files they are in if that didn't happen yet
+		void load(const size_t diagonal);
+		void drop(const size_t diagonal);
+		size_t loadedChunks() const noexcept { return m_loadedChunks; }
+
+		// nullptr if the chunk doesn't exist or isn't loaded
+		ChunkSlot* slot(const size_t chunkX, const size_t chunkZ) const
+		{
+			return m_slots[chunkX * m_chunksZ + chunkZ].get();
+		}
+		// Blocks of column x, z from y = 0 up, nullptr for air
+		const StateID_t* column(const size_t x, const size_t z) const
+		{
+			const ChunkSlot* chunk = slot(x / CHUNKSIZE_X, z / CHUNKSIZE_Z);
+			return chunk ? &chunk->blocks[columnIn(x, z) * Global::MapsizeY] : nullptr;
+		}
+		// Same as BLOCKAT and GETLIGHTAT on the whole area
+		StateID_t block(const size_t x, const size_t y, const size_t z) const
+		{
+			const StateID_t* blocks = column(x, z);
+			return blocks ? blocks[y] : static_cast<StateID_t>(AIR);
+		}
+		int light(const size_t x, const size_t y, const size_t z) const
+		{
+			const ChunkSlot* chunk = slot(x / CHUNKSIZE_X, z / CHUNKSIZE_Z);
+			if (!chunk || chunk->light.empty()) {
+				return m_missingLight;
+			}
+			return (chunk->light[(y / 2) + columnIn(x, z) * ((Global::MapsizeY + 1) / 2)] >> ((y % 2) * 4)) & 0xF;
+		}
+
+	private:
+		// Column of view x, z inside its slot, which is laid out the way the world lies
+		size_t columnIn(const size_t x, const size_t z) const
+		{
+			return m_columnX[x % CHUNKSIZE_X] + m_columnZ[z % CHUNKSIZE_Z];
+		}
+		// World chunk shown at view chunk x, z
+		std::pair<int, int> worldChunk(const size_t chunkX, const size_t chunkZ) const;
+		void decodeRegions(const std::set<std::pair<int, int>>& regions);
+
+		std::string m_fromPath;
+		size_t m_chunksX, m_chunksZ;
+		std::vector<size_t> m_columnX, m_columnZ; // like Global::columnX and columnZ for one slot
+		std::vector<std::unique_ptr<ChunkSlot>> m_slots;
+		std::set<std::pair<int, int>> m_regions; // decoded already
+		std::map<std::pair<int, int>, std::shared_ptr<const DecodedChunk>> m_decoded; // waiting for their diagonal
+		uint64_t m_decodedBytes;
+		size_t m_loadedChunks;
+		int m_missingLight;
+	};
+}
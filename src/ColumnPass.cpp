@@ -0,0 +1,47 @@
+//C++ Header
+#include <iostream>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <algorithm>
+//My-Header
+#include "ColumnPass.h"
+#include "globals.h"
+#include "helper.h"
+
+namespace
+{
+	// Ranges per thread, so threads that are done early take over some of the work of slower ones
+	constexpr size_t RANGES_PER_THREAD{ 4 };
+}
+
+namespace terrain
+{
+	size_t runColumnPass(const std::string& name, const size_t fromX, const size_t toX, const std::function<size_t(size_t, size_t)>& pass)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const size_t columns = toX > fromX ? toX - fromX : 0;
+		const size_t threads = Global::threadPool ? Global::threadPool->size() : 1;
+		const size_t width = std::max<size_t>((columns + threads * RANGES_PER_THREAD - 1) / (threads * RANGES_PER_THREAD), 1);
+		const size_t ranges = (columns + width - 1) / width;
+
+		size_t touched = 0, done = 0;
+		helper::printProgress(0, ranges);
+		std::vector<std::future<size_t>> results;
+		for (size_t from = fromX; from < toX; from += width) {
+			const size_t to = std::min(from + width, toX);
+			if (Global::threadPool) {
+				results.emplace_back(Global::threadPool->enqueue(pass, from, to));
+			} else {
+				touched += pass(from, to);
+				helper::printProgress(++done, ranges);
+			}
+		}
+		for (auto& r : results) {
+			touched += r.get();
+			helper::printProgress(++done, ranges);
+		}
+		std::cout << name << ": " << touched << " blocks touched in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s\n";
+		return touched;
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+//C++ Header
+#include <cstddef>
+#include <string>
+#include <functional>
+
+namespace terrain
+{
+	/*
+	 Runs a pass over the columns x = fromX..toX - 1 (every z) of the terrain. The columns are cut into ranges of x,
+	 which run on Global::threadPool, or one after the other without -threads. 'pass' gets a range, may only write
+	 the columns inside it and returns how many blocks it touched. Prints 'name' with the blocks touched and the
+	 time it took, returns the blocks.
+	*/
+	size_t runColumnPass(const std::string& name, const size_t fromX, const size_t toX, const std::function<size_t(size_t, size_t)>& pass);
+}
@@ -0,0 +1,477 @@
+//C++ Header
+#include <iostream>
+#include <algorithm>
+#include <queue>
+#include <cstring> //memcpy (for g++)
+#include <zlib.h>
+//My-Header
+#include "FastPNGEncoder.h"
+
+namespace
+{
+	constexpr size_t NUM_LITLEN{ 286 };
+	constexpr size_t NUM_DIST{ 30 };
+	constexpr size_t MAX_CODE_LEN{ 15 };
+	constexpr size_t MIN_MATCH{ 4 };
+	constexpr size_t MAX_MATCH{ 258 };
+	constexpr size_t MAX_DISTANCE{ 32768 };
+	constexpr size_t IDAT_SIZE{ 1 << 16 };
+
+	constexpr std::array<uint16_t, 29> LENGTH_BASE{ 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	constexpr std::array<uint8_t, 29> LENGTH_EXTRA{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	constexpr std::array<uint16_t, 30> DIST_BASE{ 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	constexpr std::array<uint8_t, 30> DIST_EXTRA{ 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	/*
+	 The precomputed huffman table. The code lengths are derived once from a symbol distribution that is
+	 typical for filtered isometric maps: residuals close to 0, lots of short pixel repeats and long runs
+	 of transparent background.
+	*/
+	struct HuffmanTables
+	{
+		std::array<uint16_t, NUM_LITLEN> litCode;
+		std::array<uint8_t, NUM_LITLEN> litLen;
+		std::array<uint16_t, NUM_DIST> distCode;
+		std::array<uint8_t, NUM_DIST> distLen;
+		std::array<uint8_t, MAX_MATCH + 1> lengthSymbol; // match length -> index into LENGTH_BASE
+		std::array<uint8_t, 512> distSymbol; // see distanceSymbol()
+
+		HuffmanTables()
+		{
+			std::vector<uint32_t> litFreq(NUM_LITLEN);
+			for (size_t i = 0; i < 256; ++i) {
+				const size_t residual = std::min<size_t>(i, 256 - i);
+				litFreq[i] = 40 + 3000 / static_cast<uint32_t>(residual + 1);
+			}
+			litFreq[256] = 1; // end of block
+			for (size_t i = 0; i < LENGTH_BASE.size(); ++i) {
+				litFreq[257 + i] = i < 6 ? 20000 : 3000;
+			}
+			litFreq[285] = 200000; // long runs of the same pixel
+			buildLengths(litFreq, litLen.data());
+
+			std::vector<uint32_t> distFreq(NUM_DIST);
+			for (size_t i = 0; i < NUM_DIST; ++i) {
+				distFreq[i] = i < 6 ? 20 : (i < 23 ? 5000 : 1000);
+			}
+			distFreq[3] = 300000; // distance 4, the pixel to the left
+			buildLengths(distFreq, distLen.data());
+
+			buildCodes(litLen.data(), litCode.data(), NUM_LITLEN);
+			buildCodes(distLen.data(), distCode.data(), NUM_DIST);
+
+			size_t sym = 0;
+			for (size_t len = 3; len <= MAX_MATCH; ++len) {
+				while (sym + 1 < LENGTH_BASE.size() && LENGTH_BASE[sym + 1] <= len) {
+					++sym;
+				}
+				lengthSymbol[len] = static_cast<uint8_t>(sym);
+			}
+			sym = 0;
+			for (size_t d = 1; d <= 256; ++d) {
+				while (sym + 1 < NUM_DIST && DIST_BASE[sym + 1] <= d) {
+					++sym;
+				}
+				distSymbol[d - 1] = static_cast<uint8_t>(sym);
+			}
+			for (size_t d = 257; d <= MAX_DISTANCE; d += 128) {
+				while (sym + 1 < NUM_DIST && DIST_BASE[sym + 1] <= d) {
+					++sym;
+				}
+				distSymbol[256 + ((d - 1) >> 7)] = static_cast<uint8_t>(sym);
+			}
+		}
+
+		// Same trick zlib uses, distances above 256 are looked up with a granularity of 128
+		uint8_t distanceSymbol(const size_t distance) const
+		{
+			return distance <= 256 ? distSymbol[distance - 1] : distSymbol[256 + ((distance - 1) >> 7)];
+		}
+
+		// Plain huffman, frequencies get flattened until no code is longer than 15 bits
+		static void buildLengths(std::vector<uint32_t> freq, uint8_t* lengths)
+		{
+			const size_t num = freq.size();
+			for (;;) {
+				using Node = std::pair<uint64_t, size_t>;
+				std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+				std::vector<size_t> parent(num * 2, 0);
+				for (size_t i = 0; i < num; ++i) {
+					queue.emplace(freq[i], i);
+				}
+				size_t next = num;
+				while (queue.size() > 1) {
+					const Node a = queue.top();
+					queue.pop();
+					const Node b = queue.top();
+					queue.pop();
+					parent[a.second] = next;
+					parent[b.second] = next;
+					queue.emplace(a.first + b.first, next++);
+				}
+				const size_t root = next - 1;
+				size_t maxLen = 0;
+				for (size_t i = 0; i < num; ++i) {
+					size_t depth = 0;
+					for (size_t n = i; n != root; n = parent[n]) {
+						++depth;
+					}
+					lengths[i] = static_cast<uint8_t>(depth);
+					maxLen = std::max(maxLen, depth);
+				}
+				if (maxLen <= MAX_CODE_LEN) {
+					return;
+				}
+				for (auto& f : freq) {
+					f = (f >> 1) + 1;
+				}
+			}
+		}
+
+		// Canonical codes as described in RFC 1951, stored bit reversed since deflate writes LSB first
+		static void buildCodes(const uint8_t* lengths, uint16_t* codes, const size_t num)
+		{
+			std::array<uint16_t, MAX_CODE_LEN + 1> count{};
+			for (size_t i = 0; i < num; ++i) {
+				++count[lengths[i]];
+			}
+			count[0] = 0;
+			std::array<uint16_t, MAX_CODE_LEN + 2> nextCode{};
+			uint16_t code = 0;
+			for (size_t bits = 1; bits <= MAX_CODE_LEN; ++bits) {
+				code = static_cast<uint16_t>((code + count[bits - 1]) << 1);
+				nextCode[bits] = code;
+			}
+			for (size_t i = 0; i < num; ++i) {
+				const uint8_t len = lengths[i];
+				if (len == 0) {
+					continue;
+				}
+				uint16_t c = nextCode[len]++;
+				uint16_t reversed = 0;
+				for (uint8_t b = 0; b < len; ++b) {
+					reversed = static_cast<uint16_t>((reversed << 1) | (c & 1));
+					c = static_cast<uint16_t>(c >> 1);
+				}
+				codes[i] = reversed;
+			}
+		}
+	};
+
+	const HuffmanTables& getTables()
+	{
+		static const HuffmanTables tables;
+		return tables;
+	}
+
+	inline uint32_t read32(const uint8_t* data)
+	{
+		uint32_t val;
+		std::memcpy(&val, data, sizeof(val));
+		return val;
+	}
+
+	inline size_t hash32(const uint32_t val)
+	{
+		return static_cast<size_t>((val * 2654435761U) >> (32 - 14));
+	}
+
+	inline void putBE32(uint8_t* dest, const uint32_t val)
+	{
+		dest[0] = static_cast<uint8_t>(val >> 24);
+		dest[1] = static_cast<uint8_t>(val >> 16);
+		dest[2] = static_cast<uint8_t>(val >> 8);
+		dest[3] = static_cast<uint8_t>(val);
+	}
+}
+
+namespace image
+{
+	FastPNGEncoder::FastPNGEncoder(const PNGFilter filter)
+		: m_filter(filter == FILTER_NONE || filter == FILTER_SUB ? filter : FILTER_UP), m_out(nullptr), m_width(0), m_height(0), m_rowsWritten(0),
+		m_lineLen(0), m_streamPos(0), m_hasPrevLine(false), m_adler(1), m_bitBuffer(0), m_bitCount(0)
+	{}
+
+	bool FastPNGEncoder::begin(std::ostream& out, const size_t width, const size_t height, const bool addSoftwareTag)
+	{
+		static_assert(HASH_BITS == 14, "hash32() assumes 14 bits");
+		const HuffmanTables& tables = getTables();
+
+		m_out = &out;
+		m_width = width;
+		m_height = height;
+		m_rowsWritten = 0;
+		m_lineLen = width * 4 + 1;
+		m_streamPos = 0;
+		m_hasPrevLine = false;
+		m_adler = static_cast<uint32_t>(adler32(0L, Z_NULL, 0));
+		m_bitBuffer = 0;
+		m_bitCount = 0;
+		m_window.assign(m_lineLen * 2, 0);
+		m_prevRow.assign(width * 4, 0);
+		m_hashTable.assign(size_t(1) << HASH_BITS, 0);
+		m_idat.clear();
+		m_idat.reserve(IDAT_SIZE + 1024);
+
+		static constexpr uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		m_out->write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+		uint8_t ihdr[13];
+		putBE32(ihdr, static_cast<uint32_t>(width));
+		putBE32(ihdr + 4, static_cast<uint32_t>(height));
+		ihdr[8] = 8; // bit depth
+		ihdr[9] = 6; // RGBA
+		ihdr[10] = 0; // deflate
+		ihdr[11] = 0; // adaptive filtering (each row stores its filter type)
+		ihdr[12] = 0; // no interlace
+		writeChunk("IHDR", ihdr, sizeof(ihdr));
+
+		if (addSoftwareTag) {
+			static constexpr char text[] = "Software\0mcmap";
+			writeChunk("tEXt", reinterpret_cast<const uint8_t*>(text), sizeof(text) - 1);
+		}
+
+		// zlib header: deflate with 32K window, no dictionary, "fastest" level
+		m_idat.push_back(0x78);
+		m_idat.push_back(0x01);
+
+		// Everything goes into a single final block with dynamic huffman codes
+		putBits(1, 1); // BFINAL
+		putBits(2, 2); // BTYPE = dynamic
+		putBits(NUM_LITLEN - 257, 5);
+		putBits(NUM_DIST - 1, 5);
+		putBits(19 - 4, 4);
+		// The code length alphabet: lengths 0-15 all get 4 bit codes, the repeat codes 16-18 are unused
+		static constexpr uint8_t clOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		for (const uint8_t sym : clOrder) {
+			putBits(sym < 16 ? 4 : 0, 3);
+		}
+		const auto putCodeLength = [this](const uint8_t len) {
+			// With 16 codes of length 4, the canonical code of symbol n is n, written reversed
+			uint32_t reversed = 0;
+			for (uint32_t b = 0; b < 4; ++b) {
+				reversed |= ((len >> b) & 1U) << (3 - b);
+			}
+			putBits(reversed, 4);
+		};
+		for (const uint8_t len : tables.litLen) {
+			putCodeLength(len);
+		}
+		for (const uint8_t len : tables.distLen) {
+			putCodeLength(len);
+		}
+
+		return m_out->good();
+	}
+
+	bool FastPNGEncoder::writeRow(const Channel* row)
+	{
+		if (m_out == nullptr || m_rowsWritten >= m_height) {
+			return false;
+		}
+		filterRow(row);
+		uint8_t* line = &m_window[m_lineLen];
+		m_adler = static_cast<uint32_t>(adler32(m_adler, line, static_cast<uInt>(m_lineLen)));
+		compressRow();
+
+		// Current line becomes the previous one
+		std::memcpy(m_window.data(), line, m_lineLen);
+		std::memcpy(m_prevRow.data(), row, m_width * 4);
+		m_streamPos += m_lineLen;
+		m_hasPrevLine = true;
+		++m_rowsWritten;
+
+		flushIDAT(false);
+		return m_out->good();
+	}
+
+	bool FastPNGEncoder::end()
+	{
+		if (m_out == nullptr) {
+			return false;
+		}
+		// Pad missing rows, so we always produce a valid image
+		if (m_rowsWritten < m_height) {
+			const std::vector<Channel> empty(m_width * 4, 0);
+			while (m_rowsWritten < m_height) {
+				writeRow(empty.data());
+			}
+		}
+
+		const HuffmanTables& tables = getTables();
+		putBits(tables.litCode[256], tables.litLen[256]); // end of block
+		flushBits();
+		uint8_t adler[4];
+		putBE32(adler, m_adler);
+		m_idat.insert(m_idat.end(), adler, adler + 4);
+		flushIDAT(true);
+		writeChunk("IEND", nullptr, 0);
+
+		const bool ok = m_out->good();
+		m_out = nullptr;
+		m_window.clear();
+		m_window.shrink_to_fit();
+		m_prevRow.clear();
+		m_prevRow.shrink_to_fit();
+		m_hashTable.clear();
+		m_hashTable.shrink_to_fit();
+		if (!ok) {
+			std::cerr << "Error writing png data\n";
+		}
+		return ok;
+	}
+
+	void FastPNGEncoder::filterRow(const Channel* row)
+	{
+		uint8_t* line = &m_window[m_lineLen];
+		const size_t rowLen = m_width * 4;
+		uint8_t* dest = line + 1;
+
+		if (m_filter == FILTER_NONE) {
+			line[0] = 0;
+			std::memcpy(dest, row, rowLen);
+		} else if (m_filter == FILTER_SUB) {
+			line[0] = 1;
+			std::memcpy(dest, row, std::min<size_t>(4, rowLen));
+			for (size_t i = 4; i < rowLen; ++i) {
+				dest[i] = static_cast<uint8_t>(row[i] - row[i - 4]);
+			}
+		} else {
+			line[0] = 2;
+			for (size_t i = 0; i < rowLen; ++i) {
+				dest[i] = static_cast<uint8_t>(row[i] - m_prevRow[i]);
+			}
+		}
+	}
+
+	void FastPNGEncoder::compressRow()
+	{
+		const uint8_t* window = m_window.data();
+		const size_t lineStart = m_lineLen;
+		const size_t lineEnd = m_lineLen * 2;
+		// Window index 0 corresponds to this stream position
+		const size_t windowPos = m_streamPos - m_lineLen;
+		const size_t firstValid = m_hasPrevLine ? 0 : lineStart;
+
+		const auto matchLength = [window, lineEnd](const size_t a, const size_t b) {
+			const size_t maxLen = std::min(MAX_MATCH, lineEnd - b);
+			size_t len = MIN_MATCH;
+			while (len < maxLen && window[a + len] == window[b + len]) {
+				++len;
+			}
+			return len;
+		};
+
+		size_t i = lineStart;
+		putLiteral(window[i++]); // filter type
+		while (i < lineEnd) {
+			if (i + MIN_MATCH <= lineEnd) {
+				const uint32_t cur = read32(window + i);
+				size_t bestLen = 0;
+				size_t bestDist = 0;
+
+				// Repeat of the pixel to the left
+				if (i >= firstValid + 4 && read32(window + i - 4) == cur) {
+					bestLen = matchLength(i - 4, i);
+					bestDist = 4;
+				}
+
+				size_t& slot = m_hashTable[hash32(cur)];
+				const size_t candidate = slot; // stream position + 1, 0 if empty
+				slot = windowPos + i + 1;
+				if (bestLen < MAX_MATCH && candidate > windowPos + firstValid) {
+					const size_t cand = candidate - 1 - windowPos;
+					const size_t dist = i - cand;
+					if (dist != bestDist && dist <= MAX_DISTANCE && read32(window + cand) == cur) {
+						const size_t len = matchLength(cand, i);
+						if (len > bestLen) {
+							bestLen = len;
+							bestDist = dist;
+						}
+					}
+				}
+
+				if (bestLen >= MIN_MATCH) {
+					putMatch(bestLen, bestDist);
+					i += bestLen;
+					continue;
+				}
+			}
+			putLiteral(window[i++]);
+		}
+	}
+
+	void FastPNGEncoder::putBits(const uint32_t bits, const uint32_t count)
+	{
+		m_bitBuffer |= static_cast<uint64_t>(bits) << m_bitCount;
+		m_bitCount += count;
+		if (m_bitCount >= 32) {
+			const uint32_t word = static_cast<uint32_t>(m_bitBuffer);
+			m_idat.push_back(static_cast<uint8_t>(word));
+			m_idat.push_back(static_cast<uint8_t>(word >> 8));
+			m_idat.push_back(static_cast<uint8_t>(word >> 16));
+			m_idat.push_back(static_cast<uint8_t>(word >> 24));
+			m_bitBuffer >>= 32;
+			m_bitCount -= 32;
+		}
+	}
+
+	void FastPNGEncoder::putLiteral(const uint8_t value)
+	{
+		const HuffmanTables& tables = getTables();
+		putBits(tables.litCode[value], tables.litLen[value]);
+	}
+
+	void FastPNGEncoder::putMatch(const size_t length, const size_t distance)
+	{
+		const HuffmanTables& tables = getTables();
+		const uint8_t lenSym = tables.lengthSymbol[length];
+		putBits(tables.litCode[257 + lenSym], tables.litLen[257 + lenSym]);
+		if (LENGTH_EXTRA[lenSym]) {
+			putBits(static_cast<uint32_t>(length - LENGTH_BASE[lenSym]), LENGTH_EXTRA[lenSym]);
+		}
+		const uint8_t distSym = tables.distanceSymbol(distance);
+		putBits(tables.distCode[distSym], tables.distLen[distSym]);
+		if (DIST_EXTRA[distSym]) {
+			putBits(static_cast<uint32_t>(distance - DIST_BASE[distSym]), DIST_EXTRA[distSym]);
+		}
+	}
+
+	void FastPNGEncoder::flushBits()
+	{
+		while (m_bitCount > 0) {
+			m_idat.push_back(static_cast<uint8_t>(m_bitBuffer));
+			m_bitBuffer >>= 8;
+			m_bitCount = m_bitCount > 8 ? m_bitCount - 8 : 0;
+		}
+		m_bitBuffer = 0;
+	}
+
+	void FastPNGEncoder::writeChunk(const char* type, const uint8_t* data, const size_t length)
+	{
+		uint8_t header[8];
+		putBE32(header, static_cast<uint32_t>(length));
+		std::memcpy(header + 4, type, 4);
+		uLong crc = crc32(0L, Z_NULL, 0);
+		crc = crc32(crc, header + 4, 4);
+		if (length > 0) {
+			crc = crc32(crc, data, static_cast<uInt>(length));
+		}
+		uint8_t footer[4];
+		putBE32(footer, static_cast<uint32_t>(crc));
+
+		m_out->write(reinterpret_cast<const char*>(header), sizeof(header));
+		if (length > 0) {
+			m_out->write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+		}
+		m_out->write(reinterpret_cast<const char*>(footer), sizeof(footer));
+	}
+
+	void FastPNGEncoder::flushIDAT(const bool force)
+	{
+		if (m_idat.size() >= IDAT_SIZE || (force && !m_idat.empty())) {
+			writeChunk("IDAT", m_idat.data(), m_idat.size());
+			m_idat.clear();
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+//C++ Header
+#include <vector>
+#include <array>
+//My-Header
+#include "ImageEncoder.h"
+#include "globals.h"
+
+namespace image
+{
+	/*
+	 Single pass RGBA8 png encoder, in the spirit of fpng.
+	 Every row uses the same filter, matches are only searched in the current and the previous row
+	 and all symbols are coded with one precomputed huffman table, so there is no second pass over the data.
+	 The result is a standard png, just a bit bigger than what libpng produces.
+	*/
+	class FastPNGEncoder : public ImageEncoder
+	{
+	public:
+		explicit FastPNGEncoder(const PNGFilter filter);
+
+		bool begin(std::ostream& out, const size_t width, const size_t height, const bool addSoftwareTag = false) override;
+		bool writeRow(const Channel* row) override;
+		bool end() override;
+
+	private:
+		void filterRow(const Channel* row);
+		void compressRow();
+		void putBits(const uint32_t bits, const uint32_t count);
+		void putLiteral(const uint8_t value);
+		void putMatch(const size_t length, const size_t distance);
+		void flushBits();
+		void writeChunk(const char* type, const uint8_t* data, const size_t length);
+		void flushIDAT(const bool force);
+
+		static constexpr size_t HASH_BITS{ 14 };
+
+		PNGFilter m_filter;
+		std::ostream* m_out;
+		size_t m_width;
+		size_t m_height;
+		size_t m_rowsWritten;
+		size_t m_lineLen; // filter byte + pixel data
+		size_t m_streamPos; // uncompressed stream position of the current line
+		bool m_hasPrevLine;
+		uint32_t m_adler;
+
+		uint64_t m_bitBuffer;
+		uint32_t m_bitCount;
+
+		std::vector<uint8_t> m_window; // previous and current filtered line, back to back
+		std::vector<Channel> m_prevRow; // unfiltered previous row, needed for the up filter
+		std::vector<size_t> m_hashTable; // stream position + 1 of the last occurrence of a 4 byte sequence
+		std::vector<uint8_t> m_idat; // compressed data not yet written
+	};
+}
@@ -0,0 +1,118 @@
+//C++ Header
+#include <algorithm>
+#include <cstring> //memcpy (for g++)
+//My-Header
+#include "ImageCanvas.h"
+#include "MemoryTracker.h"
+
+namespace
+{
+	constexpr size_t CHANNELS{ 4 };
+	constexpr size_t TILE_BYTES{ image::ImageCanvas::TILE_SIZE * image::ImageCanvas::TILE_SIZE * CHANNELS };
+}
+
+namespace image
+{
+	ImageCanvas::ImageCanvas()
+		: m_width(0), m_height(0), m_tilesX(0), m_committed(0)
+	{}
+
+	ImageCanvas::~ImageCanvas()
+	{
+		memory::released(memory::MEM_IMAGE, m_committed * TILE_BYTES);
+	}
+
+	ImageCanvas::ImageCanvas(ImageCanvas&& other) noexcept
+		: m_width(other.m_width), m_height(other.m_height), m_tilesX(other.m_tilesX), m_committed(other.m_committed), m_tiles(std::move(other.m_tiles))
+	{
+		other.m_committed = 0;
+		other.reset(0, 0);
+	}
+
+	ImageCanvas& ImageCanvas::operator=(ImageCanvas&& other) noexcept
+	{
+		if (this != &other) {
+			memory::released(memory::MEM_IMAGE, m_committed * TILE_BYTES);
+			m_width = other.m_width;
+			m_height = other.m_height;
+			m_tilesX = other.m_tilesX;
+			m_committed = other.m_committed;
+			m_tiles = std::move(other.m_tiles);
+			other.m_committed = 0;
+			other.reset(0, 0);
+		}
+		return *this;
+	}
+
+	void ImageCanvas::reset(const size_t width, const size_t height)
+	{
+		m_width = width;
+		m_height = height;
+		m_tilesX = (width + TILE_SIZE - 1) >> TILE_SHIFT;
+		memory::released(memory::MEM_IMAGE, m_committed * TILE_BYTES);
+		m_committed = 0;
+		m_tiles.clear();
+		m_tiles.shrink_to_fit();
+		m_tiles.resize(m_tilesX * ((height + TILE_SIZE - 1) >> TILE_SHIFT));
+	}
+
+	void ImageCanvas::commit(std::unique_ptr<Channel[]>& tile)
+	{
+		tile = std::make_unique<Channel[]>(TILE_BYTES); // zeroed, transparent
+		memory::allocated(memory::MEM_IMAGE, TILE_BYTES);
+		++m_committed;
+	}
+
+	void ImageCanvas::copyRow(const size_t y, const size_t x, const size_t count, Channel* dst) const
+	{
+		const size_t rowStart = (y & (TILE_SIZE - 1)) << TILE_SHIFT;
+		const std::unique_ptr<Channel[]>* tiles = &m_tiles[(y >> TILE_SHIFT) * m_tilesX];
+		for (size_t done = 0; done < count;) {
+			const size_t px = x + done;
+			const size_t offset = px & (TILE_SIZE - 1);
+			const size_t n = std::min(TILE_SIZE - offset, count - done);
+			const Channel* tile = tiles[px >> TILE_SHIFT].get();
+			if (tile != nullptr) {
+				std::memcpy(dst + done * CHANNELS, tile + (rowStart + offset) * CHANNELS, n * CHANNELS);
+			} else {
+				std::memset(dst + done * CHANNELS, 0, n * CHANNELS);
+			}
+			done += n;
+		}
+	}
+
+	void ImageCanvas::setRow(const size_t y, const Channel* src)
+	{
+		const size_t rowStart = (y & (TILE_SIZE - 1)) << TILE_SHIFT;
+		std::unique_ptr<Channel[]>* tiles = &m_tiles[(y >> TILE_SHIFT) * m_tilesX];
+		for (size_t x = 0; x < m_width; x += TILE_SIZE) {
+			const size_t n = std::min(TILE_SIZE, m_width - x) * CHANNELS;
+			const Channel* span = src + x * CHANNELS;
+			std::unique_ptr<Channel[]>& tile = tiles[x >> TILE_SHIFT];
+			if (!tile) {
+				if (std::all_of(span, span + n, [](const Channel c) { return c == 0; })) {
+					continue;
+				}
+				commit(tile);
+			}
+			std::memcpy(tile.get() + rowStart * CHANNELS, span, n);
+		}
+	}
+
+	bool ImageCanvas::isEmpty(const size_t x, const size_t y, const size_t width, const size_t height) const
+	{
+		if (x >= m_width || y >= m_height || width == 0 || height == 0) {
+			return true;
+		}
+		const size_t lastX = (std::min(x + width, m_width) - 1) >> TILE_SHIFT;
+		const size_t lastY = (std::min(y + height, m_height) - 1) >> TILE_SHIFT;
+		for (size_t ty = y >> TILE_SHIFT; ty <= lastY; ++ty) {
+			for (size_t tx = x >> TILE_SHIFT; tx <= lastX; ++tx) {
+				if (m_tiles[ty * m_tilesX + tx]) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+//C++ Header
+#include <vector>
+#include <memory>
+//My-Header
+#include "defines.h"
+
+namespace image
+{
+	/*
+	 RGBA image made of 256x256 tiles that are only allocated once something is drawn into them.
+	 Tiles nobody touched read as transparent, so the memory of an irregular world tracks the area that
+	 was actually drawn instead of its bounding box. Committing tiles is not thread safe, reading is.
+	 Committed tiles are booked to memory::MEM_IMAGE.
+	*/
+	class ImageCanvas
+	{
+	public:
+		static constexpr size_t TILE_SHIFT{ 8 };
+		static constexpr size_t TILE_SIZE{ size_t(1) << TILE_SHIFT };
+
+		ImageCanvas();
+		~ImageCanvas();
+		ImageCanvas(ImageCanvas&& other) noexcept;
+		ImageCanvas& operator=(ImageCanvas&& other) noexcept;
+
+		// Drops all tiles and sets the new size
+		void reset(const size_t width, const size_t height);
+		void release()
+		{
+			reset(0, 0);
+		}
+
+		size_t width() const noexcept { return m_width; }
+		size_t height() const noexcept { return m_height; }
+		size_t committedTiles() const noexcept { return m_committed; }
+
+		// Address of pixel (x, y), commits its tile. No bounds checks
+		Channel* pixel(const size_t x, const size_t y)
+		{
+			std::unique_ptr<Channel[]>& tile = m_tiles[(y >> TILE_SHIFT) * m_tilesX + (x >> TILE_SHIFT)];
+			if (!tile) {
+				commit(tile);
+			}
+			return tile.get() + ((((y & (TILE_SIZE - 1)) << TILE_SHIFT) + (x & (TILE_SIZE - 1))) << 2);
+		}
+
+		// Copies 'count' pixels of row y starting at x into dst
+		void copyRow(const size_t y, const size_t x, const size_t count, Channel* dst) const;
+		// Stores a full row, transparent runs don't commit any tiles
+		void setRow(const size_t y, const Channel* src);
+		// True if nothing was drawn to the area, it may reach over the edges of the image
+		bool isEmpty(const size_t x, const size_t y, const size_t width, const size_t height) const;
+
+	private:
+		void commit(std::unique_ptr<Channel[]>& tile);
+
+		size_t m_width;
+		size_t m_height;
+		size_t m_tilesX;
+		size_t m_committed;
+		std::vector<std::unique_ptr<Channel[]>> m_tiles;
+	};
+}
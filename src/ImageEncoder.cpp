@@ -0,0 +1,44 @@
+//My-Header
+#include "ImageEncoder.h"
+#include "PNGEncoder.h"
+#include "FastPNGEncoder.h"
+#include "QOIEncoder.h"
+#include "RawEncoder.h"
+#include "globals.h"
+
+namespace image
+{
+	std::unique_ptr<ImageEncoder> ImageEncoder::create()
+	{
+		if (Global::settings.format == FORMAT_QOI) {
+			return std::make_unique<QOIEncoder>();
+		}
+		if (Global::settings.format == FORMAT_RAW) {
+			return std::make_unique<RawEncoder>();
+		}
+		if (Global::settings.palette) {
+			return std::make_unique<PNGEncoder>(Global::settings.pngLevel, Global::settings.pngFilter, &Palette::get());
+		}
+		if (Global::settings.pngFast) {
+			return std::make_unique<FastPNGEncoder>(Global::settings.pngFilter);
+		}
+		return std::make_unique<PNGEncoder>(Global::settings.pngLevel, Global::settings.pngFilter);
+	}
+
+	const char* ImageEncoder::extension()
+	{
+		return extension(Global::settings.format);
+	}
+
+	const char* ImageEncoder::extension(const ImageFormat format)
+	{
+		switch (format) {
+		case FORMAT_QOI:
+			return ".qoi";
+		case FORMAT_RAW:
+			return ".raw";
+		default:
+			return ".png";
+		}
+	}
+}
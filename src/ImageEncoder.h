@@ -0,0 +1,27 @@
+#pragma once
+//C++ Header
+#include <ostream>
+#include <memory>
+//My-Header
+#include "defines.h"
+#include "globals.h"
+
+namespace image
+{
+	// Streams an RGBA image row by row into an output stream
+	class ImageEncoder
+	{
+	public:
+		virtual ~ImageEncoder() = default;
+
+		virtual bool begin(std::ostream& out, const size_t width, const size_t height, const bool addSoftwareTag = false) = 0;
+		virtual bool writeRow(const Channel* row) = 0;
+		virtual bool end() = 0;
+
+		// Creates the encoder that was selected on the command line
+		static std::unique_ptr<ImageEncoder> create();
+		// File extension of the selected format, including the dot
+		static const char* extension();
+		static const char* extension(const ImageFormat format);
+	};
+}
@@ -0,0 +1,283 @@
+//C++ Header
+#include <cmath> //floor (for g++)
+#include <cstring> //memcpy (for g++)
+#include <algorithm>
+#include <future>
+#include <limits>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MCMAP_SCALER_SSE2
+#endif
+//My-Header
+#include "ImageScaler.h"
+#include "helper.h"
+
+namespace
+{
+	// Output rows handed to one job, small enough to keep all threads busy until the end
+	constexpr size_t ROWS_PER_JOB{ 32 };
+	constexpr size_t CHANNELS{ 4 };
+
+#ifdef MCMAP_SCALER_SSE2
+	inline __m128 loadPixel(const Channel* pixel, const bool premultiply)
+	{
+		int32_t packed;
+		std::memcpy(&packed, pixel, CHANNELS);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+		const __m128 value = _mm_cvtepi32_ps(wide);
+		if (!premultiply) {
+			return value;
+		}
+		const float alpha = static_cast<float>(pixel[3]) / 255.0f;
+		return _mm_mul_ps(value, _mm_set_ps(1.0f, alpha, alpha, alpha));
+	}
+#endif
+
+	// Same rounding as the old bicubic sampler: clamp, then truncate
+	inline Channel saturate(const float x)
+	{
+		return x > 255.0f ? 255
+			: x < 0.0f ? 0
+			: Channel(x);
+	}
+}
+
+namespace image
+{
+	ImageScaler::ImageScaler(const ScaleFilter filter, const size_t srcWidth, const size_t srcHeight, const size_t dstWidth, const size_t dstHeight)
+		: m_premultiply(filter == SCALE_AREA), m_srcWidth(srcWidth), m_srcHeight(srcHeight), m_dstWidth(dstWidth), m_dstHeight(dstHeight), m_rowsPushed(0), m_rowsEmitted(0)
+	{
+		if (filter == SCALE_AREA) {
+			m_columns = areaTaps(srcWidth, dstWidth);
+			m_rows = areaTaps(srcHeight, dstHeight);
+		} else {
+			m_columns = bicubicTaps(srcWidth, dstWidth);
+			m_rows = bicubicTaps(srcHeight, dstHeight);
+		}
+	}
+
+	// Catmull-Rom weights, the sample positions are the ones the per pixel sampler used:
+	// output pixel i maps to i / (dstSize - 1) * srcSize - 0.5 in the source
+	ImageScaler::Taps ImageScaler::bicubicTaps(const size_t srcSize, const size_t dstSize)
+	{
+		Taps taps;
+		taps.maxCount = 4;
+		const int last = static_cast<int>(srcSize) - 1;
+		for (size_t i = 0; i < dstSize; ++i) {
+			taps.begin.push_back(static_cast<uint32_t>(taps.index.size()));
+			const float u = dstSize > 1 ? float(i) / float(dstSize - 1) : 0.0f;
+			const float x = (u * static_cast<float>(srcSize)) - 0.5f;
+			const int xint = int(x);
+			const float t = x - floorf(x);
+			const float t2 = t * t;
+			const float t3 = t2 * t;
+			const float weight[4] = {
+				-t3 / 2.0f + t2 - t / 2.0f,
+				(3.0f * t3) / 2.0f - (5.0f * t2) / 2.0f + 1.0f,
+				-(3.0f * t3) / 2.0f + 2.0f * t2 + t / 2.0f,
+				t3 / 2.0f - t2 / 2.0f
+			};
+			for (int k = 0; k < 4; ++k) {
+				taps.index.push_back(static_cast<uint32_t>(std::clamp(xint - 1 + k, 0, last)));
+				taps.weight.push_back(weight[k]);
+			}
+		}
+		taps.begin.push_back(static_cast<uint32_t>(taps.index.size()));
+		return taps;
+	}
+
+	// Every output pixel covers srcSize / dstSize source pixels, partially covered ones get a partial weight
+	ImageScaler::Taps ImageScaler::areaTaps(const size_t srcSize, const size_t dstSize)
+	{
+		Taps taps;
+		taps.maxCount = 0;
+		const double ratio = static_cast<double>(srcSize) / static_cast<double>(dstSize);
+		for (size_t i = 0; i < dstSize; ++i) {
+			taps.begin.push_back(static_cast<uint32_t>(taps.index.size()));
+			const double start = static_cast<double>(i) * ratio;
+			const double end = std::min(static_cast<double>(i + 1) * ratio, static_cast<double>(srcSize));
+			size_t count = 0;
+			for (size_t j = static_cast<size_t>(start); static_cast<double>(j) < end; ++j) {
+				const double covered = std::min(end, static_cast<double>(j + 1)) - std::max(start, static_cast<double>(j));
+				if (covered <= 0.0) {
+					continue;
+				}
+				taps.index.push_back(static_cast<uint32_t>(j));
+				taps.weight.push_back(static_cast<float>(covered / (end - start)));
+				++count;
+			}
+			taps.maxCount = std::max(taps.maxCount, count);
+		}
+		taps.begin.push_back(static_cast<uint32_t>(taps.index.size()));
+		return taps;
+	}
+
+	void ImageScaler::filterRow(const Channel* src, float* dst) const
+	{
+		for (size_t x = 0; x < m_dstWidth; ++x, dst += CHANNELS) {
+			const uint32_t end = m_columns.begin[x + 1];
+#ifdef MCMAP_SCALER_SSE2
+			__m128 sum = _mm_setzero_ps();
+			for (uint32_t k = m_columns.begin[x]; k < end; ++k) {
+				const __m128 pixel = loadPixel(src + m_columns.index[k] * CHANNELS, m_premultiply);
+				sum = _mm_add_ps(sum, _mm_mul_ps(pixel, _mm_set1_ps(m_columns.weight[k])));
+			}
+			_mm_storeu_ps(dst, sum);
+#else
+			float sum[CHANNELS] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (uint32_t k = m_columns.begin[x]; k < end; ++k) {
+				const Channel* pixel = src + m_columns.index[k] * CHANNELS;
+				const float alpha = m_premultiply ? static_cast<float>(pixel[3]) / 255.0f : 1.0f;
+				for (size_t c = 0; c < 3; ++c) {
+					sum[c] += static_cast<float>(pixel[c]) * alpha * m_columns.weight[k];
+				}
+				sum[3] += static_cast<float>(pixel[3]) * m_columns.weight[k];
+			}
+			std::memcpy(dst, sum, sizeof(sum));
+#endif
+		}
+	}
+
+	void ImageScaler::scaleRows(const Channel* src, Channel* dst, const size_t first, const size_t last) const
+	{
+		const size_t rowLength = m_dstWidth * CHANNELS;
+		// Horizontally filtered source rows, source rows only move forward so the lowest one is evicted first
+		struct FilteredRow
+		{
+			size_t source;
+			size_t usedBy;
+			std::vector<float> data;
+		};
+		std::vector<FilteredRow> cache(m_rows.maxCount, FilteredRow{ std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max(), std::vector<float>(rowLength) });
+		std::vector<const float*> taps(m_rows.maxCount);
+		std::vector<float> sum(rowLength);
+
+		for (size_t y = first; y < last; ++y) {
+			const uint32_t end = m_rows.begin[y + 1];
+			for (uint32_t k = m_rows.begin[y]; k < end; ++k) {
+				const size_t source = m_rows.index[k];
+				auto row = std::find_if(cache.begin(), cache.end(), [source](const FilteredRow& r) { return r.source == source; });
+				if (row == cache.end()) {
+					for (auto it = cache.begin(); it != cache.end(); ++it) {
+						if (it->usedBy != y && (row == cache.end() || it->source < row->source)) {
+							row = it;
+						}
+					}
+					row->source = source;
+					filterRow(src + source * m_srcWidth * CHANNELS, row->data.data());
+				}
+				row->usedBy = y;
+				taps[k - m_rows.begin[y]] = row->data.data();
+			}
+			combineRows(y, taps.data(), sum.data(), dst + y * rowLength);
+		}
+	}
+
+	void ImageScaler::combineRows(const size_t y, const float* const* rows, float* sum, Channel* out) const
+	{
+		const size_t rowLength = m_dstWidth * CHANNELS;
+		const uint32_t first = m_rows.begin[y];
+		for (uint32_t k = first; k < m_rows.begin[y + 1]; ++k) {
+			const float* in = rows[k - first];
+			const float weight = m_rows.weight[k];
+			const bool firstTap = k == first;
+#ifdef MCMAP_SCALER_SSE2
+			const __m128 w = _mm_set1_ps(weight);
+			for (size_t i = 0; i < rowLength; i += CHANNELS) {
+				const __m128 value = _mm_mul_ps(_mm_loadu_ps(in + i), w);
+				_mm_storeu_ps(sum + i, firstTap ? value : _mm_add_ps(_mm_loadu_ps(sum + i), value));
+			}
+#else
+			for (size_t i = 0; i < rowLength; ++i) {
+				sum[i] = firstTap ? in[i] * weight : sum[i] + in[i] * weight;
+			}
+#endif
+		}
+
+		if (m_premultiply) {
+			for (size_t i = 0; i < rowLength; i += CHANNELS) {
+				const float alpha = sum[i + 3];
+				if (alpha < 0.5f) {
+					std::memset(out + i, 0, CHANNELS);
+					continue;
+				}
+				for (size_t c = 0; c < 3; ++c) {
+					out[i + c] = saturate(sum[i + c] * 255.0f / alpha + 0.5f);
+				}
+				out[i + 3] = saturate(alpha + 0.5f);
+			}
+			return;
+		}
+		size_t i = 0;
+#ifdef MCMAP_SCALER_SSE2
+		// Truncating conversion, packs saturate to 0..255 like saturate() does
+		for (; i + 16 <= rowLength; i += 16) {
+			const __m128i a = _mm_cvttps_epi32(_mm_loadu_ps(sum + i));
+			const __m128i b = _mm_cvttps_epi32(_mm_loadu_ps(sum + i + 4));
+			const __m128i c = _mm_cvttps_epi32(_mm_loadu_ps(sum + i + 8));
+			const __m128i d = _mm_cvttps_epi32(_mm_loadu_ps(sum + i + 12));
+			const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+		}
+#endif
+		for (; i < rowLength; ++i) {
+			out[i] = saturate(sum[i]);
+		}
+	}
+
+	bool ImageScaler::pushRow(const Channel* row, const std::function<bool(const Channel*)>& emit)
+	{
+		const size_t rowLength = m_dstWidth * CHANNELS;
+		if (m_ring.empty()) {
+			m_ring.assign(m_rows.maxCount, std::vector<float>(rowLength));
+			m_sum.resize(rowLength);
+			m_outRow.resize(rowLength);
+		}
+		const size_t source = m_rowsPushed++;
+		// The taps of an output row are contiguous, so the last maxCount source rows are all it can need
+		std::vector<float>& slot = m_ring[source % m_ring.size()];
+		filterRow(row, slot.data());
+
+		std::vector<const float*> taps(m_rows.maxCount);
+		while (m_rowsEmitted < m_dstHeight) {
+			const size_t y = m_rowsEmitted;
+			const uint32_t first = m_rows.begin[y];
+			const uint32_t end = m_rows.begin[y + 1];
+			if (*std::max_element(&m_rows.index[first], &m_rows.index[first] + (end - first)) > source) {
+				break; // needs rows that did not arrive yet
+			}
+			for (uint32_t k = first; k < end; ++k) {
+				taps[k - first] = m_ring[m_rows.index[k] % m_ring.size()].data();
+			}
+			combineRows(y, taps.data(), m_sum.data(), m_outRow.data());
+			++m_rowsEmitted;
+			if (!emit(m_outRow.data())) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void ImageScaler::scale(const Channel* src, Channel* dst) const
+	{
+		if (!Global::threadPool) {
+			for (size_t first = 0; first < m_dstHeight; first += ROWS_PER_JOB) {
+				helper::printProgress(first, m_dstHeight);
+				scaleRows(src, dst, first, std::min(first + ROWS_PER_JOB, m_dstHeight));
+			}
+			helper::printProgress(10, 10);
+			return;
+		}
+		std::vector<std::future<void>> jobs;
+		for (size_t first = 0; first < m_dstHeight; first += ROWS_PER_JOB) {
+			const size_t last = std::min(first + ROWS_PER_JOB, m_dstHeight);
+			jobs.push_back(Global::threadPool->enqueue([this, src, dst, first, last]() { scaleRows(src, dst, first, last); }));
+		}
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			helper::printProgress(i * ROWS_PER_JOB, m_dstHeight);
+			jobs[i].get();
+		}
+		helper::printProgress(10, 10);
+	}
+}
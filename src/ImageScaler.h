@@ -0,0 +1,64 @@
+#pragma once
+//C++ Header
+#include <vector>
+#include <cstdint>
+#include <functional>
+//My-Header
+#include "defines.h"
+#include "globals.h"
+
+namespace image
+{
+	/*
+	 Separable RGBA8 resampler used by -scale.
+	 The filter weights for every output column and row are computed once. Rows are filtered horizontally into
+	 float, then columns combine those rows vertically. Each job keeps only the few filtered rows its current
+	 output row needs, so there is no full size intermediate image. Output rows are spread over Global::threadPool.
+	 SCALE_BICUBIC samples like the old per pixel Catmull-Rom code did, SCALE_AREA averages all covered
+	 source pixels weighted by alpha, which is what you want for strong downscaling.
+	*/
+	class ImageScaler
+	{
+	public:
+		ImageScaler(const ScaleFilter filter, const size_t srcWidth, const size_t srcHeight, const size_t dstWidth, const size_t dstHeight);
+
+		// Resamples src (srcWidth * srcHeight pixels) into dst (dstWidth * dstHeight pixels)
+		void scale(const Channel* src, Channel* dst) const;
+		// For images that only exist row by row: feed all source rows top to bottom, every output row is handed to
+		// 'emit' as soon as its source rows are in. Only the last few horizontally filtered rows are kept around.
+		bool pushRow(const Channel* row, const std::function<bool(const Channel*)>& emit);
+
+	private:
+		// Source pixels contributing to each output pixel along one axis
+		struct Taps
+		{
+			size_t maxCount;
+			std::vector<uint32_t> begin; // first entry of output pixel i, output pixel i + 1 begins where it ends
+			std::vector<uint32_t> index;
+			std::vector<float> weight;
+		};
+
+		static Taps bicubicTaps(const size_t srcSize, const size_t dstSize);
+		static Taps areaTaps(const size_t srcSize, const size_t dstSize);
+
+		void filterRow(const Channel* src, float* dst) const;
+		void scaleRows(const Channel* src, Channel* dst, const size_t first, const size_t last) const;
+		// Vertical pass of output row y, rows holds the filtered source rows of its taps in order
+		void combineRows(const size_t y, const float* const* rows, float* sum, Channel* out) const;
+
+		bool m_premultiply;
+		size_t m_srcWidth;
+		size_t m_srcHeight;
+		size_t m_dstWidth;
+		size_t m_dstHeight;
+		Taps m_columns;
+		Taps m_rows;
+
+		// State of pushRow
+		size_t m_rowsPushed;
+		size_t m_rowsEmitted;
+		std::vector<std::vector<float>> m_ring;
+		std::vector<float> m_sum;
+		std::vector<Channel> m_outRow;
+	};
+}
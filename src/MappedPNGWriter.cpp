@@ -0,0 +1,191 @@
+//C++ Header
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <cstring> //memcpy (for g++)
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#ifdef _WIN32
+#	define NOMINMAX
+#	include <windows.h>
+#	include <winioctl.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#endif
+//My-Header
+#include "MappedPNGWriter.h"
+#include "ImageEncoder.h"
+#include "ImageScaler.h"
+#include "helper.h"
+#include "globals.h"
+
+namespace image
+{
+	MappedPNGWriter::MappedPNGWriter()
+		: m_scratch(Global::settings.scratchDir), m_view(nullptr), m_mappedSize(0), m_tilesX(0), m_outWidth(0), m_outHeight(0)
+#ifdef _WIN32
+		, m_fileHandle(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#endif
+	{}
+
+	MappedPNGWriter::~MappedPNGWriter()
+	{
+		unmap();
+	}
+
+	bool MappedPNGWriter::reserve(const size_t width, const size_t height)
+	{
+		unmap();
+		if (!m_scratch.valid()) {
+			return false;
+		}
+		m_tilesX = (width + TILE_SIZE - 1) >> TILE_SHIFT;
+		const size_t tilesY = (height + TILE_SIZE - 1) >> TILE_SHIFT;
+		const uint64_t tiles = m_tilesX; // no overflow in 32 bit builds before the check below
+		const uint64_t size = tiles * tilesY * TILE_SIZE * TILE_SIZE * CHANSPERPIXEL;
+		std::cout << "Image dimensions are " << width << 'x' << height << ", 32bpp, " << static_cast<float>(size) / (1024.0f * 1024.0f) << "MiB, memory mapped\n";
+		if (size > std::numeric_limits<size_t>::max()) {
+			std::cerr << "The image is too big to be memory mapped in a 32 bit build\n";
+			return false;
+		}
+		const std::string path = m_scratch.path() + "/canvas";
+#ifdef _WIN32
+		m_fileHandle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+		if (m_fileHandle == INVALID_HANDLE_VALUE) {
+			std::cerr << "Could not create the canvas file " << path << '\n';
+			return false;
+		}
+		DWORD unused;
+		DeviceIoControl(m_fileHandle, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &unused, NULL); // Not fatal, just uses more disk space
+		m_mapping = CreateFileMappingA(m_fileHandle, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xFFFFFFFF), NULL);
+		void* view = m_mapping == nullptr ? nullptr : MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(size));
+		if (view == nullptr) {
+			std::cerr << "Could not map " << static_cast<float>(size) / (1024.0f * 1024.0f) << "MiB canvas file " << path << '\n';
+			unmap();
+			return false;
+		}
+#else
+		const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (fd == -1) {
+			std::cerr << "Could not create the canvas file " << path << '\n';
+			return false;
+		}
+		// The mapping keeps the file alive, so it's gone as soon as we are, even after a crash
+		::unlink(path.c_str());
+		void* view = MAP_FAILED;
+		if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+			view = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		::close(fd);
+		if (view == MAP_FAILED) {
+			std::cerr << "Could not map " << static_cast<float>(size) / (1024.0f * 1024.0f) << "MiB canvas file " << path << '\n';
+			return false;
+		}
+#endif
+		m_view = static_cast<Channel*>(view);
+		m_mappedSize = static_cast<size_t>(size);
+		m_width = m_outWidth = width;
+		m_height = m_outHeight = height;
+		return true;
+	}
+
+	Channel* MappedPNGWriter::getPixel(const size_t x, const size_t y)
+	{
+		if (x >= m_width || y >= m_height)
+			throw std::out_of_range("getPixel out of range\n");
+
+		const size_t tile = (y >> TILE_SHIFT) * m_tilesX + (x >> TILE_SHIFT);
+		return m_view + ((tile << (2 * TILE_SHIFT)) + ((y & (TILE_SIZE - 1)) << TILE_SHIFT) + (x & (TILE_SIZE - 1))) * CHANSPERPIXEL;
+	}
+
+	void MappedPNGWriter::resize(const double scaleFac)
+	{
+		resize(static_cast<size_t>(static_cast<double>(m_width) * scaleFac), static_cast<size_t>(static_cast<double>(m_height) * scaleFac));
+	}
+
+	void MappedPNGWriter::resize(const size_t newWidth, const size_t newHeight)
+	{
+		m_outWidth = newWidth;
+		m_outHeight = newHeight;
+	}
+
+	void MappedPNGWriter::copyRow(const size_t y, Channel* row) const
+	{
+		const Channel* src = m_view + (((y >> TILE_SHIFT) * m_tilesX << (2 * TILE_SHIFT)) + ((y & (TILE_SIZE - 1)) << TILE_SHIFT)) * CHANSPERPIXEL;
+		for (size_t x = 0; x < m_width; x += TILE_SIZE) {
+			std::memcpy(row + x * CHANSPERPIXEL, src, std::min(TILE_SIZE, m_width - x) * CHANSPERPIXEL);
+			src += TILE_SIZE * TILE_SIZE * CHANSPERPIXEL;
+		}
+	}
+
+	bool MappedPNGWriter::write(const std::string& path)
+	{
+		std::fstream fileHandle(path, std::fstream::out | std::fstream::binary);
+		if (fileHandle.fail()) {
+			std::cerr << "Error opening '" << path << "' for writing.\n";
+			return false;
+		}
+
+		std::unique_ptr<ImageScaler> scaler;
+		if (m_outWidth != m_width || m_outHeight != m_height) {
+			scaler = std::make_unique<ImageScaler>(Global::settings.scaleFilter, m_width, m_height, m_outWidth, m_outHeight);
+		}
+		auto encoder = ImageEncoder::create();
+		if (!encoder->begin(fileHandle, m_outWidth, m_outHeight, true)) {
+			return false;
+		}
+
+		std::cout << "Writing to file...\n";
+#ifndef _WIN32
+		posix_madvise(m_view, m_mappedSize, POSIX_MADV_SEQUENTIAL); // Rows are gathered tile band by tile band
+#endif
+		std::vector<Channel> row(m_width * CHANSPERPIXEL);
+		for (size_t y = 0; y < m_height; ++y) {
+			if (y % 25 == 0) {
+				helper::printProgress(y, m_height);
+			}
+			copyRow(y, row.data());
+			if (scaler) {
+				if (!scaler->pushRow(row.data(), [&encoder](const Channel* out) { return encoder->writeRow(out); })) {
+					return false;
+				}
+			} else if (!encoder->writeRow(row.data())) {
+				return false;
+			}
+		}
+		helper::printProgress(10, 10);
+		if (!encoder->end()) {
+			return false;
+		}
+
+		unmap();
+		m_width = m_height = 0;
+		return true;
+	}
+
+	void MappedPNGWriter::unmap()
+	{
+#ifdef _WIN32
+		if (m_view != nullptr) {
+			UnmapViewOfFile(m_view);
+		}
+		if (m_mapping != nullptr) {
+			CloseHandle(m_mapping);
+			m_mapping = nullptr;
+		}
+		if (m_fileHandle != INVALID_HANDLE_VALUE) {
+			CloseHandle(m_fileHandle);
+			m_fileHandle = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (m_view != nullptr) {
+			munmap(m_view, m_mappedSize);
+		}
+#endif
+		m_view = nullptr;
+		m_mappedSize = 0;
+	}
+}
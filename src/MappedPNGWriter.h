@@ -0,0 +1,52 @@
+#pragma once
+//C++ Header
+#include <string>
+#include <vector>
+//My-Header
+#include "PNGWriter.h"
+#include "ScratchPart.h"
+
+namespace image
+{
+	/*
+	 Canvas for images that don't fit into -mem, used with -mmap. The whole image lives in a sparse file below
+	 the scratch directory that is mapped into memory, so every pass of an incremental render draws right into
+	 it and the kernel decides what stays in RAM. Pixels are kept in 64x64 tiles of 16 KiB, a block sprite only
+	 touches one or two of them and untouched tiles never take up any space. write() gathers the rows from the
+	 tiles and streams them to the encoder, scaled on the fly if resize() was called before.
+	*/
+	class MappedPNGWriter : public PNGWriter
+	{
+	public:
+		MappedPNGWriter();
+		~MappedPNGWriter() override;
+		MappedPNGWriter(const MappedPNGWriter&) = delete;
+		MappedPNGWriter& operator=(const MappedPNGWriter&) = delete;
+
+		bool reserve(const size_t width, const size_t height) override;
+		bool write(const std::string& path) override;
+		Channel* getPixel(const size_t x, const size_t y) override;
+
+		// Only remembers the size, the image is scaled while it is written
+		void resize(const double scaleFac) override;
+		void resize(const size_t newWidth, const size_t newHeight) override;
+
+		static constexpr size_t TILE_SHIFT{ 6 };
+		static constexpr size_t TILE_SIZE{ size_t(1) << TILE_SHIFT };
+
+	private:
+		void copyRow(const size_t y, Channel* row) const;
+		void unmap();
+
+		ScratchDir m_scratch;
+		Channel* m_view;
+		size_t m_mappedSize;
+		size_t m_tilesX;
+		size_t m_outWidth;
+		size_t m_outHeight;
+#ifdef _WIN32
+		void* m_fileHandle;
+		void* m_mapping;
+#endif
+	};
+}
@@ -0,0 +1,88 @@
+//C++ Header
+#include <iostream>
+#include <atomic>
+#include <array>
+//My-Header
+#include "MemoryTracker.h"
+
+namespace
+{
+	constexpr double MIB{ 1024.0 * 1024.0 };
+	const std::array<const char*, memory::NUM_CATEGORIES> CATEGORY_NAMES{ "terrain", "light", "heightmap", "image", "decode", "chunk cache", "read-ahead" };
+
+	std::array<std::atomic<uint64_t>, memory::NUM_CATEGORIES> inUse{};
+	std::array<std::atomic<uint64_t>, memory::NUM_CATEGORIES> categoryPeak{}; // since startPeak
+	std::array<std::atomic<uint64_t>, memory::NUM_CATEGORIES> categoryHighWater{};
+	std::atomic<uint64_t> working{ 0 };
+	std::atomic<uint64_t> workingHigh{ 0 }; // since startPeak
+	std::atomic<uint64_t> total{ 0 };
+	std::atomic<uint64_t> highWater{ 0 };
+
+	void raise(std::atomic<uint64_t>& mark, const uint64_t value)
+	{
+		uint64_t seen = mark.load();
+		while (seen < value && !mark.compare_exchange_weak(seen, value)) {}
+	}
+
+	bool isWorking(const memory::Category category)
+	{
+		return category != memory::MEM_CHUNKCACHE && category != memory::MEM_READAHEAD;
+	}
+}
+
+namespace memory
+{
+	void allocated(const Category category, const size_t bytes)
+	{
+		const uint64_t used = inUse[category] += bytes;
+		raise(categoryPeak[category], used);
+		raise(categoryHighWater[category], used);
+		if (isWorking(category)) {
+			raise(workingHigh, working += bytes);
+		}
+		raise(highWater, total += bytes);
+	}
+
+	void released(const Category category, const size_t bytes)
+	{
+		inUse[category] -= bytes;
+		if (isWorking(category)) {
+			working -= bytes;
+		}
+		total -= bytes;
+	}
+
+	uint64_t workingPeak()
+	{
+		return workingHigh.load();
+	}
+
+	uint64_t peak(const Category category)
+	{
+		return categoryPeak[category].load();
+	}
+
+	void startPeak()
+	{
+		workingHigh = working.load();
+		for (size_t i = 0; i < NUM_CATEGORIES; ++i) {
+			categoryPeak[i] = inUse[i].load();
+		}
+	}
+
+	void printReport(const uint64_t limit)
+	{
+		std::cout << "Memory high-water mark: " << static_cast<double>(highWater.load()) / MIB << " MiB";
+		if (limit != 0) {
+			std::cout << " of " << static_cast<double>(limit) / MIB << " MiB allowed";
+		}
+		const char* separator = " (peaks: ";
+		for (size_t i = 0; i < NUM_CATEGORIES; ++i) {
+			if (categoryHighWater[i] != 0) {
+				std::cout << separator << CATEGORY_NAMES[i] << ' ' << static_cast<double>(categoryHighWater[i].load()) / MIB;
+				separator = ", ";
+			}
+		}
+		std::cout << (separator[0] == ',' ? " MiB)\n" : "\n");
+	}
+}
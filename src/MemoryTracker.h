@@ -0,0 +1,99 @@
+#pragma once
+//C++ Header
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace memory
+{
+	// What the memory is used for, the report lists them on their own
+	enum Category
+	{
+		MEM_TERRAIN,
+		MEM_LIGHT,
+		MEM_HEIGHTMAP,
+		MEM_IMAGE,
+		MEM_DECODE, // region files and chunks being inflated and parsed
+		MEM_CHUNKCACHE,
+		MEM_READAHEAD,
+		NUM_CATEGORIES
+	};
+
+	/*
+	 Counts the bytes the big buffers of a render take, so -mem can be checked against what was actually used
+	 instead of what calcTerrainSize and calcImageSize expect. Safe to use from any thread.
+	*/
+	void allocated(const Category category, const size_t bytes);
+	void released(const Category category, const size_t bytes);
+	// Most bytes in use at once since the last startPeak(), or since the start. The working memory is everything
+	// but MEM_CHUNKCACHE and MEM_READAHEAD, those only get what the passes of an incremental render leave over
+	uint64_t workingPeak();
+	uint64_t peak(const Category category);
+	void startPeak();
+	// Prints the high-water mark of the whole run and of every category, 'limit' 0 if there is none
+	void printReport(const uint64_t limit);
+
+	// Accounts for 'bytes' of memory the category holds somewhere else, for as long as it lives
+	class Reservation
+	{
+	public:
+		Reservation(const Category category, const size_t bytes)
+			: m_category(category), m_bytes(bytes)
+		{
+			allocated(m_category, m_bytes);
+		}
+		~Reservation()
+		{
+			released(m_category, m_bytes);
+		}
+		Reservation(const Reservation&) = delete;
+		Reservation& operator=(const Reservation&) = delete;
+
+	private:
+		const Category m_category;
+		const size_t m_bytes;
+	};
+
+	// std::allocator that books everything it hands out to category C
+	template<typename T, Category C>
+	struct TrackedAllocator
+	{
+		using value_type = T;
+		template<typename U>
+		struct rebind
+		{
+			using other = TrackedAllocator<U, C>;
+		};
+
+		TrackedAllocator() noexcept = default;
+		template<typename U>
+		TrackedAllocator(const TrackedAllocator<U, C>&) noexcept {}
+
+		T* allocate(const size_t count)
+		{
+			T* data = std::allocator<T>().allocate(count);
+			allocated(C, count * sizeof(T));
+			return data;
+		}
+		void deallocate(T* data, const size_t count) noexcept
+		{
+			released(C, count * sizeof(T));
+			std::allocator<T>().deallocate(data, count);
+		}
+	};
+
+	template<typename T, typename U, Category C>
+	bool operator==(const TrackedAllocator<T, C>&, const TrackedAllocator<U, C>&) noexcept
+	{
+		return true;
+	}
+	template<typename T, typename U, Category C>
+	bool operator!=(const TrackedAllocator<T, C>&, const TrackedAllocator<U, C>&) noexcept
+	{
+		return false;
+	}
+
+	template<typename T, Category C>
+	using TrackedVector = std::vector<T, TrackedAllocator<T, C>>;
+}
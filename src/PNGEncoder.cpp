@@ -0,0 +1,153 @@
+//C++ Header
+#include <iostream>
+//My-Header
+#include "PNGEncoder.h"
+
+namespace
+{
+	//Function to write png data to disc
+	void userWriteData(png_structp pngPtr, png_bytep data, png_size_t length)
+	{
+		png_voidp a = png_get_io_ptr(pngPtr);
+		//Cast the pointer to std::ostream* and write 'length' bytes from 'data'
+		static_cast<std::ostream*>(a)->write(reinterpret_cast<char*>(data), static_cast<std::streamsize>(length));
+	}
+
+	void userFlushData([[maybe_unused]] png_structp pngPtr)
+	{}
+
+	int toPNGFilter(const PNGFilter filter)
+	{
+		switch (filter) {
+		case FILTER_NONE:
+			return PNG_FILTER_NONE;
+		case FILTER_SUB:
+			return PNG_FILTER_SUB;
+		case FILTER_UP:
+			return PNG_FILTER_UP;
+		case FILTER_AVG:
+			return PNG_FILTER_AVG;
+		case FILTER_PAETH:
+			return PNG_FILTER_PAETH;
+		default:
+			return PNG_ALL_FILTERS;
+		}
+	}
+}
+
+namespace image
+{
+	PNGEncoder::PNGEncoder(const int level, const PNGFilter filter, const Palette* palette)
+		: m_level(level), m_filter(filter), m_palette(palette), m_pngPtr(nullptr), m_pngInfo(nullptr)
+	{}
+
+	PNGEncoder::~PNGEncoder()
+	{
+		destroy();
+	}
+
+	bool PNGEncoder::begin(std::ostream& out, const size_t width, const size_t height, const bool addSoftwareTag)
+	{
+		destroy();
+		m_pngPtr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+		if (m_pngPtr == nullptr) {
+			std::cerr << "Error creating png write struct!\n";
+			return false;
+		}
+
+		m_pngInfo = png_create_info_struct(m_pngPtr);
+		if (m_pngInfo == nullptr) {
+			std::cerr << "Error creating png info struct!\n";
+			destroy();
+			return false;
+		}
+
+		if (setjmp(png_jmpbuf(m_pngPtr))) { // libpng will issue a longjmp on error, so code flow will end up
+			std::cerr << "Something went wrong with pngLib\n"; // here if something goes wrong in the code below
+			destroy();
+			return false;
+		}
+
+		png_set_write_fn(m_pngPtr, static_cast<png_voidp>(&out), userWriteData, userFlushData);
+		if (m_level >= 0) {
+			png_set_compression_level(m_pngPtr, m_level);
+		}
+		if (m_filter != FILTER_ADAPTIVE) {
+			png_set_filter(m_pngPtr, PNG_FILTER_TYPE_BASE, toPNGFilter(m_filter));
+		}
+
+		png_set_IHDR(m_pngPtr, m_pngInfo, static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+			8, m_palette != nullptr ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+		if (m_palette != nullptr) {
+			std::vector<png_color> colors(m_palette->size());
+			std::vector<png_byte> alpha(m_palette->numTransparent());
+			for (size_t i = 0; i < colors.size(); ++i) {
+				colors[i] = { (*m_palette)[i].r, (*m_palette)[i].g, (*m_palette)[i].b };
+			}
+			for (size_t i = 0; i < alpha.size(); ++i) {
+				alpha[i] = (*m_palette)[i].a;
+			}
+			png_set_PLTE(m_pngPtr, m_pngInfo, colors.data(), static_cast<int>(colors.size()));
+			png_set_tRNS(m_pngPtr, m_pngInfo, alpha.data(), static_cast<int>(alpha.size()), NULL);
+			m_indices.resize(width);
+		}
+
+		if (addSoftwareTag) {
+			png_text title_text;
+			title_text.compression = PNG_TEXT_COMPRESSION_NONE;
+			title_text.key = png_charp("Software"); // we need to cast from const char* to char*
+			title_text.text = png_charp("mcmap"); // we need to cast from const char* to char*
+			png_set_text(m_pngPtr, m_pngInfo, &title_text, 1);
+		}
+
+		png_write_info(m_pngPtr, m_pngInfo);
+		return true;
+	}
+
+	bool PNGEncoder::writeRow(const Channel* row)
+	{
+		if (m_pngPtr == nullptr) {
+			return false;
+		}
+		if (setjmp(png_jmpbuf(m_pngPtr))) {
+			std::cerr << "Something went wrong with pngLib\n";
+			destroy();
+			return false;
+		}
+		if (m_palette != nullptr) {
+			for (size_t x = 0; x < m_indices.size(); ++x) {
+				m_indices[x] = m_palette->index(row + x * 4);
+			}
+			png_write_row(m_pngPtr, m_indices.data());
+		} else {
+			png_write_row(m_pngPtr, row);
+		}
+		return true;
+	}
+
+	bool PNGEncoder::end()
+	{
+		if (m_pngPtr == nullptr) {
+			return false;
+		}
+		if (setjmp(png_jmpbuf(m_pngPtr))) {
+			std::cerr << "Something went wrong with pngLib\n";
+			destroy();
+			return false;
+		}
+		png_write_end(m_pngPtr, NULL);
+		destroy();
+		return true;
+	}
+
+	void PNGEncoder::destroy()
+	{
+		if (m_pngPtr != nullptr) {
+			png_destroy_write_struct(&m_pngPtr, m_pngInfo != nullptr ? &m_pngInfo : NULL);
+		}
+		m_pngPtr = nullptr;
+		m_pngInfo = nullptr;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+//C++ Header
+#include <vector>
+//My-Header
+#include "png.h"
+#include "ImageEncoder.h"
+#include "Palette.h"
+#include "globals.h"
+
+namespace image
+{
+	// libpng based encoder, honours the zlib level and filter settings. With a palette rows are written as 8 bit indices
+	class PNGEncoder : public ImageEncoder
+	{
+	public:
+		PNGEncoder(const int level, const PNGFilter filter, const Palette* palette = nullptr);
+		~PNGEncoder() override;
+
+		bool begin(std::ostream& out, const size_t width, const size_t height, const bool addSoftwareTag = false) override;
+		bool writeRow(const Channel* row) override;
+		bool end() override;
+
+	private:
+		void destroy();
+
+		int m_level;
+		PNGFilter m_filter;
+		const Palette* m_palette;
+		std::vector<uint8_t> m_indices;
+		png_structp m_pngPtr;
+		png_infop m_pngInfo;
+	};
+}
@@ -3,6 +3,7 @@
 #include <vector>
 #include <array>
 #include "defines.h"
+#include "ImageCanvas.h"
 
 namespace image
 {
@@ -28,10 +29,7 @@ namespace image
 		static constexpr size_t BYTESPERPIXEL{ 4 };
 
 	protected:
-		Channel* getPixelClamped(int x, int y);
-		std::array<Channel, CHANSPERPIXEL> SampleBicubic(const float u, const float v);
-
-		std::vector<Channel> m_buffer; //Change to Pixel
+		ImageCanvas m_canvas; // only the tiles that were drawn to take up memory
 		size_t m_width;
 		size_t m_height;
 	};
@@ -0,0 +1,190 @@
+//C++ Header
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+//My-Header
+#include "Palette.h"
+#include "globals.h"
+#include "helper.h"
+
+namespace
+{
+	constexpr size_t MAX_COLORS{ 256 };
+	constexpr size_t MAX_TRANSLUCENT{ 48 };
+	constexpr int MIN_SHIFT{ -200 }; // darkest brightness adjustment still worth an own color, night and caves get close to black
+	constexpr int MAX_SHIFT{ 24 };
+	constexpr int SHIFT_STEP{ 4 };
+	constexpr size_t ALPHA_LAYERS{ 3 }; // translucent blocks stacked on top of each other
+
+	struct Candidate
+	{
+		std::array<int, 4> c; // r, g, b, a
+		uint64_t weight;
+	};
+
+	using CandidateMap = std::unordered_map<uint32_t, uint64_t>;
+
+	void addCandidate(CandidateMap& map, const int r, const int g, const int b, const int a, const uint64_t weight)
+	{
+		const uint32_t key = uint32_t(helper::clamp(r)) << 24 | uint32_t(helper::clamp(g)) << 16 | uint32_t(helper::clamp(b)) << 8 | uint32_t(a);
+		map[key] += weight;
+	}
+
+	std::vector<Candidate> toCandidates(const CandidateMap& map)
+	{
+		std::vector<Candidate> candidates;
+		candidates.reserve(map.size());
+		for (const auto& entry : map) {
+			const uint32_t key = entry.first;
+			candidates.push_back({ { int(key >> 24), int((key >> 16) & 0xFF), int((key >> 8) & 0xFF), int(key & 0xFF) }, entry.second });
+		}
+		// unordered_map iteration order is not fixed, sort to get the same palette on every platform
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.c < b.c; });
+		return candidates;
+	}
+
+	// Weighted median cut: split the box with the largest weighted extent at its weighted median until there are enough boxes
+	std::vector<Pixel> medianCut(std::vector<Candidate> points, const size_t numColors, const size_t numAxis)
+	{
+		struct Box
+		{
+			size_t begin, end;
+			size_t axis;
+			uint64_t score;
+		};
+
+		auto makeBox = [&points, numAxis](const size_t begin, const size_t end) {
+			Box box{ begin, end, 0, 0 };
+			std::array<int, 4> lo{ 255, 255, 255, 255 }, hi{ 0, 0, 0, 0 };
+			uint64_t weight = 0;
+			for (size_t i = begin; i < end; ++i) {
+				for (size_t a = 0; a < numAxis; ++a) {
+					lo[a] = std::min(lo[a], points[i].c[a]);
+					hi[a] = std::max(hi[a], points[i].c[a]);
+				}
+				weight += points[i].weight;
+			}
+			int range = 0;
+			for (size_t a = 0; a < numAxis; ++a) {
+				if (hi[a] - lo[a] > range) {
+					range = hi[a] - lo[a];
+					box.axis = a;
+				}
+			}
+			box.score = end - begin > 1 ? uint64_t(range) * weight : 0;
+			return box;
+		};
+
+		std::vector<Box> boxes;
+		if (!points.empty()) {
+			boxes.push_back(makeBox(0, points.size()));
+		}
+		while (boxes.size() < numColors) {
+			auto it = std::max_element(boxes.begin(), boxes.end(), [](const Box& a, const Box& b) { return a.score < b.score; });
+			if (it->score == 0) {
+				break;
+			}
+			const Box box = *it;
+			std::sort(points.begin() + ptrdiff_t(box.begin), points.begin() + ptrdiff_t(box.end),
+				[&box](const Candidate& a, const Candidate& b) { return a.c[box.axis] < b.c[box.axis]; });
+			uint64_t total = 0;
+			for (size_t i = box.begin; i < box.end; ++i) {
+				total += points[i].weight;
+			}
+			size_t split = box.begin + 1;
+			for (uint64_t sum = points[box.begin].weight; split < box.end - 1 && sum * 2 < total; ++split) {
+				sum += points[split].weight;
+			}
+			*it = makeBox(box.begin, split);
+			boxes.push_back(makeBox(split, box.end));
+		}
+
+		std::vector<Pixel> colors;
+		for (const Box& box : boxes) {
+			std::array<uint64_t, 4> sum{};
+			uint64_t weight = 0;
+			for (size_t i = box.begin; i < box.end; ++i) {
+				for (size_t a = 0; a < 4; ++a) {
+					sum[a] += uint64_t(points[i].c[a]) * points[i].weight;
+				}
+				weight += points[i].weight;
+			}
+			colors.push_back({ Channel((sum[0] + weight / 2) / weight), Channel((sum[1] + weight / 2) / weight), Channel((sum[2] + weight / 2) / weight), Channel((sum[3] + weight / 2) / weight) });
+		}
+		return colors;
+	}
+
+	size_t nearest(const std::vector<Pixel>& colors, const size_t first, const size_t last, const int r, const int g, const int b, const int a)
+	{
+		size_t best = first;
+		int bestDist = std::numeric_limits<int>::max();
+		for (size_t i = first; i < last; ++i) {
+			const int dr = r - colors[i].r, dg = g - colors[i].g, db = b - colors[i].b, da = a - colors[i].a;
+			const int dist = dr * dr + dg * dg + db * db + da * da;
+			if (dist < bestDist) {
+				bestDist = dist;
+				best = i;
+			}
+		}
+		return best;
+	}
+}
+
+namespace image
+{
+	const Palette& Palette::get()
+	{
+		static const Palette palette;
+		return palette;
+	}
+
+	Palette::Palette()
+	{
+		CandidateMap opaque, translucent;
+		for (size_t id = 1; id < Global::colorMap.size(); ++id) {
+			const ColorArray& colors = Global::colorMap[id].colors;
+			for (size_t i = 0; i < colors.length; ++i) {
+				const Color_t& color = colors[i];
+				if (color.a == 0) {
+					continue;
+				}
+				for (int shift = MIN_SHIFT; shift <= MAX_SHIFT; shift += SHIFT_STEP) {
+					const uint64_t weight = shift >= -64 ? 4 : 1; // daylight shades are the most common ones
+					if (color.a == 255) {
+						addCandidate(opaque, color.r + shift, color.g + shift, color.b + shift, 255, weight);
+						continue;
+					}
+					int alpha = color.a;
+					for (size_t layer = 0; layer < ALPHA_LAYERS && alpha < 255; ++layer) {
+						addCandidate(translucent, color.r + shift, color.g + shift, color.b + shift, alpha, weight);
+						alpha += (color.a * (255 - alpha)) / 255;
+					}
+				}
+			}
+		}
+		if (opaque.empty()) {
+			addCandidate(opaque, 0, 0, 0, 255, 1);
+		}
+
+		const std::vector<Pixel> translucentColors = medianCut(toCandidates(translucent), MAX_TRANSLUCENT, 4);
+		const std::vector<Pixel> opaqueColors = medianCut(toCandidates(opaque), MAX_COLORS - 1 - translucentColors.size(), 3);
+
+		m_colors.push_back({ 0, 0, 0, 0 });
+		m_colors.insert(m_colors.end(), translucentColors.begin(), translucentColors.end());
+		m_numTransparent = m_colors.size();
+		m_colors.insert(m_colors.end(), opaqueColors.begin(), opaqueColors.end());
+
+		m_opaqueLookup.resize(size_t(1) << 16);
+		for (size_t i = 0; i < m_opaqueLookup.size(); ++i) {
+			const int r = int((i >> 11) << 3 | 4), g = int(((i >> 5) & 63) << 2 | 2), b = int((i & 31) << 3 | 4);
+			m_opaqueLookup[i] = static_cast<uint8_t>(nearest(m_colors, m_numTransparent, m_colors.size(), r, g, b, 255));
+		}
+		if (m_numTransparent > 1) {
+			m_translucentLookup.resize(size_t(1) << 15);
+			for (size_t i = 0; i < m_translucentLookup.size(); ++i) {
+				const int a = int((i >> 12) << 5 | 16), r = int(((i >> 8) & 15) << 4 | 8), g = int(((i >> 4) & 15) << 4 | 8), b = int((i & 15) << 4 | 8);
+				m_translucentLookup[i] = static_cast<uint8_t>(nearest(m_colors, 1, m_numTransparent, r, g, b, a));
+			}
+		}
+	}
+}
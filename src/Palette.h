@@ -0,0 +1,58 @@
+#pragma once
+//C++ Header
+#include <vector>
+#include <array>
+//My-Header
+#include "defines.h"
+
+namespace image
+{
+	/*
+	 Fixed 256 color palette for indexed png output.
+	 Every color in the final image is a color of Global::colorMap shifted in brightness (and maybe blended or noised),
+	 so the palette is built from those colors at a range of brightness steps, reduced with a weighted median cut.
+	 Index 0 is fully transparent, translucent entries follow, so the tRNS chunk stays short.
+	 Pixels are mapped with precomputed nearest color tables, no dithering.
+	*/
+	class Palette
+	{
+	public:
+		// Built on first use, Global::colorMap has to be loaded by then
+		static const Palette& get();
+
+		inline uint8_t index(const Channel* px) const
+		{
+			if (px[3] == 0) {
+				return 0;
+			}
+			if (px[3] == 255 || m_translucentLookup.empty()) {
+				return m_opaqueLookup[(size_t(px[0] >> 3) << 11) | (size_t(px[1] >> 2) << 5) | size_t(px[2] >> 3)];
+			}
+			return m_translucentLookup[(size_t(px[3] >> 5) << 12) | (size_t(px[0] >> 4) << 8) | (size_t(px[1] >> 4) << 4) | size_t(px[2] >> 4)];
+		}
+
+		size_t size() const
+		{
+			return m_colors.size();
+		}
+
+		// Number of leading entries that are not fully opaque
+		size_t numTransparent() const
+		{
+			return m_numTransparent;
+		}
+
+		const Pixel& operator[](const size_t idx) const
+		{
+			return m_colors[idx];
+		}
+
+	private:
+		Palette();
+
+		std::vector<Pixel> m_colors;
+		size_t m_numTransparent;
+		std::vector<uint8_t> m_opaqueLookup; // 5-6-5 rgb -> index
+		std::vector<uint8_t> m_translucentLookup; // 3 bit alpha, 4-4-4 rgb -> index
+	};
+}
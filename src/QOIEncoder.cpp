@@ -0,0 +1,129 @@
+//C++ Header
+#include <iostream>
+#include <cstring>
+//My-Header
+#include "QOIEncoder.h"
+
+namespace
+{
+	constexpr uint8_t QOI_OP_INDEX{ 0x00 };
+	constexpr uint8_t QOI_OP_DIFF{ 0x40 };
+	constexpr uint8_t QOI_OP_LUMA{ 0x80 };
+	constexpr uint8_t QOI_OP_RUN{ 0xc0 };
+	constexpr uint8_t QOI_OP_RGB{ 0xfe };
+	constexpr uint8_t QOI_OP_RGBA{ 0xff };
+	constexpr uint32_t QOI_MAX_RUN{ 62 };
+
+	inline size_t colorHash(const Channel* px)
+	{
+		return static_cast<size_t>(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+	}
+
+	inline void putBE32(uint8_t* dest, const uint32_t val)
+	{
+		dest[0] = static_cast<uint8_t>(val >> 24);
+		dest[1] = static_cast<uint8_t>(val >> 16);
+		dest[2] = static_cast<uint8_t>(val >> 8);
+		dest[3] = static_cast<uint8_t>(val);
+	}
+}
+
+namespace image
+{
+	QOIEncoder::QOIEncoder()
+		: m_out(nullptr), m_width(0), m_height(0), m_rowsWritten(0), m_run(0), m_prev{}, m_index{}
+	{}
+
+	bool QOIEncoder::begin(std::ostream& out, const size_t width, const size_t height, [[maybe_unused]] const bool addSoftwareTag)
+	{
+		m_out = &out;
+		m_width = width;
+		m_height = height;
+		m_rowsWritten = 0;
+		m_run = 0;
+		m_prev = { 0, 0, 0, 255 };
+		m_index = {};
+		m_buffer.clear();
+		m_buffer.reserve(width * 5 + 1);
+
+		uint8_t header[14] = { 'q', 'o', 'i', 'f' };
+		putBE32(header + 4, static_cast<uint32_t>(width));
+		putBE32(header + 8, static_cast<uint32_t>(height));
+		header[12] = 4; // RGBA
+		header[13] = 0; // sRGB with linear alpha
+		m_out->write(reinterpret_cast<const char*>(header), sizeof(header));
+		return m_out->good();
+	}
+
+	bool QOIEncoder::writeRow(const Channel* row)
+	{
+		if (m_out == nullptr || m_rowsWritten >= m_height) {
+			return false;
+		}
+		m_buffer.clear();
+		for (size_t x = 0; x < m_width; ++x) {
+			const Channel* px = row + x * sizeof(Pixel);
+			if (std::memcmp(px, m_prev.data(), sizeof(Pixel)) == 0) {
+				if (++m_run == QOI_MAX_RUN) {
+					flushRun();
+				}
+				continue;
+			}
+			flushRun();
+
+			const size_t hash = colorHash(px);
+			if (std::memcmp(px, m_index[hash].data(), sizeof(Pixel)) == 0) {
+				m_buffer.push_back(static_cast<uint8_t>(QOI_OP_INDEX | hash));
+			} else if (px[3] == m_prev[3]) {
+				const int8_t dr = static_cast<int8_t>(px[0] - m_prev[0]);
+				const int8_t dg = static_cast<int8_t>(px[1] - m_prev[1]);
+				const int8_t db = static_cast<int8_t>(px[2] - m_prev[2]);
+				const int8_t drdg = static_cast<int8_t>(dr - dg);
+				const int8_t dbdg = static_cast<int8_t>(db - dg);
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+					m_buffer.push_back(static_cast<uint8_t>(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+				} else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 && dbdg >= -8 && dbdg <= 7) {
+					m_buffer.push_back(static_cast<uint8_t>(QOI_OP_LUMA | (dg + 32)));
+					m_buffer.push_back(static_cast<uint8_t>((drdg + 8) << 4 | (dbdg + 8)));
+				} else {
+					m_buffer.insert(m_buffer.end(), { QOI_OP_RGB, px[0], px[1], px[2] });
+				}
+			} else {
+				m_buffer.insert(m_buffer.end(), { QOI_OP_RGBA, px[0], px[1], px[2], px[3] });
+			}
+			std::memcpy(m_index[hash].data(), px, sizeof(Pixel));
+			std::memcpy(m_prev.data(), px, sizeof(Pixel));
+		}
+		++m_rowsWritten;
+		m_out->write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<std::streamsize>(m_buffer.size()));
+		return m_out->good();
+	}
+
+	bool QOIEncoder::end()
+	{
+		if (m_out == nullptr) {
+			return false;
+		}
+		if (m_rowsWritten < m_height) {
+			// Pad missing rows with transparent pixels, so the file is at least valid
+			const std::vector<Channel> empty(m_width * 4, 0);
+			while (m_rowsWritten < m_height) {
+				writeRow(empty.data());
+			}
+		}
+		m_buffer.clear();
+		flushRun();
+		m_buffer.insert(m_buffer.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+		m_out->write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<std::streamsize>(m_buffer.size()));
+		m_out = nullptr;
+		return true;
+	}
+
+	void QOIEncoder::flushRun()
+	{
+		if (m_run > 0) {
+			m_buffer.push_back(static_cast<uint8_t>(QOI_OP_RUN | (m_run - 1)));
+			m_run = 0;
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+//C++ Header
+#include <vector>
+#include <array>
+//My-Header
+#include "ImageEncoder.h"
+
+namespace image
+{
+	/*
+	 Encoder for the "Quite OK Image" format (https://qoiformat.org).
+	 Every pixel is coded as a run, an index into a small hash table of recently seen colors,
+	 a small difference to the previous pixel or as a full color. Much faster than png, but the files are bigger.
+	*/
+	class QOIEncoder : public ImageEncoder
+	{
+	public:
+		QOIEncoder();
+
+		bool begin(std::ostream& out, const size_t width, const size_t height, const bool addSoftwareTag = false) override;
+		bool writeRow(const Channel* row) override;
+		bool end() override;
+
+	private:
+		void flushRun();
+
+		std::ostream* m_out;
+		size_t m_width;
+		size_t m_height;
+		size_t m_rowsWritten;
+		uint32_t m_run;
+		std::array<Channel, 4> m_prev;
+		std::array<std::array<Channel, 4>, 64> m_index;
+		std::vector<uint8_t> m_buffer; // encoded data of the current row
+	};
+}
@@ -0,0 +1,53 @@
+//C++ Header
+#include <vector>
+//My-Header
+#include "RawEncoder.h"
+
+namespace image
+{
+	RawEncoder::RawEncoder()
+		: m_out(nullptr), m_width(0), m_height(0), m_rowsWritten(0)
+	{}
+
+	bool RawEncoder::begin(std::ostream& out, const size_t width, const size_t height, [[maybe_unused]] const bool addSoftwareTag)
+	{
+		m_out = &out;
+		m_width = width;
+		m_height = height;
+		m_rowsWritten = 0;
+
+		uint8_t header[16] = { 'm', 'c', 'm', 'a', 'p', 'r', 'a', 'w' };
+		for (int i = 0; i < 4; ++i) {
+			header[8 + i] = static_cast<uint8_t>(width >> (24 - i * 8));
+			header[12 + i] = static_cast<uint8_t>(height >> (24 - i * 8));
+		}
+		m_out->write(reinterpret_cast<const char*>(header), sizeof(header));
+		return m_out->good();
+	}
+
+	bool RawEncoder::writeRow(const Channel* row)
+	{
+		if (m_out == nullptr || m_rowsWritten >= m_height) {
+			return false;
+		}
+		++m_rowsWritten;
+		m_out->write(reinterpret_cast<const char*>(row), static_cast<std::streamsize>(m_width * 4));
+		return m_out->good();
+	}
+
+	bool RawEncoder::end()
+	{
+		if (m_out == nullptr) {
+			return false;
+		}
+		if (m_rowsWritten < m_height) {
+			// Pad missing rows with transparent pixels, so the file has the size the header promises
+			const std::vector<Channel> empty(m_width * 4, 0);
+			while (m_rowsWritten < m_height) {
+				writeRow(empty.data());
+			}
+		}
+		m_out = nullptr;
+		return true;
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+//My-Header
+#include "ImageEncoder.h"
+
+namespace image
+{
+	/*
+	 Uncompressed RGBA output for tools that re-encode the image anyway.
+	 The file starts with a 16 byte header: the magic "mcmapraw", followed by width and height as
+	 big endian 32 bit integers. After that come height rows of width * 4 bytes, top to bottom.
+	*/
+	class RawEncoder : public ImageEncoder
+	{
+	public:
+		RawEncoder();
+
+		bool begin(std::ostream& out, const size_t width, const size_t height, const bool addSoftwareTag = false) override;
+		bool writeRow(const Channel* row) override;
+		bool end() override;
+
+	private:
+		std::ostream* m_out;
+		size_t m_width;
+		size_t m_height;
+		size_t m_rowsWritten;
+	};
+}
@@ -0,0 +1,239 @@
+//C++ Header
+#include <iostream>
+#include <cstring> //memcpy (for g++)
+#include <ctime>
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+//My-Header
+#include "ScratchPart.h"
+#include "filesystem.h"
+
+namespace
+{
+	constexpr size_t CHANNELS{ 4 };
+	// Longest literal and repeat run one header byte can describe
+	constexpr size_t MAX_LITERAL{ 128 };
+	constexpr size_t MAX_REPEAT{ 129 };
+
+	inline bool samePixel(const Channel* a, const Channel* b)
+	{
+		return std::memcmp(a, b, CHANNELS) == 0;
+	}
+}
+
+namespace image
+{
+	ScratchDir::ScratchDir(const std::string& root)
+	{
+		const std::string base = root.empty() ? Dir::tempDir() : root;
+		if (!Dir::createDirs(base)) {
+			std::cerr << "Could not create scratch directory " << base << '\n';
+			return;
+		}
+		const std::string stamp = std::to_string(time(NULL));
+		for (int i = 0; i < 100; ++i) {
+			const std::string candidate = base + "/mcmap." + stamp + '.' + std::to_string(i);
+			if (Dir::createDir(candidate)) {
+				m_path = candidate;
+				return;
+			}
+		}
+		std::cerr << "Could not create a scratch directory in " << base << '\n';
+	}
+
+	ScratchDir::~ScratchDir()
+	{
+		if (!m_path.empty()) {
+			Dir::removeAll(m_path);
+		}
+	}
+
+	ScratchPart::ScratchPart(const std::string& filename, const size_t width, const size_t height)
+		: m_filename(filename), m_width(width), m_height(height), m_nextRow(0)
+#ifndef _WIN32
+		, m_fd(-1)
+#endif
+	{}
+
+	ScratchPart::ScratchPart(ScratchPart&& other) noexcept
+		: m_filename(std::move(other.m_filename)), m_width(other.m_width), m_height(other.m_height),
+		m_rowEnd(std::move(other.m_rowEnd)), m_packed(std::move(other.m_packed)), m_nextRow(other.m_nextRow)
+#ifdef _WIN32
+		, m_file(std::move(other.m_file))
+#else
+		, m_fd(other.m_fd)
+#endif
+	{
+#ifndef _WIN32
+		other.m_fd = -1;
+#endif
+	}
+
+	ScratchPart::~ScratchPart()
+	{
+#ifndef _WIN32
+		if (m_fd != -1) {
+			::close(m_fd);
+		}
+#endif
+	}
+
+	bool ScratchPart::write(const ImageCanvas& canvas)
+	{
+		std::ofstream file(m_filename, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (file.fail()) {
+			std::cerr << "Could not create temporary image at " << m_filename << "; check permissions of the scratch directory.\n";
+			return false;
+		}
+		m_rowEnd.clear();
+		m_rowEnd.reserve(m_height);
+		uint64_t offset = 0;
+		std::vector<Channel> row(m_width * CHANNELS);
+		for (size_t y = 0; y < m_height; ++y) {
+			canvas.copyRow(y, 0, m_width, row.data());
+			packRow(row.data(), m_width, m_packed);
+			file.write(reinterpret_cast<const char*>(m_packed.data()), static_cast<std::streamsize>(m_packed.size()));
+			offset += m_packed.size();
+			m_rowEnd.push_back(offset);
+		}
+		file.close();
+		if (file.fail()) {
+			std::cerr << "Error writing temporary image " << m_filename << '\n';
+			return false;
+		}
+		return true;
+	}
+
+	bool ScratchPart::open()
+	{
+		m_nextRow = 0;
+#ifdef _WIN32
+		m_file.open(m_filename, std::ios::in | std::ios::binary);
+		if (m_file.fail()) {
+#else
+		m_fd = ::open(m_filename.c_str(), O_RDONLY);
+		if (m_fd == -1) {
+#endif
+			std::cerr << "Error opening temporary image " << m_filename << '\n';
+			return false;
+		}
+		return true;
+	}
+
+	bool ScratchPart::isOpen() const
+	{
+#ifdef _WIN32
+		return m_file.is_open();
+#else
+		return m_fd != -1;
+#endif
+	}
+
+	bool ScratchPart::readRow(Channel* row)
+	{
+		if (m_nextRow >= m_rowEnd.size()) {
+			std::cerr << "Reading past the end of temporary image " << m_filename << '\n';
+			return false;
+		}
+		const uint64_t begin = m_nextRow == 0 ? 0 : m_rowEnd[m_nextRow - 1];
+		const size_t length = m_rowEnd[m_nextRow] - begin;
+		m_packed.resize(length);
+#ifdef _WIN32
+		// Rows are read in order, so the stream is always at the right spot
+		m_file.read(reinterpret_cast<char*>(m_packed.data()), static_cast<std::streamsize>(length));
+		const bool ok = !m_file.fail();
+#else
+		size_t done = 0;
+		while (done < length) {
+			const ssize_t got = pread(m_fd, m_packed.data() + done, length - done, static_cast<off_t>(begin + done));
+			if (got <= 0) {
+				break;
+			}
+			done += static_cast<size_t>(got);
+		}
+		const bool ok = done == length;
+#endif
+		if (!ok || !unpackRow(m_packed.data(), length, m_width, row)) {
+			std::cerr << "Error reading data from temporary image " << m_filename << '\n';
+			return false;
+		}
+		++m_nextRow;
+		return true;
+	}
+
+	void ScratchPart::remove()
+	{
+#ifdef _WIN32
+		m_file.close();
+#else
+		if (m_fd != -1) {
+			::close(m_fd);
+			m_fd = -1;
+		}
+#endif
+		std::remove(m_filename.c_str());
+		m_rowEnd.clear();
+		m_rowEnd.shrink_to_fit();
+		m_packed.clear();
+		m_packed.shrink_to_fit();
+	}
+
+	void ScratchPart::packRow(const Channel* row, const size_t width, std::vector<uint8_t>& out)
+	{
+		out.clear();
+		size_t i = 0;
+		while (i < width) {
+			const Channel* pixel = row + i * CHANNELS;
+			size_t run = 1;
+			while (i + run < width && run < MAX_REPEAT && samePixel(pixel, pixel + run * CHANNELS)) {
+				++run;
+			}
+			if (run > 1) {
+				out.push_back(static_cast<uint8_t>(126 + run));
+				out.insert(out.end(), pixel, pixel + CHANNELS);
+				i += run;
+				continue;
+			}
+			// Literal pixels up to where the next repeat starts
+			size_t literal = 1;
+			while (i + literal < width && literal < MAX_LITERAL
+				&& !(i + literal + 1 < width && samePixel(row + (i + literal) * CHANNELS, row + (i + literal + 1) * CHANNELS))) {
+				++literal;
+			}
+			out.push_back(static_cast<uint8_t>(literal - 1));
+			out.insert(out.end(), pixel, pixel + literal * CHANNELS);
+			i += literal;
+		}
+	}
+
+	bool ScratchPart::unpackRow(const uint8_t* packed, const size_t length, const size_t width, Channel* row)
+	{
+		const uint8_t* const end = packed + length;
+		Channel* const rowEnd = row + width * CHANNELS;
+		while (packed < end) {
+			const uint8_t header = *packed++;
+			if (header < 128) {
+				const size_t bytes = (size_t(header) + 1) * CHANNELS;
+				if (size_t(end - packed) < bytes || size_t(rowEnd - row) < bytes) {
+					return false;
+				}
+				std::memcpy(row, packed, bytes);
+				packed += bytes;
+				row += bytes;
+			} else {
+				const size_t count = size_t(header) - 126;
+				if (size_t(end - packed) < CHANNELS || size_t(rowEnd - row) < count * CHANNELS) {
+					return false;
+				}
+				for (size_t i = 0; i < count; ++i) {
+					std::memcpy(row, packed, CHANNELS);
+					row += CHANNELS;
+				}
+				packed += CHANNELS;
+			}
+		}
+		return row == rowEnd;
+	}
+}
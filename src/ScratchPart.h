@@ -0,0 +1,84 @@
+#pragma once
+//C++ Header
+#include <string>
+#include <vector>
+#include <fstream>
+//My-Header
+#include "defines.h"
+#include "ImageCanvas.h"
+
+namespace image
+{
+	/*
+	 Private directory for the parts of a disk cached render, created as mcmap.<time>.<n> below the root given with
+	 -scratch (the system temp dir by default) and removed with everything left in it when it goes out of scope.
+	*/
+	class ScratchDir
+	{
+	public:
+		explicit ScratchDir(const std::string& root);
+		~ScratchDir();
+		ScratchDir(const ScratchDir&) = delete;
+		ScratchDir& operator=(const ScratchDir&) = delete;
+
+		bool valid() const
+		{
+			return !m_path.empty();
+		}
+		const std::string& path() const
+		{
+			return m_path;
+		}
+
+	private:
+		std::string m_path;
+	};
+
+	/*
+	 One part of a disk cached render. Rows are stored back to back, each packed with a byte oriented run length
+	 code on whole RGBA pixels: a header byte below 128 is followed by header + 1 literal pixels, a header byte
+	 of 128 or more by one pixel that repeats header - 126 times. Big transparent areas shrink to almost nothing,
+	 everything else stays close to raw size and costs no more than a compare per pixel to pack or unpack.
+	 The row offsets stay in memory, rows are read back with pread so an open part needs no stream buffer.
+	*/
+	class ScratchPart
+	{
+	public:
+		ScratchPart(const std::string& filename, const size_t width, const size_t height);
+		ScratchPart(ScratchPart&& other) noexcept;
+		~ScratchPart();
+		ScratchPart(const ScratchPart&) = delete;
+		ScratchPart& operator=(const ScratchPart&) = delete;
+		ScratchPart& operator=(ScratchPart&&) = delete;
+
+		// Stores the top left width x height pixels of canvas
+		bool write(const ImageCanvas& canvas);
+		bool open();
+		bool isOpen() const;
+		// Unpacks the next row into row, which needs room for width pixels
+		bool readRow(Channel* row);
+		// Closes and deletes the file
+		void remove();
+
+		const std::string& filename() const
+		{
+			return m_filename;
+		}
+
+	private:
+		static void packRow(const Channel* row, const size_t width, std::vector<uint8_t>& out);
+		static bool unpackRow(const uint8_t* packed, const size_t length, const size_t width, Channel* row);
+
+		std::string m_filename;
+		size_t m_width;
+		size_t m_height;
+		std::vector<uint64_t> m_rowEnd; // file offset behind each packed row
+		std::vector<uint8_t> m_packed;
+		size_t m_nextRow;
+#ifdef _WIN32
+		std::ifstream m_file;
+#else
+		int m_fd;
+#endif
+	};
+}
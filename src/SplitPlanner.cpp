@@ -0,0 +1,150 @@
+//C++ Header
+#include <algorithm>
+//My-Header
+#include "SplitPlanner.h"
+
+namespace
+{
+	// Upper bound for the number of cells the chunks are counted in, 16 MiB of counts
+	constexpr size_t MAX_CELLS{ 4 * 1024 * 1024 };
+}
+
+namespace terrain
+{
+	SplitPlanner::SplitPlanner(const int fromX, const int fromZ, const int toX, const int toZ)
+		: m_fromX(fromX), m_fromZ(fromZ), m_toX(toX), m_toZ(toZ), m_cellShift(0), m_summed(false), m_limit(0), m_ascendingX(true), m_ascendingZ(true)
+	{
+		const size_t width = static_cast<size_t>(std::max(toX - fromX, 1));
+		const size_t depth = static_cast<size_t>(std::max(toZ - fromZ, 1));
+		while ((((width - 1) >> m_cellShift) + 2) * (((depth - 1) >> m_cellShift) + 2) > MAX_CELLS) {
+			++m_cellShift;
+		}
+		m_cellsX = ((width - 1) >> m_cellShift) + 1;
+		m_cellsZ = ((depth - 1) >> m_cellShift) + 1;
+		// One more row and column of zeros in front, for the summed area table
+		m_cells.resize((m_cellsX + 1) * (m_cellsZ + 1), 0);
+	}
+
+	void SplitPlanner::addChunk(const int x, const int z)
+	{
+		if (m_summed || x < m_fromX || x >= m_toX || z < m_fromZ || z >= m_toZ) {
+			return;
+		}
+		const size_t cellX = static_cast<size_t>(x - m_fromX) >> m_cellShift;
+		const size_t cellZ = static_cast<size_t>(z - m_fromZ) >> m_cellShift;
+		++m_cells[(cellZ + 1) * (m_cellsX + 1) + cellX + 1];
+	}
+
+	size_t SplitPlanner::chunks() const
+	{
+		if (m_summed) {
+			return count(Cells{ 0, 0, m_cellsX, m_cellsZ });
+		}
+		size_t total = 0;
+		for (const auto cell : m_cells) {
+			total += cell;
+		}
+		return total;
+	}
+
+	std::vector<ChunkArea> SplitPlanner::plan(const std::function<uint64_t(size_t, size_t)>& cost, const uint64_t limit, const Orientation orientation)
+	{
+		if (!m_summed) {
+			const size_t stride = m_cellsX + 1;
+			for (size_t z = 1; z <= m_cellsZ; ++z) {
+				for (size_t x = 1; x <= m_cellsX; ++x) {
+					m_cells[z * stride + x] += m_cells[(z - 1) * stride + x] + m_cells[z * stride + x - 1] - m_cells[(z - 1) * stride + x - 1];
+				}
+			}
+			m_summed = true;
+		}
+		m_cost = cost;
+		m_limit = limit;
+		// Same order the passes of the old uniform grid had, see prepareNextArea
+		m_ascendingX = (orientation == North || orientation == West);
+		m_ascendingZ = (orientation == North || orientation == East);
+
+		std::vector<ChunkArea> passes;
+		split(Cells{ 0, 0, m_cellsX, m_cellsZ }, passes);
+		return passes;
+	}
+
+	std::vector<ChunkArea> SplitPlanner::replan(const std::vector<ChunkArea>& areas)
+	{
+		std::vector<ChunkArea> passes;
+		for (const auto& area : areas) {
+			// Areas start and end on cell borders, except for the far edges where the last cells are cut off
+			split(Cells{ static_cast<size_t>(area.fromX - m_fromX) >> m_cellShift, static_cast<size_t>(area.fromZ - m_fromZ) >> m_cellShift,
+				((static_cast<size_t>(area.toX - m_fromX) - 1) >> m_cellShift) + 1, ((static_cast<size_t>(area.toZ - m_fromZ) - 1) >> m_cellShift) + 1 }, passes);
+		}
+		return passes;
+	}
+
+	uint64_t SplitPlanner::count(const Cells& cells) const
+	{
+		const size_t stride = m_cellsX + 1;
+		return uint64_t(m_cells[cells.toZ * stride + cells.toX]) + m_cells[cells.fromZ * stride + cells.fromX]
+			- m_cells[cells.fromZ * stride + cells.toX] - m_cells[cells.toZ * stride + cells.fromX];
+	}
+
+	SplitPlanner::Cells SplitPlanner::shrink(Cells cells) const
+	{
+		while (cells.fromX < cells.toX && count(Cells{ cells.fromX, cells.fromZ, cells.fromX + 1, cells.toZ }) == 0) ++cells.fromX;
+		while (cells.toX > cells.fromX && count(Cells{ cells.toX - 1, cells.fromZ, cells.toX, cells.toZ }) == 0) --cells.toX;
+		while (cells.fromZ < cells.toZ && count(Cells{ cells.fromX, cells.fromZ, cells.toX, cells.fromZ + 1 }) == 0) ++cells.fromZ;
+		while (cells.toZ > cells.fromZ && count(Cells{ cells.fromX, cells.toZ - 1, cells.toX, cells.toZ }) == 0) --cells.toZ;
+		return cells;
+	}
+
+	ChunkArea SplitPlanner::toChunks(const Cells& cells) const
+	{
+		ChunkArea area;
+		area.fromX = m_fromX + static_cast<int>(cells.fromX << m_cellShift);
+		area.fromZ = m_fromZ + static_cast<int>(cells.fromZ << m_cellShift);
+		area.toX = std::min(m_fromX + static_cast<int>(cells.toX << m_cellShift), m_toX);
+		area.toZ = std::min(m_fromZ + static_cast<int>(cells.toZ << m_cellShift), m_toZ);
+		area.chunks = count(cells);
+		return area;
+	}
+
+	void SplitPlanner::split(const Cells& whole, std::vector<ChunkArea>& passes)
+	{
+		const Cells cells = shrink(whole);
+		const uint64_t chunks = count(cells);
+		if (chunks == 0) {
+			return;
+		}
+		const ChunkArea area = toChunks(cells);
+		const size_t width = cells.toX - cells.fromX;
+		const size_t depth = cells.toZ - cells.fromZ;
+		if ((width == 1 && depth == 1) || m_cost(static_cast<size_t>(area.toX - area.fromX), static_cast<size_t>(area.toZ - area.fromZ)) <= m_limit) {
+			passes.push_back(area);
+			return;
+		}
+		// Cut across the longer side, where about half of the chunks are on either side
+		const bool alongX = (depth == 1 || (width > 1 && area.toX - area.fromX >= area.toZ - area.fromZ));
+		const size_t from = alongX ? cells.fromX : cells.fromZ;
+		const size_t to = alongX ? cells.toX : cells.toZ;
+		size_t cut = from + 1;
+		while (cut + 1 < to) {
+			const Cells front = alongX ? Cells{ cells.fromX, cells.fromZ, cut, cells.toZ } : Cells{ cells.fromX, cells.fromZ, cells.toX, cut };
+			if (count(front) * 2 >= chunks) {
+				break;
+			}
+			++cut;
+		}
+		Cells low = cells, high = cells;
+		if (alongX) {
+			low.toX = high.fromX = cut;
+		} else {
+			low.toZ = high.fromZ = cut;
+		}
+		if (alongX ? m_ascendingX : m_ascendingZ) {
+			split(low, passes);
+			split(high, passes);
+		} else {
+			split(high, passes);
+			split(low, passes);
+		}
+	}
+}
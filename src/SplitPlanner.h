@@ -0,0 +1,61 @@
+#pragma once
+//C++ Header
+#include <cstdint>
+#include <vector>
+#include <functional>
+//My-Header
+#include "globals.h"
+
+namespace terrain
+{
+	// Chunks FromX..ToX - 1 and FromZ..ToZ - 1 rendered in one pass
+	struct ChunkArea
+	{
+		int fromX, fromZ, toX, toZ;
+		size_t chunks; // existing chunks inside
+	};
+
+	/*
+	 Splits the area of an incremental render into passes using the chunks that actually exist. Empty borders are
+	 cut off every area before it is measured, areas that are still too expensive are halved across their longer
+	 side where that leaves about as many chunks on each side. Areas without chunks are dropped. Since every split
+	 is a straight cut, ordering the halves back to front for the orientation keeps the parts in the order they
+	 have to be blended in, and neighbouring passes end up next to each other in the image.
+	 Very big areas are counted in cells of several chunks, so the counts stay small.
+	*/
+	class SplitPlanner
+	{
+	public:
+		SplitPlanner(const int fromX, const int fromZ, const int toX, const int toZ);
+
+		void addChunk(const int x, const int z);
+		size_t chunks() const;
+		// 'cost' gives the bytes a pass of chunksX * chunksZ chunks needs
+		std::vector<ChunkArea> plan(const std::function<uint64_t(size_t, size_t)>& cost, const uint64_t limit, const Orientation orientation);
+		// Splits areas plan() returned again, after 'cost' found them to be more expensive than it said at first
+		std::vector<ChunkArea> replan(const std::vector<ChunkArea>& areas);
+
+	private:
+		// Cells from..to - 1, in cell coordinates
+		struct Cells
+		{
+			size_t fromX, fromZ, toX, toZ;
+		};
+
+		uint64_t count(const Cells& cells) const;
+		// Smallest area of the same cells holding all their chunks
+		Cells shrink(Cells cells) const;
+		ChunkArea toChunks(const Cells& cells) const;
+		void split(const Cells& cells, std::vector<ChunkArea>& passes);
+
+		int m_fromX, m_fromZ, m_toX, m_toZ;
+		size_t m_cellShift; // cells are 2^m_cellShift chunks wide
+		size_t m_cellsX, m_cellsZ;
+		std::vector<uint32_t> m_cells; // chunks per cell, until plan() turns it into a summed area table
+		bool m_summed;
+
+		std::function<uint64_t(size_t, size_t)> m_cost;
+		uint64_t m_limit;
+		bool m_ascendingX, m_ascendingZ; // back to front order
+	};
+}
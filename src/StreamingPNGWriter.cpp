@@ -0,0 +1,102 @@
+//C++ Header
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+//My-Header
+#include "StreamingPNGWriter.h"
+#include "helper.h"
+#include "globals.h"
+
+namespace image
+{
+	StreamingPNGWriter::StreamingPNGWriter()
+		: m_windowRows(0), m_flushed(0), m_outWidth(0), m_outHeight(0)
+	{}
+
+	bool StreamingPNGWriter::reserve(const size_t width, const size_t height)
+	{
+		std::cout << "Image dimensions are " << width << 'x' << height << ", 32bpp, streamed\n";
+		m_width = m_outWidth = width;
+		m_height = m_outHeight = height;
+		return true;
+	}
+
+	void StreamingPNGWriter::resize(const double scaleFac)
+	{
+		resize(static_cast<size_t>(static_cast<double>(m_width) * scaleFac), static_cast<size_t>(static_cast<double>(m_height) * scaleFac));
+	}
+
+	void StreamingPNGWriter::resize(const size_t newWidth, const size_t newHeight)
+	{
+		m_outWidth = newWidth;
+		m_outHeight = newHeight;
+	}
+
+	bool StreamingPNGWriter::begin(const std::string& path, const size_t windowRows)
+	{
+		m_file.open(path, std::fstream::out | std::fstream::binary);
+		if (m_file.fail()) {
+			std::cerr << "Error opening '" << path << "' for writing.\n";
+			return false;
+		}
+		m_path = path;
+		if (m_outWidth != m_width || m_outHeight != m_height) {
+			m_scaler = std::make_unique<ImageScaler>(Global::settings.scaleFilter, m_width, m_height, m_outWidth, m_outHeight);
+		}
+		m_encoder = ImageEncoder::create();
+		if (!m_encoder->begin(m_file, m_outWidth, m_outHeight, true)) {
+			return false;
+		}
+		m_windowRows = std::max<size_t>(std::min(windowRows, m_height), 1);
+		m_rows.assign(m_windowRows * m_width * CHANSPERPIXEL, 0);
+		m_flushed = 0;
+		std::cout << "Keeping " << m_windowRows << " rows of the image, " << static_cast<float>(m_rows.size()) / (1024.0f * 1024.0f) << "MiB\n";
+		return true;
+	}
+
+	bool StreamingPNGWriter::flushRows(const size_t row)
+	{
+		const size_t to = std::min(row, m_height);
+		for (; m_flushed < to; ++m_flushed) {
+			Channel* const line = m_rows.data() + (m_flushed % m_windowRows) * m_width * CHANSPERPIXEL;
+			if (m_scaler) {
+				if (!m_scaler->pushRow(line, [this](const Channel* out) { return m_encoder->writeRow(out); })) {
+					return false;
+				}
+			} else if (!m_encoder->writeRow(line)) {
+				return false;
+			}
+			// The row is reused for the one m_windowRows further down
+			std::fill_n(line, m_width * CHANSPERPIXEL, Channel(0));
+		}
+		return true;
+	}
+
+	bool StreamingPNGWriter::write(const std::string& path)
+	{
+		if (!m_encoder || path != m_path) {
+			std::cerr << "Streamed image was not started for '" << path << "'.\n";
+			return false;
+		}
+		std::cout << "Writing to file...\n";
+		if (!flushRows(m_height) || !m_encoder->end()) {
+			return false;
+		}
+		m_file.close();
+		m_encoder.reset();
+		m_scaler.reset();
+		m_rows.clear();
+		m_rows.shrink_to_fit();
+		m_width = 0;
+		m_height = 0;
+		return true;
+	}
+
+	Channel* StreamingPNGWriter::getPixel(const size_t x, const size_t y)
+	{
+		if (x >= m_width || y < m_flushed || y >= m_flushed + m_windowRows || y >= m_height)
+			throw std::out_of_range("getPixel outside of the streamed rows\n");
+
+		return m_rows.data() + ((y % m_windowRows) * m_width + x) * CHANSPERPIXEL;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+//C++ Header
+#include <string>
+#include <fstream>
+#include <memory>
+//My-Header
+#include "PNGWriter.h"
+#include "ImageEncoder.h"
+#include "ImageScaler.h"
+#include "MemoryTracker.h"
+
+namespace image
+{
+	/*
+	 Image of a -stream render. Only a window of rows is kept in memory, the renderer tells with flushRows() which
+	 rows no block can reach anymore and those go straight to the encoder, scaled on the fly if resize() was called
+	 before begin(). Drawing above the window throws, like getPixel outside the image does.
+	*/
+	class StreamingPNGWriter : public PNGWriter
+	{
+	public:
+		StreamingPNGWriter();
+
+		// Only remembers the size, nothing is allocated before begin()
+		bool reserve(const size_t width, const size_t height) override;
+		// Opens 'path' and keeps 'windowRows' rows of the image from here on
+		bool begin(const std::string& path, const size_t windowRows);
+		// Encodes all rows above 'row' that weren't yet
+		bool flushRows(const size_t row);
+		// Encodes the rest, 'path' has to be the one begin() opened
+		bool write(const std::string& path) override;
+		Channel* getPixel(const size_t x, const size_t y) override;
+
+		void resize(const double scaleFac) override;
+		void resize(const size_t newWidth, const size_t newHeight) override;
+
+	private:
+		std::string m_path;
+		std::fstream m_file;
+		std::unique_ptr<ImageEncoder> m_encoder;
+		std::unique_ptr<ImageScaler> m_scaler;
+		memory::TrackedVector<Channel, memory::MEM_IMAGE> m_rows; // ring of the rows not yet encoded
+		size_t m_windowRows;
+		size_t m_flushed; // rows encoded so far
+		size_t m_outWidth;
+		size_t m_outHeight;
+	};
+}
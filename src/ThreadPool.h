@@ -24,6 +24,11 @@ public:
 		stop();
 	}
 
+	std::size_t size() const noexcept
+	{
+		return mThreads.size();
+	}
+
 	template<class T, typename... Arguments>
 	auto enqueue(T task, Arguments... args) -> std::future<decltype(task(args...))>
 	{
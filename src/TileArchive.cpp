@@ -0,0 +1,257 @@
+//C++ Header
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <cstring> //memcmp (for g++)
+//My-Header
+#include "TileArchive.h"
+#include "ImageEncoder.h"
+#include "filesystem.h"
+
+namespace
+{
+	constexpr char MAGIC[8] = { 'M', 'C', 'M', 'A', 'P', 'T', 'L', 'S' };
+	constexpr uint32_t ARCHIVE_VERSION{ 1 };
+	constexpr size_t HEADER_SIZE{ 32 };
+	constexpr size_t ENTRY_SIZE{ 32 };
+
+	void putLE(uint8_t* dest, const uint64_t val, const size_t bytes)
+	{
+		for (size_t i = 0; i < bytes; ++i) {
+			dest[i] = static_cast<uint8_t>(val >> (i * 8));
+		}
+	}
+
+	uint64_t getLE(const uint8_t* src, const size_t bytes)
+	{
+		uint64_t val = 0;
+		for (size_t i = 0; i < bytes; ++i) {
+			val |= uint64_t(src[i]) << (i * 8);
+		}
+		return val;
+	}
+
+	uint64_t fnv1a(const uint8_t* data, const size_t length)
+	{
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		for (size_t i = 0; i < length; ++i) {
+			hash = (hash ^ data[i]) * 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	bool entryLess(const image::TileArchiveEntry& a, const image::TileArchiveEntry& b)
+	{
+		if (a.zoom != b.zoom) return a.zoom < b.zoom;
+		if (a.x != b.x) return a.x < b.x;
+		return a.y < b.y;
+	}
+}
+
+namespace image
+{
+	ArchiveTileStore::ArchiveTileStore(const std::string& path, const bool pyramid)
+		: m_path(path), m_pyramid(pyramid), m_end(0)
+	{}
+
+	bool ArchiveTileStore::prepare()
+	{
+		m_file.open(m_path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (m_file.fail()) {
+			std::cerr << "Could not create archive " << m_path << '\n';
+			return false;
+		}
+		// The header is rewritten with the index position once all tiles are in
+		const std::vector<char> header(HEADER_SIZE, 0);
+		m_file.write(header.data(), static_cast<std::streamsize>(header.size()));
+		m_end = HEADER_SIZE;
+		return m_file.good();
+	}
+
+	bool ArchiveTileStore::createDir([[maybe_unused]] const std::string& name)
+	{
+		return true;
+	}
+
+	std::unique_ptr<std::iostream> ArchiveTileStore::open([[maybe_unused]] const std::string& name)
+	{
+		return std::make_unique<std::stringstream>(std::ios::in | std::ios::out | std::ios::binary);
+	}
+
+	bool ArchiveTileStore::close(const TileId& id, const std::string& name, std::unique_ptr<std::iostream> stream)
+	{
+		const std::string data = static_cast<std::stringstream*>(stream.get())->str();
+		const uint64_t hash = fnv1a(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_file.write(data.data(), static_cast<std::streamsize>(data.size()));
+		if (m_file.fail()) {
+			std::cerr << "Error writing tile " << name << " to " << m_path << '\n';
+			return false;
+		}
+		m_names[name] = m_entries.size();
+		m_entries.push_back({ uint32_t(id.zoom), uint32_t(id.x), uint32_t(id.y), uint32_t(data.size()), m_end, hash });
+		m_end += data.size();
+		return true;
+	}
+
+	void ArchiveTileStore::duplicate(const TileId& id, [[maybe_unused]] const std::string& name, const std::string& original)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_duplicates.emplace_back(id, original);
+	}
+
+	bool ArchiveTileStore::finish()
+	{
+		for (const auto& dup : m_duplicates) {
+			const auto it = m_names.find(dup.second);
+			if (it == m_names.end()) {
+				std::cerr << "Tile " << dup.second << " is missing in the archive\n";
+				return false;
+			}
+			TileArchiveEntry entry = m_entries[it->second];
+			entry.zoom = uint32_t(dup.first.zoom);
+			entry.x = uint32_t(dup.first.x);
+			entry.y = uint32_t(dup.first.y);
+			m_entries.push_back(entry);
+		}
+		std::sort(m_entries.begin(), m_entries.end(), entryLess);
+
+		std::vector<uint8_t> index(m_entries.size() * ENTRY_SIZE);
+		for (size_t i = 0; i < m_entries.size(); ++i) {
+			uint8_t* dest = &index[i * ENTRY_SIZE];
+			putLE(dest, m_entries[i].zoom, 4);
+			putLE(dest + 4, m_entries[i].x, 4);
+			putLE(dest + 8, m_entries[i].y, 4);
+			putLE(dest + 12, m_entries[i].length, 4);
+			putLE(dest + 16, m_entries[i].offset, 8);
+			putLE(dest + 24, m_entries[i].hash, 8);
+		}
+		m_file.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size()));
+
+		uint8_t header[HEADER_SIZE] = {};
+		std::memcpy(header, MAGIC, sizeof(MAGIC));
+		putLE(header + 8, ARCHIVE_VERSION, 4);
+		header[12] = static_cast<uint8_t>(Global::settings.format);
+		header[13] = m_pyramid ? 1 : 0;
+		putLE(header + 16, m_end, 8);
+		putLE(header + 24, m_entries.size(), 8);
+		m_file.seekp(0);
+		m_file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		m_file.close();
+		if (m_file.fail()) {
+			std::cerr << "Error writing archive " << m_path << '\n';
+			return false;
+		}
+		std::cout << "Wrote " << m_entries.size() << " tiles to " << m_path << '\n';
+		return true;
+	}
+
+	bool TileArchiveReader::open(const std::string& path)
+	{
+		m_file.open(path, std::ios::in | std::ios::binary);
+		uint8_t header[HEADER_SIZE];
+		if (!m_file.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+			std::cerr << path << " is not a tile archive\n";
+			return false;
+		}
+		if (getLE(header + 8, 4) != ARCHIVE_VERSION || header[12] > FORMAT_RAW) {
+			std::cerr << path << " has an unsupported version\n";
+			return false;
+		}
+		m_format = static_cast<ImageFormat>(header[12]);
+		m_pyramid = header[13] != 0;
+		const uint64_t indexOffset = getLE(header + 16, 8);
+		const uint64_t numEntries = getLE(header + 24, 8);
+		m_file.seekg(0, std::ios::end);
+		m_size = static_cast<uint64_t>(m_file.tellg());
+		// Both come from the file, a truncated or damaged one must not make the index huge
+		if (indexOffset < HEADER_SIZE || indexOffset > m_size || numEntries > (m_size - indexOffset) / ENTRY_SIZE) {
+			std::cerr << "The index of " << path << " is outside the file, the archive is damaged\n";
+			return false;
+		}
+
+		std::vector<uint8_t> index(numEntries * ENTRY_SIZE);
+		m_file.seekg(static_cast<std::streamoff>(indexOffset));
+		if (!m_file.read(reinterpret_cast<char*>(index.data()), static_cast<std::streamsize>(index.size()))) {
+			std::cerr << "Could not read the index of " << path << '\n';
+			return false;
+		}
+		m_entries.resize(numEntries);
+		for (size_t i = 0; i < m_entries.size(); ++i) {
+			const uint8_t* src = &index[i * ENTRY_SIZE];
+			m_entries[i] = { uint32_t(getLE(src, 4)), uint32_t(getLE(src + 4, 4)), uint32_t(getLE(src + 8, 4)), uint32_t(getLE(src + 12, 4)), getLE(src + 16, 8), getLE(src + 24, 8) };
+			if (!inFile(m_entries[i])) {
+				std::cerr << "Tile " << tileName(m_entries[i]) << " of " << path << " is outside the file, the archive is damaged\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool TileArchiveReader::inFile(const TileArchiveEntry& entry) const
+	{
+		return entry.offset <= m_size && entry.length <= m_size - entry.offset;
+	}
+
+	const TileArchiveEntry* TileArchiveReader::find(const uint32_t zoom, const uint32_t x, const uint32_t y) const
+	{
+		const TileArchiveEntry key{ zoom, x, y, 0, 0, 0 };
+		const auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key, entryLess);
+		if (it == m_entries.end() || it->zoom != zoom || it->x != x || it->y != y) {
+			return nullptr;
+		}
+		return &*it;
+	}
+
+	bool TileArchiveReader::read(const TileArchiveEntry& entry, std::vector<uint8_t>& data)
+	{
+		if (!inFile(entry)) {
+			return false;
+		}
+		data.resize(entry.length);
+		m_file.seekg(static_cast<std::streamoff>(entry.offset));
+		if (!m_file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+			m_file.clear();
+			return false;
+		}
+		return fnv1a(data.data(), data.size()) == entry.hash;
+	}
+
+	std::string TileArchiveReader::tileName(const TileArchiveEntry& entry) const
+	{
+		if (m_pyramid) {
+			return std::to_string(entry.zoom) + '/' + std::to_string(entry.x) + '/' + std::to_string(entry.y) + ImageEncoder::extension(m_format);
+		}
+		return "x" + std::to_string(entry.x) + 'y' + std::to_string(entry.y) + 'z' + std::to_string(entry.zoom) + ImageEncoder::extension(m_format);
+	}
+
+	bool extractArchive(const std::string& archive, const std::string& folder)
+	{
+		TileArchiveReader reader;
+		if (!reader.open(archive)) {
+			return false;
+		}
+		std::vector<uint8_t> data;
+		for (const TileArchiveEntry& entry : reader.entries()) {
+			const std::filesystem::path file = folder + '/' + reader.tileName(entry);
+			if (!Dir::createDirs(file.parent_path().string())) {
+				std::cerr << "Could not create " << file.parent_path().string() << " folder\n";
+				return false;
+			}
+			if (!reader.read(entry, data)) {
+				std::cerr << "Tile " << reader.tileName(entry) << " is damaged\n";
+				return false;
+			}
+			std::ofstream out(file, std::ios::out | std::ios::binary);
+			out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+			if (out.fail()) {
+				std::cerr << "Error writing " << file.string() << '\n';
+				return false;
+			}
+		}
+		std::cout << "Extracted " << reader.entries().size() << " tiles to " << folder << '\n';
+		return true;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+//C++ Header
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+//My-Header
+#include "TileStore.h"
+#include "globals.h"
+
+namespace image
+{
+	/*
+	 Single file tile archive, all numbers little endian:
+	 header (32 bytes): magic "MCMAPTLS", uint32 version, uint8 image format, uint8 layout (0 = x/y/size tiles, 1 = z/x/y pyramid),
+	                    uint16 reserved, uint64 offset of the index, uint64 number of index entries
+	 tile data: the encoded tiles, back to back, in the order they were finished
+	 index: one entry per tile sorted by zoom, x and y, see TileArchiveEntry. Duplicate tiles point to the same data
+	*/
+	struct TileArchiveEntry
+	{
+		uint32_t zoom, x, y, length;
+		uint64_t offset;
+		uint64_t hash; // FNV-1a of the tile data
+	};
+
+	class ArchiveTileStore : public TileStore
+	{
+	public:
+		ArchiveTileStore(const std::string& path, const bool pyramid);
+
+		bool prepare() override;
+		bool createDir(const std::string& name) override;
+		std::unique_ptr<std::iostream> open(const std::string& name) override;
+		bool close(const TileId& id, const std::string& name, std::unique_ptr<std::iostream> stream) override;
+		void duplicate(const TileId& id, const std::string& name, const std::string& original) override;
+		bool finish() override;
+
+	private:
+		std::string m_path;
+		bool m_pyramid;
+		std::fstream m_file;
+		uint64_t m_end;
+		std::mutex m_mutex;
+		std::vector<TileArchiveEntry> m_entries;
+		std::unordered_map<std::string, size_t> m_names; // tile name -> index into m_entries
+		std::vector<std::pair<TileId, std::string>> m_duplicates; // duplicate, name of the original
+	};
+
+	class TileArchiveReader
+	{
+	public:
+		bool open(const std::string& path);
+
+		const std::vector<TileArchiveEntry>& entries() const
+		{
+			return m_entries;
+		}
+		const TileArchiveEntry* find(const uint32_t zoom, const uint32_t x, const uint32_t y) const;
+		// Reads the data of a tile and checks its hash
+		bool read(const TileArchiveEntry& entry, std::vector<uint8_t>& data);
+		// File name the tile would have been written to without -archive
+		std::string tileName(const TileArchiveEntry& entry) const;
+
+	private:
+		// Whether the data of 'entry' lies within the file
+		bool inFile(const TileArchiveEntry& entry) const;
+
+		std::ifstream m_file;
+		uint64_t m_size; // of the file
+		ImageFormat m_format;
+		bool m_pyramid;
+		std::vector<TileArchiveEntry> m_entries;
+	};
+
+	// Writes all tiles of an archive as files into 'folder'
+	bool extractArchive(const std::string& archive, const std::string& folder);
+}
@@ -0,0 +1,56 @@
+//C++ Header
+#include <iostream>
+#include <cstring> //memcpy (for g++)
+//My-Header
+#include "TileDeduplicator.h"
+
+namespace image
+{
+	TileDeduplicator::TileDeduplicator()
+		: m_numEmpty(0), m_numDuplicates(0)
+	{}
+
+	TileDeduplicator::Result TileDeduplicator::check(const std::string& name, const size_t size, const std::function<const Channel*(const size_t)>& row, std::string& original)
+	{
+		// Two independent multiplicative hashes, together 128 bits, so a collision is not a practical concern
+		uint64_t h1 = 0xcbf29ce484222325ULL ^ size, h2 = 0x9e3779b97f4a7c15ULL ^ size;
+		uint32_t alpha = 0;
+		auto mix = [&h1, &h2](const uint32_t val) {
+			h1 = (h1 ^ val) * 0x100000001b3ULL;
+			h2 = ((h2 + val) * 0xff51afd7ed558ccdULL);
+			h2 ^= h2 >> 29;
+		};
+		for (size_t y = 0; y < size; ++y) {
+			const Channel* px = row(y);
+			for (size_t x = 0; x < size; ++x, px += 4) {
+				uint32_t val;
+				std::memcpy(&val, px, sizeof(val));
+				alpha |= px[3];
+				mix(val);
+			}
+		}
+
+		if (alpha == 0) {
+			++m_numEmpty;
+			return TILE_EMPTY;
+		}
+		const auto it = m_tiles.emplace(Hash(h1, h2), name);
+		if (it.second) {
+			return TILE_NEW;
+		}
+		original = it.first->second;
+		++m_numDuplicates;
+		return TILE_DUPLICATE;
+	}
+
+	TileDeduplicator::Result TileDeduplicator::skipEmpty()
+	{
+		++m_numEmpty;
+		return TILE_EMPTY;
+	}
+
+	void TileDeduplicator::printStats() const
+	{
+		std::cout << "Skipped " << m_numEmpty << " empty and " << m_numDuplicates << " duplicate tiles\n";
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+//C++ Header
+#include <string>
+#include <map>
+#include <utility>
+#include <functional>
+//My-Header
+#include "defines.h"
+
+namespace image
+{
+	/*
+	 Finds tiles that don't have to be written: fully transparent ones are skipped,
+	 tiles that have the same content as an earlier one are handed to TileStore::duplicate().
+	 Tile contents are compared by a 128 bit hash, the pixels are not kept around.
+	*/
+	class TileDeduplicator
+	{
+	public:
+		enum Result
+		{
+			TILE_NEW, // has to be encoded
+			TILE_EMPTY, // fully transparent, don't write anything
+			TILE_DUPLICATE // same as the earlier tile 'original'
+		};
+
+		TileDeduplicator();
+
+		/*
+		 Checks a tile of size x size pixels, 'row' returns the size pixels of each of its rows. Pixels outside
+		 of the image have to be transparent, just like the padding of the tile writers.
+		 'name' identifies the tile, for duplicates 'original' is set to the name of the first tile with that content.
+		*/
+		Result check(const std::string& name, const size_t size, const std::function<const Channel*(const size_t)>& row, std::string& original);
+		// For tiles the caller already knows to be fully transparent
+		Result skipEmpty();
+
+		void printStats() const;
+
+	private:
+		using Hash = std::pair<uint64_t, uint64_t>;
+
+		std::map<Hash, std::string> m_tiles;
+		size_t m_numEmpty;
+		size_t m_numDuplicates;
+	};
+}
@@ -0,0 +1,196 @@
+//C++ Header
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring> //memcpy (for g++)
+//My-Header
+#include "TilePyramid.h"
+#include "ImageEncoder.h"
+#include "globals.h"
+
+namespace
+{
+	// Upper bound of tiles waiting for an encoder thread, each one holds TILESIZE * TILESIZE pixels
+	constexpr size_t MAX_PENDING_TILES{ 64 };
+
+	bool encodeTile(image::TileStore* store, const image::TileId id, const std::string name, const size_t tileSize, std::shared_ptr<std::vector<Channel>> pixels)
+	{
+		std::unique_ptr<std::iostream> stream = store->open(name);
+		if (!stream) {
+			return false;
+		}
+		auto encoder = image::ImageEncoder::create();
+		if (!encoder->begin(*stream, tileSize, tileSize)) {
+			return false;
+		}
+		for (size_t y = 0; y < tileSize; ++y) {
+			if (!encoder->writeRow(&(*pixels)[y * tileSize * 4])) {
+				return false;
+			}
+		}
+		return encoder->end() && store->close(id, name, std::move(stream));
+	}
+
+	// 2x2 box filter, colors are weighted by alpha so transparent pixels don't darken the edges
+	void downsample(const Channel* top, const Channel* bottom, Channel* out, const size_t outWidth)
+	{
+		for (size_t x = 0; x < outWidth; ++x, top += 8, bottom += 8, out += 4) {
+			const uint32_t alpha = uint32_t(top[3]) + top[7] + bottom[3] + bottom[7];
+			if (alpha == 0) {
+				std::memset(out, 0, 4);
+				continue;
+			}
+			for (size_t c = 0; c < 3; ++c) {
+				const uint32_t sum = top[c] * uint32_t(top[3]) + top[c + 4] * uint32_t(top[7]) + bottom[c] * uint32_t(bottom[3]) + bottom[c + 4] * uint32_t(bottom[7]);
+				out[c] = static_cast<Channel>((sum + alpha / 2) / alpha);
+			}
+			out[3] = static_cast<Channel>((alpha + 2) / 4);
+		}
+	}
+}
+
+namespace image
+{
+	TilePyramid::TilePyramid(TileStore& store, const size_t width, const size_t height)
+		: m_store(store), m_width(width), m_height(height), m_rowsAdded(0)
+	{
+		size_t maxZoom = 0;
+		while ((TILESIZE << maxZoom) < std::max(width, height)) {
+			++maxZoom;
+		}
+		for (size_t z = maxZoom + 1; z-- > 0;) {
+			const size_t levelTile = TILESIZE << (maxZoom - z); // size of a tile of this level in full resolution pixels
+			Level level;
+			level.zoom = z;
+			level.width = (width + levelTile - 1) / levelTile;
+			level.height = (height + levelTile - 1) / levelTile;
+			level.row = 0;
+			level.band.resize(level.width * TILESIZE * TILESIZE * 4, 0);
+			m_levels.push_back(std::move(level));
+		}
+		m_scratch.resize(m_levels.front().width * TILESIZE * 4, 0);
+		if (Global::settings.dedup != DEDUP_OFF) {
+			m_dedup = std::make_unique<TileDeduplicator>();
+		}
+	}
+
+	TilePyramid::~TilePyramid()
+	{
+		waitForJobs(0);
+	}
+
+	bool TilePyramid::prepare()
+	{
+		for (const Level& level : m_levels) {
+			for (size_t x = 0; x < level.width; ++x) {
+				if (!m_store.createDir(std::to_string(level.zoom) + '/' + std::to_string(x))) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool TilePyramid::addRow(const Channel* row)
+	{
+		if (m_rowsAdded >= m_height) {
+			return false;
+		}
+		++m_rowsAdded;
+		return pushRow(0, row, m_width);
+	}
+
+	bool TilePyramid::finish()
+	{
+		const std::vector<Channel> empty(m_scratch.size(), 0);
+		// Higher levels first, their padding rows end up in the lower levels
+		for (size_t i = 0; i < m_levels.size(); ++i) {
+			while (m_levels[i].row < m_levels[i].height * TILESIZE) {
+				if (!pushRow(i, empty.data(), 0)) {
+					return false;
+				}
+			}
+		}
+		if (!waitForJobs(0)) {
+			return false;
+		}
+		if (m_dedup) {
+			m_dedup->printStats();
+		}
+		return true;
+	}
+
+	bool TilePyramid::pushRow(const size_t levelIdx, const Channel* row, const size_t rowWidth)
+	{
+		Level& level = m_levels[levelIdx];
+		const size_t bandWidth = level.width * TILESIZE * 4;
+		Channel* dest = &level.band[(level.row % TILESIZE) * bandWidth];
+		std::memcpy(dest, row, rowWidth * 4);
+		std::fill(dest + rowWidth * 4, dest + bandWidth, 0);
+
+		// Every odd row completes a pair for the next lower level. The band holds TILESIZE rows, so both are still in there
+		if (levelIdx + 1 < m_levels.size() && level.row % 2 == 1) {
+			downsample(dest - bandWidth, dest, m_scratch.data(), bandWidth / 8);
+			if (!pushRow(levelIdx + 1, m_scratch.data(), bandWidth / 8)) {
+				return false;
+			}
+		}
+
+		++level.row;
+		if (level.row % TILESIZE == 0) {
+			return flushBand(level);
+		}
+		return true;
+	}
+
+	bool TilePyramid::flushBand(Level& level)
+	{
+		const size_t tileY = level.row / TILESIZE - 1;
+		const size_t bandWidth = level.width * TILESIZE * 4;
+		for (size_t tileX = 0; tileX < level.width; ++tileX) {
+			auto pixels = std::make_shared<std::vector<Channel>>(TILESIZE * TILESIZE * 4);
+			for (size_t y = 0; y < TILESIZE; ++y) {
+				std::memcpy(&(*pixels)[y * TILESIZE * 4], &level.band[y * bandWidth + tileX * TILESIZE * 4], TILESIZE * 4);
+			}
+			if (!writeTile(level.zoom, tileX, tileY, pixels)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool TilePyramid::writeTile(const size_t zoom, const size_t x, const size_t y, std::shared_ptr<std::vector<Channel>> pixels)
+	{
+		const std::string name = std::to_string(zoom) + '/' + std::to_string(x) + '/' + std::to_string(y) + ImageEncoder::extension();
+		const TileId id{ zoom, x, y };
+		if (m_dedup) {
+			std::string original;
+			const Channel* data = pixels->data();
+			const auto result = m_dedup->check(name, TILESIZE, [data](const size_t row) { return data + row * TILESIZE * 4; }, original);
+			if (result == TileDeduplicator::TILE_DUPLICATE) {
+				m_store.duplicate(id, name, original);
+			}
+			if (result != TileDeduplicator::TILE_NEW) {
+				return true;
+			}
+		}
+		if (!Global::threadPool) {
+			return encodeTile(&m_store, id, name, TILESIZE, pixels);
+		}
+		if (!waitForJobs(MAX_PENDING_TILES - 1)) {
+			return false;
+		}
+		m_jobs.push_back(Global::threadPool->enqueue(encodeTile, &m_store, id, name, TILESIZE, pixels));
+		return true;
+	}
+
+	bool TilePyramid::waitForJobs(const size_t maxPending)
+	{
+		bool success = true;
+		while (m_jobs.size() > maxPending) {
+			success = m_jobs.front().get() && success;
+			m_jobs.pop_front();
+		}
+		return success;
+	}
+}
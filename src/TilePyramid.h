@@ -0,0 +1,61 @@
+#pragma once
+//C++ Header
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <memory>
+//My-Header
+#include "defines.h"
+#include "TileDeduplicator.h"
+#include "TileStore.h"
+
+namespace image
+{
+	/*
+	 Zoom pyramid of fixed size tiles in a z/x/y layout, like web map viewers expect them.
+	 The highest zoom level is the image at full resolution, every lower level is half the size of the one above.
+	 Rows are fed top to bottom, each level only keeps one band of TILESIZE rows: when a band is full it is cut into
+	 tiles and every two rows of a level are box filtered into one row of the next lower level.
+	 Tiles are encoded on Global::threadPool if there is one, empty and duplicate tiles are filtered out with -dedup.
+	*/
+	class TilePyramid
+	{
+	public:
+		TilePyramid(TileStore& store, const size_t width, const size_t height);
+		~TilePyramid();
+
+		// Creates the directory structure for plain files, call once before adding rows
+		bool prepare();
+		// Adds the next row of the full resolution image, 'row' has to hold at least width pixels
+		bool addRow(const Channel* row);
+		// Pads missing rows and writes the remaining tiles
+		bool finish();
+
+		static constexpr size_t TILESIZE{ 256 };
+
+	private:
+		struct Level
+		{
+			size_t zoom;
+			size_t width; // in tiles
+			size_t height; // in tiles
+			size_t row; // next row of this level
+			std::vector<Channel> band; // TILESIZE rows of width * TILESIZE pixels
+		};
+
+		bool pushRow(const size_t levelIdx, const Channel* row, const size_t rowWidth);
+		bool flushBand(Level& level);
+		bool writeTile(const size_t zoom, const size_t x, const size_t y, std::shared_ptr<std::vector<Channel>> pixels);
+		bool waitForJobs(const size_t maxPending);
+
+		TileStore& m_store;
+		size_t m_width;
+		size_t m_height;
+		size_t m_rowsAdded;
+		std::vector<Level> m_levels; // highest zoom first
+		std::vector<Channel> m_scratch;
+		std::deque<std::future<bool>> m_jobs;
+		std::unique_ptr<TileDeduplicator> m_dedup;
+	};
+}
@@ -0,0 +1,96 @@
+//C++ Header
+#include <fstream>
+#include <filesystem>
+//My-Header
+#include "TileStore.h"
+#include "TileArchive.h"
+#include "globals.h"
+#include "filesystem.h"
+#include "json.hpp"
+
+namespace image
+{
+	std::unique_ptr<TileStore> TileStore::create(const std::string& path, const bool pyramid)
+	{
+		if (Global::settings.archive) {
+			return std::make_unique<ArchiveTileStore>(path, pyramid);
+		}
+		return std::make_unique<FileTileStore>(path);
+	}
+
+	FileTileStore::FileTileStore(const std::string& path)
+		: m_path(path)
+	{}
+
+	bool FileTileStore::prepare()
+	{
+		if (!Dir::createDir(m_path)) {
+			std::cerr << "Could not create " << m_path << " folder\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool FileTileStore::createDir(const std::string& name)
+	{
+		if (!Dir::createDirs(m_path + '/' + name)) {
+			std::cerr << "Could not create " << m_path << '/' << name << " folder\n";
+			return false;
+		}
+		return true;
+	}
+
+	std::unique_ptr<std::iostream> FileTileStore::open(const std::string& name)
+	{
+		auto file = std::make_unique<std::fstream>(m_path + '/' + name, std::ios::out | std::ios::binary);
+		if (file->fail()) {
+			std::cerr << "Error opening file " << m_path << '/' << name << '\n';
+			return nullptr;
+		}
+		return file;
+	}
+
+	bool FileTileStore::close([[maybe_unused]] const TileId& id, const std::string& name, std::unique_ptr<std::iostream> stream)
+	{
+		static_cast<std::fstream*>(stream.get())->close();
+		if (stream->fail()) {
+			std::cerr << "Error writing file " << m_path << '/' << name << '\n';
+			return false;
+		}
+		return true;
+	}
+
+	void FileTileStore::duplicate([[maybe_unused]] const TileId& id, const std::string& name, const std::string& original)
+	{
+		m_duplicates.emplace_back(name, original);
+	}
+
+	bool FileTileStore::finish()
+	{
+		nlohmann::json manifest = nlohmann::json::object();
+		for (const auto& dup : m_duplicates) {
+			const std::filesystem::path target = m_path + '/' + dup.first;
+			std::error_code err;
+			std::filesystem::remove(target, err); // left over from an earlier run
+			if (Global::settings.dedup == DEDUP_LINK) {
+				err.clear();
+				std::filesystem::create_hard_link(m_path + '/' + dup.second, target, err);
+				if (!err) {
+					continue;
+				}
+			}
+			manifest[dup.first] = dup.second;
+		}
+		if (manifest.empty()) {
+			return true;
+		}
+		std::ofstream oStream(m_path + "/duplicates.json");
+		oStream << manifest;
+		if (oStream.fail()) {
+			std::cerr << "Error writing " << m_path << "/duplicates.json\n";
+			return false;
+		}
+		std::cout << manifest.size() << " duplicates are listed in " << m_path << "/duplicates.json\n";
+		return true;
+	}
+}
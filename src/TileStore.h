@@ -0,0 +1,56 @@
+#pragma once
+//C++ Header
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <utility>
+
+namespace image
+{
+	struct TileId
+	{
+		size_t zoom, x, y;
+	};
+
+	/*
+	 Destination of the tiled writers. A tile is encoded into the stream returned by open(), and handed back with close().
+	 open() and close() may be called from several threads at once, everything else only from the writing thread.
+	*/
+	class TileStore
+	{
+	public:
+		virtual ~TileStore() = default;
+
+		virtual bool prepare() = 0;
+		// Sub folder for tiles, only meaningful for plain files
+		virtual bool createDir(const std::string& name) = 0;
+		virtual std::unique_ptr<std::iostream> open(const std::string& name) = 0;
+		virtual bool close(const TileId& id, const std::string& name, std::unique_ptr<std::iostream> stream) = 0;
+		// Tile 'name' has the same content as the already stored tile 'original'
+		virtual void duplicate(const TileId& id, const std::string& name, const std::string& original) = 0;
+		// Call after all tiles are closed
+		virtual bool finish() = 0;
+
+		// Plain files below 'path' or, with -archive, a single archive file at 'path'
+		static std::unique_ptr<TileStore> create(const std::string& path, const bool pyramid);
+	};
+
+	// Every tile is a file below the output folder, duplicates become hardlinks or are listed in duplicates.json
+	class FileTileStore : public TileStore
+	{
+	public:
+		explicit FileTileStore(const std::string& path);
+
+		bool prepare() override;
+		bool createDir(const std::string& name) override;
+		std::unique_ptr<std::iostream> open(const std::string& name) override;
+		bool close(const TileId& id, const std::string& name, std::unique_ptr<std::iostream> stream) override;
+		void duplicate(const TileId& id, const std::string& name, const std::string& original) override;
+		bool finish() override;
+
+	private:
+		std::string m_path;
+		std::vector<std::pair<std::string, std::string>> m_duplicates; // duplicate, original
+	};
+}
@@ -11,21 +11,23 @@
 #define SECTION_Y_SHIFT 4
 #define CHUNKS_PER_BIOME_FILE 32
 #define REGIONSIZE 32
+// -blendcave lays the blocks below this height over the map
+#define CAVE_OVERLAY_HEIGHT 64
 // Some macros for easier array access
+// Index of the column x, z in all three arrays, see Global::columnX and terrain::layoutTerrain
+// x and z are the ones of the view, they run the way the orientation draws them
+#define COLUMNAT(x,z) (Global::columnX[x] + Global::columnZ[z])
+// Same for x and z of the world, counted from the lowest corner of the area. The loader places blocks with these
+#define WORLDCOLUMNAT(x,z) (Global::worldX[x] + Global::worldZ[z])
 // First: Block array
-#define BLOCKAT(x,y,z) Global::terrain[(y) + ((z) + ((x) * Global::MapsizeZ)) * Global::MapsizeY] //Sortierung: Erst Y, dann Z, dann X
-#define BLOCKEAST(x,y,z) Global::terrain[(y) + ((Global::MapsizeZ - ((x) + 1)) + ((z) * Global::MapsizeZ)) * Global::MapsizeY]
-#define BLOCKWEST(x,y,z) Global::terrain[(y) + ((x) + ((Global::MapsizeX - ((z) + 1)) * Global::MapsizeZ)) * Global::MapsizeY]
-#define BLOCKNORTH(x,y,z) Global::terrain[(y) + ((z) + ((x) * Global::MapsizeZ)) * Global::MapsizeY]
-#define BLOCKSOUTH(x,y,z) Global::terrain[(y) + ((Global::MapsizeZ - ((z) + 1)) + ((Global::MapsizeX - ((x) + 1)) * Global::MapsizeZ)) * Global::MapsizeY]
+#define BLOCKAT(x,y,z) Global::terrain[(y) + COLUMNAT(x, z) * Global::MapsizeY] // Y first, then the columns in the order COLUMNAT gives
+#define WORLDBLOCKAT(x,y,z) Global::terrain[(y) + WORLDCOLUMNAT(x, z) * Global::MapsizeY]
 // Same for lightmap
-#define GETLIGHTAT(x,y,z) ((Global::light[((y) / 2) + ((z) + ((x) * Global::MapsizeZ)) * ((Global::MapsizeY + 1) / 2)] >> (((y) % 2) * 4)) & 0xF)
-#define SETLIGHTEAST(x,y,z) Global::light[((y) / 2) + ((Global::MapsizeZ - ((x) + 1)) + ((z) * Global::MapsizeZ)) * ((Global::MapsizeY + 1) / 2)]
-#define SETLIGHTWEST(x,y,z) Global::light[((y) / 2) + ((x) + ((Global::MapsizeX - ((z) + 1)) * Global::MapsizeZ)) * ((Global::MapsizeY + 1) / 2)]
-#define SETLIGHTNORTH(x,y,z) Global::light[((y) / 2) + ((z) + ((x) * Global::MapsizeZ)) * ((Global::MapsizeY + 1) / 2)]
-#define SETLIGHTSOUTH(x,y,z) Global::light[((y) / 2) + ((Global::MapsizeZ - ((z) + 1)) + ((Global::MapsizeX - ((x) + 1)) * Global::MapsizeZ)) * ((Global::MapsizeY + 1) / 2)]
+#define LIGHTAT(x,y,z) Global::light[((y) / 2) + COLUMNAT(x, z) * ((Global::MapsizeY + 1) / 2)]
+#define WORLDLIGHTAT(x,y,z) Global::light[((y) / 2) + WORLDCOLUMNAT(x, z) * ((Global::MapsizeY + 1) / 2)]
+#define GETLIGHTAT(x,y,z) ((LIGHTAT(x, y, z) >> (((y) % 2) * 4)) & 0xF)
 // Heightmap array
-#define HEIGHTAT(x,z) Global::heightMap[(z) + ((x) * Global::MapsizeZ)]
+#define HEIGHTAT(x,z) Global::heightMap[COLUMNAT(x, z)]
 
 //determinate 64Bit or 32Bit
 #if defined(_WIN32) || defined(_WIN64)
@@ -2,12 +2,89 @@
  * This file contains functions to draw the world in to an image buffer
  */
 #include <cstring> //memcpy (for g++)
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MCMAP_BLEND_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MCMAP_BLEND_SSE2
+#endif
 
 #include "draw_png.h"
 #include "colors.h"
 #include "helper.h"
 
 #define CHANSPERPIXEL image::PNGWriter::CHANSPERPIXEL
+
+namespace
+{
+	/*
+	 Vector versions of draw::blend for blendRow. Channels are widened to 16 bit, where the products of
+	 two channels still fit, and divided by 255 with (x + 1 + (x >> 8)) >> 8, which is exact for all
+	 x <= 255 * 255. Pixels that draw::blend would copy are selected from the source at the end.
+	*/
+#ifdef MCMAP_BLEND_SSE2
+	inline __m128i div255(const __m128i x)
+	{
+		return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+	}
+
+	// Two pixels with 16 bit channels
+	inline __m128i blendWide(const __m128i src, const __m128i dst)
+	{
+		const __m128i full = _mm_set1_epi16(255);
+		const __m128i srcAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		const __m128i dstAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(dst, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		const __m128i color = div255(_mm_add_epi16(_mm_mullo_epi16(src, srcAlpha), _mm_mullo_epi16(_mm_sub_epi16(full, srcAlpha), dst)));
+		const __m128i alpha = _mm_add_epi16(dst, div255(_mm_mullo_epi16(srcAlpha, _mm_sub_epi16(full, dstAlpha))));
+		const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+		return _mm_or_si128(_mm_and_si128(alphaLanes, alpha), _mm_andnot_si128(alphaLanes, color));
+	}
+
+	// Four pixels
+	inline __m128i blend4(const __m128i src, const __m128i dst)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+		const __m128i blended = _mm_packus_epi16(blendWide(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero)),
+			blendWide(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero)));
+		const __m128i copy = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(dst, alphaMask), zero), _mm_cmpeq_epi32(_mm_and_si128(src, alphaMask), alphaMask));
+		return _mm_or_si128(_mm_and_si128(copy, src), _mm_andnot_si128(copy, blended));
+	}
+#endif
+
+#ifdef MCMAP_BLEND_AVX2
+	inline __m256i div255(const __m256i x)
+	{
+		return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8)), 8);
+	}
+
+	inline __m256i blendWide(const __m256i src, const __m256i dst)
+	{
+		const __m256i full = _mm256_set1_epi16(255);
+		const __m256i srcAlpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		const __m256i dstAlpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(dst, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		const __m256i color = div255(_mm256_add_epi16(_mm256_mullo_epi16(src, srcAlpha), _mm256_mullo_epi16(_mm256_sub_epi16(full, srcAlpha), dst)));
+		const __m256i alpha = _mm256_add_epi16(dst, div255(_mm256_mullo_epi16(srcAlpha, _mm256_sub_epi16(full, dstAlpha))));
+		const __m256i alphaLanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+		return _mm256_or_si256(_mm256_and_si256(alphaLanes, alpha), _mm256_andnot_si256(alphaLanes, color));
+	}
+
+	// Eight pixels, unpack and pack both work within 128 bit lanes so the pixel order survives
+	inline __m256i blend8(const __m256i src, const __m256i dst)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+		const __m256i blended = _mm256_packus_epi16(blendWide(_mm256_unpacklo_epi8(src, zero), _mm256_unpacklo_epi8(dst, zero)),
+			blendWide(_mm256_unpackhi_epi8(src, zero), _mm256_unpackhi_epi8(dst, zero)));
+		const __m256i copy = _mm256_or_si256(_mm256_cmpeq_epi32(_mm256_and_si256(dst, alphaMask), zero), _mm256_cmpeq_epi32(_mm256_and_si256(src, alphaMask), alphaMask));
+		return _mm256_blendv_epi8(blended, src, copy);
+	}
+#endif
+}
+
 namespace draw
 {
 
@@ -16,11 +93,27 @@ namespace draw
 	Color_t modColor(const Color_t& color, const int mod);
 	inline void modColor(Channel* const pos, const int mod);
 	inline void setColor(Channel* const pos, const Color_t& color);
+	void drawReduced(const int x, const int y, const StateID_t stateID, const std::array<ColorArray, 3>& colors, const bool allowOverwrite, image::PNGWriter* pngWriter);
+
+	/*
+	 A block drawn at a reduced resolution: 2x2 pixels at half size, a single pixel from quarter size on.
+	 Each pixel counts how many pixels of the full 4x4 sprite use each of the 6 colors (3 shades of up to 2 colors),
+	 so its color can be averaged once the brightness adjusted colors are known.
+	*/
+	struct ReducedSprite
+	{
+		size_t size;
+		uint32_t samples; // full resolution pixels per reduced pixel
+		std::array<std::array<uint8_t, 6>, 4> count;
+	};
+	std::vector<ReducedSprite> reducedSprites;
 
 	uint64_t calcImageSize(const size_t mapChunksX, const size_t mapChunksZ, const size_t mapHeight, size_t &pixelsX, size_t &pixelsY, const bool tight)
 	{
 		pixelsX = (mapChunksX * CHUNKSIZE_X + mapChunksZ * CHUNKSIZE_Z) * 2 + (tight ? 3 : 10);
 		pixelsY = (mapChunksX * CHUNKSIZE_X + mapChunksZ * CHUNKSIZE_Z + mapHeight * static_cast<size_t>(Global::OffsetY)) + (tight ? 3 : 10);
+		pixelsX = reduceSize(pixelsX);
+		pixelsY = reduceSize(pixelsY);
 		return pixelsX * image::PNGWriter::BYTESPERPIXEL * pixelsY;
 	}
 
@@ -29,10 +122,10 @@ namespace draw
 	*/
 	void setPixel(const int x, const int y, const StateID_t stateID, const float fsub, image::PNGWriter* pngWriter)
 	{
-		if (x < 0 || static_cast<size_t>(x) >= pngWriter->getWidth()) {
+		if (reducePos(x) < 0 || static_cast<size_t>(reducePos(x)) >= pngWriter->getWidth()) {
 			return;
 		}
-		if (y < 0 || static_cast<size_t>(y) >= pngWriter->getHeight()) {
+		if (reducePos(y) < 0 || static_cast<size_t>(reducePos(y)) >= pngWriter->getHeight()) {
 			return;
 		}
 
@@ -47,6 +140,10 @@ namespace draw
 			colors[1].addColor(modColor(currentColor, -17));
 			colors[2].addColor(modColor(currentColor, -27));
 		}
+		if (Global::settings.renderShift) {
+			drawReduced(x, y, stateID, colors, true, pngWriter);
+			return;
+		}
 
 		/*
 			Drawmode:
@@ -56,6 +153,8 @@ namespace draw
 			11X - dark color, X index
 		*/
 		uint64_t drawMode = model.drawMode;
+		// Parts of a disk cached image are cut off at the edges of the final image, blocks there only partly fit
+		const bool clipped = static_cast<size_t>(x) + 4 > pngWriter->getWidth() || static_cast<size_t>(y) + 4 > pngWriter->getHeight();
 		for (size_t yPos = 0; yPos < 4; yPos++) {
 			for (size_t xPos = 0; xPos < 4; xPos++) {
 				const uint64_t pixelDrawMode = drawMode & 0b111;
@@ -63,6 +162,9 @@ namespace draw
 				if ((pixelDrawMode & 0b110) == 0) {
 					continue;
 				}
+				if (clipped && (static_cast<size_t>(x) + xPos >= pngWriter->getWidth() || static_cast<size_t>(y) + yPos >= pngWriter->getHeight())) {
+					continue;
+				}
 				Channel* pos = pngWriter->getPixel(static_cast<size_t>(x) + xPos, static_cast<size_t>(y) + yPos);
 
 				const size_t colorIdx = (((pixelDrawMode & 0b110) >> 1) - 1);
@@ -90,10 +192,10 @@ namespace draw
 
 	void blendPixel(const int x, const int y, const StateID_t stateID, const float fsub, image::PNGWriter* pngWriter)
 	{
-		if (x < 0 || static_cast<size_t>(x) >= pngWriter->getWidth()) {
+		if (reducePos(x) < 0 || static_cast<size_t>(reducePos(x)) >= pngWriter->getWidth()) {
 			return;
 		}
-		if (y < 0 || static_cast<size_t>(y) >= pngWriter->getHeight()) {
+		if (reducePos(y) < 0 || static_cast<size_t>(reducePos(y)) >= pngWriter->getHeight()) {
 			return;
 		}
 
@@ -107,6 +209,10 @@ namespace draw
 			colors[1].addColor(modColor(currentColor, -17));
 			colors[2].addColor(modColor(currentColor, -27));
 		}
+		if (Global::settings.renderShift) {
+			drawReduced(x, y, stateID, colors, false, pngWriter);
+			return;
+		}
 
 		/*
 			Drawmode:
@@ -116,6 +222,8 @@ namespace draw
 			11X - dark color, X index
 		*/
 		uint64_t drawMode = model.drawMode;
+		// Parts of a disk cached image are cut off at the edges of the final image, blocks there only partly fit
+		const bool clipped = static_cast<size_t>(x) + 4 > pngWriter->getWidth() || static_cast<size_t>(y) + 4 > pngWriter->getHeight();
 		for (size_t yPos = 0; yPos < 4; yPos++) {
 			for (size_t xPos = 0; xPos < 4; xPos++) {
 				const uint64_t pixelDrawMode = drawMode & 0b111;
@@ -123,6 +231,9 @@ namespace draw
 				if ((pixelDrawMode & 0b110) == 0) {
 					continue;
 				}
+				if (clipped && (static_cast<size_t>(x) + xPos >= pngWriter->getWidth() || static_cast<size_t>(y) + yPos >= pngWriter->getHeight())) {
+					continue;
+				}
 				Channel* pos = pngWriter->getPixel(static_cast<size_t>(x) + xPos, static_cast<size_t>(y) + yPos);
 
 				const size_t colorIdx = ((pixelDrawMode & 0b110) >> 1) - 1;
@@ -143,6 +254,86 @@ namespace draw
 		}
 	}
 
+	void prepareReducedSprites()
+	{
+		const size_t size = 4 >> std::min(Global::settings.renderShift, 2);
+		const size_t block = 4 / size;
+		reducedSprites.clear();
+		reducedSprites.reserve(Global::colorMap.size());
+		for (const Model_t& model : Global::colorMap) {
+			ReducedSprite sprite{ size, static_cast<uint32_t>(block * block), {} };
+			uint64_t drawMode = model.drawMode;
+			for (size_t yPos = 0; yPos < 4; yPos++) {
+				for (size_t xPos = 0; xPos < 4; xPos++) {
+					const uint64_t pixelDrawMode = drawMode & 0b111;
+					drawMode >>= 3;
+					if ((pixelDrawMode & 0b110) == 0) {
+						continue;
+					}
+					const size_t choice = ((((pixelDrawMode & 0b110) >> 1) - 1) << 1) | (pixelDrawMode & 1);
+					++sprite.count[(yPos / block) * size + xPos / block][choice];
+				}
+			}
+			reducedSprites.push_back(sprite);
+		}
+	}
+
+	// Draws the reduced sprite of a block, (x, y) is the position of the 4x4 sprite in full resolution
+	void drawReduced(const int x, const int y, const StateID_t stateID, const std::array<ColorArray, 3>& colors, const bool allowOverwrite, image::PNGWriter* pngWriter)
+	{
+		const ReducedSprite& sprite = reducedSprites[stateID];
+		const int posX = reducePos(x);
+		const int posY = reducePos(y);
+		for (size_t i = 0; i < sprite.size * sprite.size; ++i) {
+			const size_t pixelX = static_cast<size_t>(posX) + i % sprite.size;
+			const size_t pixelY = static_cast<size_t>(posY) + i / sprite.size;
+			if (pixelX >= pngWriter->getWidth() || pixelY >= pngWriter->getHeight()) {
+				continue;
+			}
+			// Average of the covered pixels weighted by their alpha, uncovered ones count as transparent
+			uint32_t alpha = 0, red = 0, green = 0, blue = 0, most = 0;
+			size_t dominant = 0;
+			for (size_t choice = 0; choice < 6; ++choice) {
+				const uint32_t count = sprite.count[i][choice];
+				if (count == 0) {
+					continue;
+				}
+				const Color_t& color = colors[choice >> 1][choice & 1];
+				const uint32_t weight = count * color.a;
+				alpha += weight;
+				red += weight * color.r;
+				green += weight * color.g;
+				blue += weight * color.b;
+				if (count > most) {
+					most = count;
+					dominant = choice;
+				}
+			}
+			if (alpha == 0) {
+				continue;
+			}
+			const Color_t& main = colors[dominant >> 1][dominant & 1];
+			const Color_t pixelColor(Channel((red + alpha / 2) / alpha), Channel((green + alpha / 2) / alpha), Channel((blue + alpha / 2) / alpha),
+				Channel((alpha + sprite.samples / 2) / sprite.samples), main.noise, main.brightness);
+
+			int noise = 0;
+			if (Global::settings.noise && pixelColor.noise) {
+				noise = static_cast<int>(static_cast<float>(Global::settings.noise * pixelColor.noise) * (static_cast<float>(pixelColor.brightness + 10) / 2650.0f));
+			}
+
+			Channel* pos = pngWriter->getPixel(pixelX, pixelY);
+			if (allowOverwrite && pixelColor.a == 255 && !Global::settings.blendAll) {
+				setColor(pos, pixelColor);
+			} else {
+				blend(pos, pixelColor);
+			}
+
+			if (noise) {
+				modColor(pos, rand() % (noise * 2) - noise);
+			}
+		}
+	}
+
 	void blend(Channel* const destination, const Channel* const source)
 	{
 #define PALPHA 3
@@ -157,6 +348,59 @@ namespace draw
 		destination[PALPHA] += static_cast<Channel>((size_t(source[PALPHA]) * size_t(255 - destination[PALPHA])) / 255);
 	}
 
+	void blendRow(Channel* const destination, const Channel* const source, const size_t count)
+	{
+		size_t i = 0;
+#ifdef MCMAP_BLEND_AVX2
+		const __m256i alphaMask8 = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+		for (; i + 8 <= count; i += 8) {
+			Channel* const dst = destination + i * CHANSPERPIXEL;
+			const __m256i src = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i * CHANSPERPIXEL));
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(src, alphaMask8), alphaMask8)) == -1) {
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), src); // all opaque
+				continue;
+			}
+			const __m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), blend8(src, old));
+		}
+#endif
+#ifdef MCMAP_BLEND_SSE2
+		const __m128i alphaMask4 = _mm_set1_epi32(static_cast<int>(0xFF000000));
+		for (; i + 4 <= count; i += 4) {
+			Channel* const dst = destination + i * CHANSPERPIXEL;
+			const __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i * CHANSPERPIXEL));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(src, alphaMask4), alphaMask4)) == 0xFFFF) {
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), src); // all opaque
+				continue;
+			}
+			const __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), blend4(src, old));
+		}
+#endif
+		while (i < count) {
+			const Channel* src = source + i * CHANSPERPIXEL;
+			Channel* dst = destination + i * CHANSPERPIXEL;
+			size_t run = 0;
+			if (src[PALPHA] == 255) { // opaque run is copied in one go
+				while (i + run < count && src[run * CHANSPERPIXEL + PALPHA] == 255) {
+					++run;
+				}
+				std::memcpy(dst, src, run * CHANSPERPIXEL);
+			} else {
+				// Blending a fully transparent black pixel doesn't change a pixel that isn't transparent
+				uint32_t value;
+				while (i + run < count && (std::memcpy(&value, src + run * CHANSPERPIXEL, sizeof(value)), value == 0) && dst[run * CHANSPERPIXEL + PALPHA] != 0) {
+					++run;
+				}
+				if (run == 0) {
+					blend(dst, src);
+					run = 1;
+				}
+			}
+			i += run;
+		}
+	}
+
 	inline void blend(Channel* const destination, const Color_t& source)
 	{
 		if (destination[PALPHA] == 0 || source.a == 255) { //compare alpha
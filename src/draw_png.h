@@ -2,6 +2,7 @@
 #include <fstream>
 #include "defines.h"
 #include "PNGWriter.h"
+#include "globals.h"
 
 namespace draw
 {
@@ -9,5 +10,21 @@ namespace draw
 	void blendPixel(const int x, const int y, const StateID_t stateID, const float fsub, image::PNGWriter* pngWriter);
 	uint64_t calcImageSize(const size_t mapChunksX, const size_t mapChunksZ, const size_t mapHeight, size_t &pixelsX, size_t &pixelsY, const bool tight = false);
 	void blend(Channel* const destination, const Channel* const source);
+	// Same as blend() for 'count' pixels in a row, vectorized where possible
+	void blendRow(Channel* const destination, const Channel* const source, const size_t count);
+	// Builds the averaged block sprites used when rendering at a reduced resolution, call after loading the colors
+	void prepareReducedSprites();
+
+	// With Settings::renderShift all positions are still calculated in full resolution pixels,
+	// these map them and image sizes to the reduced image
+	inline int reducePos(const int pos)
+	{
+		return pos >> Global::settings.renderShift; // arithmetic shift, rounds negative positions down too
+	}
+
+	inline size_t reduceSize(const size_t size)
+	{
+		return (size + (size_t(1) << Global::settings.renderShift) - 1) >> Global::settings.renderShift;
+	}
 }
 
@@ -9,6 +9,13 @@ namespace Dir
 		return std::filesystem::create_directory(path);
 	}
 
+	bool createDirs(const std::string& path)
+	{
+		std::error_code err;
+		std::filesystem::create_directories(path, err);
+		return dirExists(path);
+	}
+
 	bool dirExists(const std::string& strFilename)
 	{
 		return std::filesystem::exists(strFilename) && std::filesystem::is_directory(strFilename);
@@ -17,4 +24,18 @@ namespace Dir
 	{
 		return std::filesystem::exists(strFilename) && !std::filesystem::is_directory(strFilename);
 	}
+
+	bool removeAll(const std::string& path)
+	{
+		std::error_code err;
+		std::filesystem::remove_all(path, err);
+		return !err;
+	}
+
+	std::string tempDir()
+	{
+		std::error_code err;
+		const std::filesystem::path path = std::filesystem::temp_directory_path(err);
+		return err ? std::string(".") : path.string();
+	}
 }
@@ -4,6 +4,9 @@
 namespace Dir
 {
 	bool createDir(const std::string& path);
+	bool createDirs(const std::string& path); // creates missing parents too, true if the directory exists afterwards
 	bool dirExists(const std::string& strFilename);
 	bool fileExists(const std::string& strFilename);
+	bool removeAll(const std::string& path); // deletes the directory and everything in it
+	std::string tempDir();
 }
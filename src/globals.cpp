@@ -6,12 +6,14 @@ size_t Global::MapsizeZ = 0, Global::MapsizeX = 0, Global::Terrainsize = 0;
 int Global::MapminY = 0;
 size_t Global::MapsizeY = 256;
 int Global::OffsetY = 2;
-Settings Global::settings = { East, false, false, false, false, 0, false, false, false, false };
+Settings Global::settings = { East, false, false, false, false, 0, false, false, false, false, false, -1, FILTER_ADAPTIVE, FORMAT_PNG, false, false, DEDUP_OFF, false, SCALE_BICUBIC, 0, false, "", 0, false, LAYOUT_COLUMNS };
 
 std::vector<Marker> Global::markers;
-std::vector<StateID_t> Global::terrain;
-std::vector<uint8_t> Global::light;
-std::vector<uint16_t> Global::heightMap;
+memory::TrackedVector<StateID_t, memory::MEM_TERRAIN> Global::terrain;
+memory::TrackedVector<uint8_t, memory::MEM_LIGHT> Global::light;
+memory::TrackedVector<uint16_t, memory::MEM_HEIGHTMAP> Global::heightMap;
+std::vector<size_t> Global::columnX, Global::columnZ;
+std::vector<size_t> Global::worldX, Global::worldZ;
 
 std::unordered_map<std::string, Tree<std::string, StateID_t>> Global::blockTree;
 std::vector<Model_t> Global::colorMap;
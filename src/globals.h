@@ -9,6 +9,7 @@
 #include "defines.h"
 #include "ThreadPool.h"
 #include "Tree.h"
+#include "MemoryTracker.h"
 
 enum Orientation
 {
@@ -32,6 +33,42 @@ enum WorldFormat
 	ANVIL13 = 3 //New Anvil format in Minecraft 1.13
 };
 
+enum PNGFilter
+{
+	FILTER_ADAPTIVE, // libpng picks the best filter per row
+	FILTER_NONE,
+	FILTER_SUB,
+	FILTER_UP,
+	FILTER_AVG,
+	FILTER_PAETH
+};
+
+enum ImageFormat
+{
+	FORMAT_PNG,
+	FORMAT_QOI,
+	FORMAT_RAW // RGBA pixels with a small header, see RawEncoder.h
+};
+
+enum TileDedup
+{
+	DEDUP_OFF,
+	DEDUP_LINK, // duplicates become hardlinks, the manifest is only used where that fails
+	DEDUP_MANIFEST // duplicates are only listed in the manifest
+};
+
+enum ScaleFilter
+{
+	SCALE_BICUBIC,
+	SCALE_AREA // average of all covered pixels, best for strong downscaling
+};
+
+enum TerrainLayout
+{
+	LAYOUT_COLUMNS, // x by x, z by z inside
+	LAYOUT_BRICKS // 16x16 columns per brick in Morton order, the bricks x by x, see terrain::layoutTerrain
+};
+
 enum SpecialBlocks
 {
 	LEAVES,
@@ -54,6 +91,21 @@ struct Settings
 	bool blendAll; // If set, do not assume certain blocks (like grass) are always opaque
 	bool hell, serverHell; // rendering the nether
 	bool end; //rendering the End
+	bool pngFast; // use the built-in single pass png encoder instead of libpng
+	int pngLevel; // zlib compression level for libpng, -1 for the default
+	PNGFilter pngFilter; // row filter used when encoding png files
+	ImageFormat format; // file format of the final image or tiles
+	bool palette; // write 8 bit indexed png files
+	bool pyramid; // tiled output as a z/x/y zoom pyramid, see TilePyramid.h
+	TileDedup dedup; // skip empty tiles and write identical tiles only once
+	bool archive; // tiled output goes into a single archive file, see TileArchive.h
+	ScaleFilter scaleFilter; // filter used by -scale, see ImageScaler.h
+	int renderShift; // draw blocks at 1 / 2^renderShift of the full resolution, see draw_png.h
+	bool mappedCanvas; // images bigger than -mem are drawn into a memory mapped file, see MappedPNGWriter.h
+	std::string scratchDir; // parts of disk cached renders go below this, empty for the system temp dir
+	size_t pipelineDepth; // finished parts of disk cached renders written in the background, 0 writes them right away
+	bool streaming; // draw the map diagonal by diagonal and write rows as soon as they are done, see drawStreaming
+	TerrainLayout terrainLayout; // order of the columns in terrain, light and heightMap
 };
 
 class Global
@@ -68,9 +120,11 @@ public:
 	static Settings settings; //Used settings
 
 	static std::vector<Marker> markers;
-	static std::vector<StateID_t> terrain;
-	static std::vector<uint8_t>	light; // 3D arrays holding terrain/lightmap
-	static std::vector<uint16_t> heightMap; // 2D array to store min and max block height per X/Z - it's 2 bytes per index, upper for highest, lower for lowest (don't ask!)
+	static memory::TrackedVector<StateID_t, memory::MEM_TERRAIN> terrain;
+	static memory::TrackedVector<uint8_t, memory::MEM_LIGHT> light; // 3D arrays holding terrain/lightmap
+	static memory::TrackedVector<uint16_t, memory::MEM_HEIGHTMAP> heightMap; // 2D array to store min and max block height per X/Z - it's 2 bytes per index, upper for highest, lower for lowest (don't ask!)
+	static std::vector<size_t> columnX, columnZ; // the column at x, z is number columnX[x] + columnZ[z] in the arrays above
+	static std::vector<size_t> worldX, worldZ; // same for x and z of the world, columnX and columnZ are these turned to the orientation
 
 	static std::unordered_map<std::string, Tree<std::string, StateID_t>> blockTree; //Maps blockState to id
 	static std::vector<Model_t> colorMap; //maps id to color_t
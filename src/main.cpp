@@ -32,6 +32,8 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <chrono>
+#include <future>
 #include <algorithm> //std::min, std::max
 
 #include "defines.h"
@@ -42,26 +44,144 @@
 #include "filesystem.h"
 #include "json.hpp"
 #include "helper.h"
+#include "SplitPlanner.h"
+#include "ChunkWindow.h"
+#include "ColumnPass.h"
+#include "MemoryTracker.h"
 
  //PNGWriter
 #include "BasicTiledPNGWriter.h"
 #include "CachedTiledPNGWriter.h"
+#include "MappedPNGWriter.h"
+#include "StreamingPNGWriter.h"
+#include "TileArchive.h"
 
 namespace
 {
 	// For bright edge
 	bool gAtBottomLeft = true, gAtBottomRight = true;
+	// Index of the pass of incremental rendering being rendered, see prepareNextArea
+	size_t gCurrentPass = 0;
+	// The whole image is only kept in memory if this much is left for the terrain of a pass, -mem otherwise splits
+	// the image into parts as well
+	constexpr uint64_t MIN_PASS_MEMORY{ 220 * uint64_t(1024 * 1024) };
+	constexpr uint64_t MIB{ 1024 * 1024 };
+	// With -stream, rays of the occlusion start this many blocks in front of the chunk they are for
+	constexpr size_t STREAM_LOOKAHEAD{ 16 };
+
+	// One image of a -views/-variants render
+	struct View
+	{
+		Orientation orientation;
+		bool night;
+		std::string suffix; // added to the name of the output file, like -north-night
+		int cropLeft, cropTop;
+		size_t bitmapX, bitmapY;
+	};
 }
 
 // Macros to make code more readable
 #define BLOCK_AT_MAPEDGE(x,z) (((z)+1 == Global::MapsizeZ-CHUNKSIZE_Z && gAtBottomLeft) || ((x)+1 == Global::MapsizeX-CHUNKSIZE_X && gAtBottomRight))
 
+namespace
+{
+	// Terrain of a pass for shadeBlock
+	struct DenseTerrain
+	{
+		StateID_t block(const size_t x, const size_t y, const size_t z) const
+		{
+			return BLOCKAT(x, y, z);
+		}
+		int light(const size_t x, const size_t y, const size_t z) const
+		{
+			return GETLIGHTAT(x, y, z);
+		}
+	};
+
+	// Brightness adjustment of block 'c' at x, y, z. 'terrain' has block(x, y, z) and light(x, y, z) like BLOCKAT and GETLIGHTAT
+	template<typename Terrain>
+	float shadeBlock(const Terrain& terrain, const std::vector<float>& brightnessLookup, const size_t x, const size_t y, const size_t z, const StateID_t c)
+	{
+		//float col = float(y) * .78f - 91;
+		float brightnessAdjustment = brightnessLookup[y];
+		if (Global::settings.blendUnderground) {
+			brightnessAdjustment -= 168;
+		}
+		// we use light if...
+		if (Global::settings.nightmode // nightmode is active, or
+			|| (Global::settings.skylight // skylight is used and
+				&& (!BLOCK_AT_MAPEDGE(x, z))  // block is not edge of map (or if it is, has non-opaque block above)
+				)) {
+			int l = terrain.light(x, y, z);  // find out how much light hits that block
+			if (l == 0 && y + 1 == Global::MapsizeY) {
+				l = (Global::settings.nightmode ? 3 : 15);   // quickfix: assume maximum strength at highest level
+			} else {
+				const bool up = y + 1 < Global::MapsizeY;
+				if (x + 1 < Global::MapsizeX && (!up || terrain.block(x + 1, y + 1, z) == 0)) {
+					l = std::max(l, terrain.light(x + 1, y, z));
+					if (x + 2 < Global::MapsizeX) l = std::max(l, terrain.light(x + 2, y, z) - 1);
+				}
+				if (z + 1 < Global::MapsizeZ && (!up || terrain.block(x, y + 1, z + 1) == 0)) {
+					l = std::max(l, terrain.light(x, y, z + 1));
+					if (z + 2 < Global::MapsizeZ) l = std::max(l, terrain.light(x, y, z + 2) - 1);
+				}
+				if (up) l = std::max(l, terrain.light(x, y + 1, z));
+				//if (y + 2 < Global::MapsizeY) l = MAX(l, GETLIGHTAT(x, y + 2, z) - 1);
+			}
+			if (!Global::settings.skylight) { // Night
+				brightnessAdjustment -= static_cast<float>(100 - l * 8);
+			} else { // Day
+				brightnessAdjustment -= static_cast<float>(210 - l * 14);
+			}
+		}
+
+		// Edge detection (this means where terrain goes 'down' and the side of the block is not visible)
+		if (y != 0) {
+			const StateID_t b = terrain.block(x - 1, y - 1, z - 1);
+			if ((y + 1 < Global::MapsizeY)  // In bounds?
+				&& terrain.block(x, y + 1, z) == AIR  // Only if block above is air
+				&& terrain.block(x - 1, y + 1, z - 1) == AIR  // and block above and behind is air
+				&& (b == AIR || b == c)   // block behind (from pov) this one is same type or air
+				&& (terrain.block(x - 1, y, z) == AIR || terrain.block(x, y, z - 1) == AIR)) {   // block TL/TR from this one is air = edge
+				brightnessAdjustment += 13;
+			}
+		}
+		return brightnessAdjustment;
+	}
+
+	// Draws the blocks of column x, z between the lowest and highest y in 'height' (packed like HEIGHTAT), back to front
+	template<typename Terrain>
+	void drawColumn(const Terrain& terrain, const std::vector<float>& brightnessLookup, const size_t x, const size_t z, const uint16_t height, const int offsetX, const int offsetY, image::PNGWriter* pngWriter)
+	{
+		const int bmpPosX = static_cast<int>((Global::MapsizeZ - z + x) * 2) - (CHUNKSIZE_Z + CHUNKSIZE_X) * 2 + offsetX;
+		int bmpPosY = static_cast<int>(Global::MapsizeY * static_cast<size_t>(Global::OffsetY) + z + x) - CHUNKSIZE_Z - CHUNKSIZE_X + offsetY + 2 - (height & 0xFF) * Global::OffsetY;
+		const unsigned int max = static_cast<unsigned int>((height & 0xFF00) >> 8);
+		for (unsigned int y = static_cast<unsigned int>(int8_t(height)); y < max; ++y) {
+			bmpPosY -= Global::OffsetY;
+			const StateID_t c = terrain.block(x, y, z);
+			if (c == AIR) {
+				continue;
+			}
+			draw::setPixel(bmpPosX, bmpPosY, c, shadeBlock(terrain, brightnessLookup, x, y, z, c), pngWriter);
+		}
+	}
+}
+
 void optimizeTerrain();
 size_t optimizeTerrainMulti(const size_t startX, const size_t startZ);
-void undergroundMode(bool explore);
-bool prepareNextArea(int splitX, int splitZ, int &bitmapStartX, int &bitmapStartY);
+size_t optimizeChunk(const terrain::ChunkWindow& window, const size_t chunkX, const size_t chunkZ);
+bool drawStreaming(const std::string& fromPath, const std::string& outfile, const std::vector<float>& brightnessLookup, const int offsetX, const int offsetY, image::StreamingPNGWriter* pngWriter);
+void drawTerrain(const std::vector<float>& brightnessLookup, const int offsetX, const int offsetY, image::PNGWriter* pngWriter);
+void keepCaveBand(terrain::TerrainVector& caveBand);
+void drawCaveOverlay(const terrain::TerrainVector& caveBand, const int offsetX, const int offsetY, image::PNGWriter* pngWriter);
+bool drawViews(const std::vector<View>& views, const std::string& outfile, const std::vector<float>& brightnessLookup, const terrain::TerrainVector& caveBand, const int offsetX, const int offsetY, const double scaleImage, const bool overlapWrites);
+std::string viewFile(const std::string& file, const std::string& suffix);
+void undergroundMode();
+bool prepareNextArea(const std::vector<terrain::ChunkArea>& passes, int &bitmapStartX, int &bitmapStartY);
+const terrain::ChunkArea* peekNextArea(const std::vector<terrain::ChunkArea>& passes);
 void writeInfoFile(const std::string& file, int xo, int yo, size_t bitmapx, size_t bitmapy);
 static inline int floorChunkX(const int val);
+static double secondsSince(const std::chrono::steady_clock::time_point& start);
 static inline int floorChunkZ(const int val);
 void printHelp(const std::string& binary);
 
@@ -76,6 +196,7 @@ int main(int argc, char **argv)
 	std::string filename, outfile, tilePath, colorfile, infoFile;
 	bool infoOnly = false;
 	double scaleImage = 1.0;
+	bool scaleNative = true;
 
 #if NUM_BITS == 32
 	uint64_t memlimit = 1500 * uint64_t(1024 * 1024);
@@ -84,6 +205,9 @@ int main(int argc, char **argv)
 #endif
 
 	bool memlimitSet = false;
+	// Orientations and day (false) or night (true) of -views and -variants, empty if not given
+	std::vector<Orientation> viewOrientations;
+	std::vector<bool> viewNights;
 
 	{ // -- New command line parsing --
 #		define MOREARGS(x) (argpos + (x) < argc)
@@ -154,6 +278,36 @@ int main(int argc, char **argv)
 				}
 				memlimitSet = true;
 				memlimit = std::stoul(NEXTARG) * size_t(1024 * 1024);
+			} else if (option == "-scratch") {
+				if (!MOREARGS(1)) {
+					std::cerr << "Error: -scratch needs a directory, ie: -scratch /tmp\n";
+					return 1;
+				}
+				Global::settings.scratchDir = NEXTARG;
+			} else if (option == "-mmap") {
+				Global::settings.mappedCanvas = true;
+			} else if (option == "-layout") {
+				if (!MOREARGS(1)) {
+					std::cerr << "Error: -layout needs either columns or bricks, ie: -layout columns\n";
+					return 1;
+				}
+				const std::string layout = NEXTARG;
+				if (layout == "columns") {
+					Global::settings.terrainLayout = LAYOUT_COLUMNS;
+				} else if (layout == "bricks") {
+					Global::settings.terrainLayout = LAYOUT_BRICKS;
+				} else {
+					std::cerr << "Error: unknown terrain layout " << layout << ", use columns or bricks\n";
+					return 1;
+				}
+			} else if (option == "-stream") {
+				Global::settings.streaming = true;
+			} else if (option == "-pipeline") {
+				if (!MOREARGS(1) || !helper::isNumeric(POLLARG(1)) || atoi(POLLARG(1)) < 0) {
+					std::cerr << "Error: -pipeline needs a positive integer argument, ie: -pipeline 2\n";
+					return 1;
+				}
+				Global::settings.pipelineDepth = std::stoul(NEXTARG);
 			} else if (option == "-file") {
 				if (!MOREARGS(1)) {
 					std::cerr << "Error: -file needs one argument, ie: -file myworld.png\n";
@@ -188,6 +342,40 @@ int main(int argc, char **argv)
 				Global::settings.orientation = East;
 			} else if (option == "-west") {
 				Global::settings.orientation = West;
+			} else if (option == "-views") {
+				if (!MOREARGS(1)) {
+					std::cerr << "Error: -views needs a list of orientations, ie: -views north,east,south,west\n";
+					return 1;
+				}
+				for (const auto& name : helper::strSplit(NEXTARG, ',')) {
+					if (name == "north") {
+						viewOrientations.push_back(North);
+					} else if (name == "east") {
+						viewOrientations.push_back(East);
+					} else if (name == "south") {
+						viewOrientations.push_back(South);
+					} else if (name == "west") {
+						viewOrientations.push_back(West);
+					} else {
+						std::cerr << "Error: unknown orientation " << name << ", use north, east, south or west\n";
+						return 1;
+					}
+				}
+			} else if (option == "-variants") {
+				if (!MOREARGS(1)) {
+					std::cerr << "Error: -variants needs a list of day and night, ie: -variants day,night\n";
+					return 1;
+				}
+				for (const auto& name : helper::strSplit(NEXTARG, ',')) {
+					if (name == "day") {
+						viewNights.push_back(false);
+					} else if (name == "night") {
+						viewNights.push_back(true);
+					} else {
+						std::cerr << "Error: unknown variant " << name << ", use day or night\n";
+						return 1;
+					}
+				}
 			} else if (option == "-split") {
 				if (!MOREARGS(1)) {
 					std::cerr << "Error: -split needs a path argument, ie: -split tiles/\n";
@@ -242,6 +430,90 @@ int main(int argc, char **argv)
 					std::cerr << "Error: -scale needs a postitive scale value > 0. eg. 50";
 					return 1;
 				}
+			} else if (option == "-scalefull") {
+				scaleNative = false;
+			} else if (option == "-pngfast") {
+				Global::settings.pngFast = true;
+			} else if (option == "-pnglevel") {
+				if (!MOREARGS(1) || !helper::isNumeric(POLLARG(1)) || atoi(POLLARG(1)) < 0 || atoi(POLLARG(1)) > 9) {
+					std::cerr << "Error: " << option << " needs a compression level between 0 and 9, ie: " << option << " 3\n";
+					return 1;
+				}
+				Global::settings.pngLevel = std::stoi(NEXTARG);
+			} else if (option == "-pngfilter") {
+				if (!MOREARGS(1)) {
+					std::cerr << "Error: -pngfilter needs one of none, sub, up, avg, paeth or all, ie: -pngfilter up\n";
+					return 1;
+				}
+				const std::string filter = NEXTARG;
+				if (filter == "none") {
+					Global::settings.pngFilter = FILTER_NONE;
+				} else if (filter == "sub") {
+					Global::settings.pngFilter = FILTER_SUB;
+				} else if (filter == "up") {
+					Global::settings.pngFilter = FILTER_UP;
+				} else if (filter == "avg") {
+					Global::settings.pngFilter = FILTER_AVG;
+				} else if (filter == "paeth") {
+					Global::settings.pngFilter = FILTER_PAETH;
+				} else if (filter == "all") {
+					Global::settings.pngFilter = FILTER_ADAPTIVE;
+				} else {
+					std::cerr << "Error: unknown png filter " << filter << ", use one of none, sub, up, avg, paeth or all\n";
+					return 1;
+				}
+			} else if (option == "-scalefilter") {
+				if (!MOREARGS(1)) {
+					std::cerr << "Error: -scalefilter needs either bicubic or area, ie: -scalefilter area\n";
+					return 1;
+				}
+				const std::string filter = NEXTARG;
+				if (filter == "bicubic") {
+					Global::settings.scaleFilter = SCALE_BICUBIC;
+				} else if (filter == "area") {
+					Global::settings.scaleFilter = SCALE_AREA;
+				} else {
+					std::cerr << "Error: unknown scale filter " << filter << ", use bicubic or area\n";
+					return 1;
+				}
+			} else if (option == "-pyramid") {
+				Global::settings.pyramid = true;
+			} else if (option == "-dedup") {
+				Global::settings.dedup = DEDUP_LINK;
+				if (MOREARGS(1) && std::string(POLLARG(1)) == "link") {
+					++argpos;
+				} else if (MOREARGS(1) && std::string(POLLARG(1)) == "manifest") {
+					Global::settings.dedup = DEDUP_MANIFEST;
+					++argpos;
+				}
+			} else if (option == "-archive") {
+				Global::settings.archive = true;
+			} else if (option == "-extract") {
+				if (!MOREARGS(2)) {
+					std::cerr << "Error: -extract needs an archive and a target folder, ie: -extract tiles.mcmap tiles/\n";
+					return 1;
+				}
+				const std::string archive = NEXTARG;
+				const std::string folder = NEXTARG;
+				return image::extractArchive(archive, folder) ? 0 : 1;
+			} else if (option == "-palette") {
+				Global::settings.palette = true;
+			} else if (option == "-format") {
+				if (!MOREARGS(1)) {
+					std::cerr << "Error: -format needs one of png, qoi or raw, ie: -format qoi\n";
+					return 1;
+				}
+				const std::string format = NEXTARG;
+				if (format == "png") {
+					Global::settings.format = FORMAT_PNG;
+				} else if (format == "qoi") {
+					Global::settings.format = FORMAT_QOI;
+				} else if (format == "raw") {
+					Global::settings.format = FORMAT_RAW;
+				} else {
+					std::cerr << "Error: unknown image format " << format << ", use one of png, qoi or raw\n";
+					return 1;
+				}
 			} else {
 				filename = option;
 			}
@@ -259,10 +531,67 @@ int main(int argc, char **argv)
 	}
 #endif
 
+	if (Global::settings.format != FORMAT_PNG && (Global::settings.pngFast || Global::settings.pngLevel >= 0 || Global::settings.pngFilter != FILTER_ADAPTIVE)) {
+		std::cerr << "The png options have no effect when not writing png files\n";
+	}
+	if (Global::settings.palette && Global::settings.format != FORMAT_PNG) {
+		std::cerr << "-palette only works with png files, writing rgba\n";
+	}
+	if (Global::settings.palette && Global::settings.format == FORMAT_PNG && Global::settings.pngFast) {
+		std::cerr << "The fast png encoder can't write indexed images, -pngfast is ignored\n";
+	}
+	if (Global::settings.pngFast && (Global::settings.pngFilter == FILTER_AVG || Global::settings.pngFilter == FILTER_PAETH)) {
+		std::cerr << "The fast png encoder only supports the none, sub and up filters, using up\n";
+	}
+	if (Global::settings.pngFast && Global::settings.pngLevel >= 0) {
+		std::cerr << "-pnglevel has no effect on the fast png encoder\n";
+	}
+
 	if (!tilePath.empty() && scaleImage != 1.0) {
 		std::cerr << "You can't scale output image, if using -split argument\n";
 		scaleImage = 1.0;
 	}
+	// Draw at the smallest power of two reduction that is still at least the requested size, only the rest gets resampled
+	if (scaleNative && scaleImage < 1.0) {
+		constexpr int maxRenderShift = 4;
+		while (Global::settings.renderShift < maxRenderShift && scaleImage * 2.0 <= 1.0 + 1e-9) {
+			scaleImage *= 2.0;
+			++Global::settings.renderShift;
+		}
+		if (scaleImage > 1.0 - 1e-9) {
+			scaleImage = 1.0;
+		}
+	}
+	if (tilePath.empty() && Global::settings.pyramid) {
+		std::cerr << "-pyramid only works together with -split\n";
+		Global::settings.pyramid = false;
+	}
+	if (tilePath.empty() && Global::settings.archive) {
+		std::cerr << "-archive only works together with -split\n";
+		Global::settings.archive = false;
+	}
+	if (tilePath.empty() && Global::settings.dedup != DEDUP_OFF) {
+		std::cerr << "-dedup only works together with -split\n";
+		Global::settings.dedup = DEDUP_OFF;
+	}
+	if (Global::settings.streaming && (!tilePath.empty() || Global::settings.underground || Global::settings.blendUnderground)) {
+		std::cerr << "-stream doesn't work with -split, -cave or -blendcave, rendering the usual way\n";
+		Global::settings.streaming = false;
+	}
+	if (Global::settings.streaming && Global::settings.mappedCanvas) {
+		std::cerr << "-mmap has no effect with -stream, the image is never kept as a whole\n";
+		Global::settings.mappedCanvas = false;
+	}
+	if ((!viewOrientations.empty() || !viewNights.empty()) && (!tilePath.empty() || Global::settings.streaming || Global::settings.underground)) {
+		std::cerr << "-views and -variants don't work with -split, -stream or -cave, rendering one image\n";
+		viewOrientations.clear();
+		viewNights.clear();
+	}
+	if (Global::settings.skylight && std::count(viewNights.begin(), viewNights.end(), true) != 0 && std::count(viewNights.begin(), viewNights.end(), false) != 0) {
+		// The sky light is dimmed for the night while loading
+		std::cerr << "-variants can't mix day and night with -skylight, rendering the usual way\n";
+		viewNights.clear();
+	}
 
 	// Load colors
 	if (colorfile.empty()) {
@@ -271,6 +600,9 @@ int main(int argc, char **argv)
 	if (!loadColors(colorfile)) {
 		return 1;
 	}
+	if (Global::settings.renderShift) {
+		draw::prepareReducedSprites();
+	}
 
 	if (filename.empty()) {
 		std::cerr << "Error: No world given. Please add the path to your world to the command line.\n";
@@ -332,21 +664,49 @@ int main(int argc, char **argv)
 	Global::TotalFromChunkZ = Global::FromChunkZ;
 	Global::TotalToChunkX = Global::ToChunkX;
 	Global::TotalToChunkZ = Global::ToChunkZ;
-	// Don't allow ridiculously small values for big maps
-	if (memlimit && memlimit < 200000000 && memlimit < Global::MapsizeX * Global::MapsizeZ * 150000) {
-		std::cerr << "Need at least " << int(float(Global::MapsizeX) * Global::MapsizeZ * .15f + 1) << " MiB of RAM to render a map of that size.\n";
-		return 1;
-	}
-
 	// Mem check
 	size_t bitmapX, bitmapY; //number of Pixels in the final image
 	uint64_t bitmapBytes = draw::calcImageSize(Global::ToChunkX - Global::FromChunkX, Global::ToChunkZ - Global::FromChunkZ, Global::MapsizeY, bitmapX, bitmapY, false);
+	// Every combination of -views and -variants, each cropped to its side of the world
+	std::vector<View> views;
+	if (!viewOrientations.empty() || !viewNights.empty()) {
+		const char* names[] = { "north", "east", "south", "west" };
+		const bool namedOrientations = !viewOrientations.empty(), namedVariants = !viewNights.empty();
+		if (viewOrientations.empty()) {
+			viewOrientations.push_back(Global::settings.orientation);
+		}
+		if (viewNights.empty()) {
+			viewNights.push_back(Global::settings.nightmode);
+		}
+		for (const Orientation orientation : viewOrientations) {
+			for (const bool night : viewNights) {
+				View view = { orientation, night, "", 0, 0, bitmapX, bitmapY };
+				if (namedOrientations) {
+					view.suffix += std::string("-") + names[orientation];
+				}
+				if (namedVariants) {
+					view.suffix += night ? "-night" : "-day";
+				}
+				if (wholeworld) {
+					int cropRight, cropBottom;
+					Global::settings.orientation = orientation;
+					terrain::calcBitmapOverdraw(view.cropLeft, cropRight, view.cropTop, cropBottom);
+					view.bitmapX -= static_cast<size_t>(draw::reducePos(view.cropLeft) + draw::reducePos(cropRight));
+					view.bitmapY -= static_cast<size_t>(draw::reducePos(view.cropTop) + draw::reducePos(cropBottom));
+				}
+				views.push_back(view);
+			}
+		}
+		// The terrain is loaded for the first view, with light if any of them is at night
+		Global::settings.orientation = views.front().orientation;
+		Global::settings.nightmode = std::count(viewNights.begin(), viewNights.end(), true) != 0;
+	}
 	// Cropping
 	int cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
 	if (wholeworld) {
 		terrain::calcBitmapOverdraw(cropLeft, cropRight, cropTop, cropBottom);
-		bitmapX -= (cropLeft + cropRight);
-		bitmapY -= (cropTop + cropBottom);
+		bitmapX -= static_cast<size_t>(draw::reducePos(cropLeft) + draw::reducePos(cropRight));
+		bitmapY -= static_cast<size_t>(draw::reducePos(cropTop) + draw::reducePos(cropBottom));
 		bitmapBytes = bitmapX * image::PNGWriter::BYTESPERPIXEL * bitmapY;
 	}
 
@@ -360,11 +720,40 @@ int main(int argc, char **argv)
 	}
 
 	bool splitImage = false; //true if we need to split the image in multiple smaller images (memlimit)
-	int numSplitsX = 0;
-	int numSplitsZ = 0;
-	if (memlimit && memlimit < bitmapBytes + terrain::calcTerrainSize(Global::ToChunkX - Global::FromChunkX, Global::ToChunkZ - Global::FromChunkZ)) {
+	bool mappedCanvas = false; //true if the image is drawn into a memory mapped file instead (-mmap)
+	bool incremental = false; //true if the map is rendered in several passes (memlimit)
+	std::vector<terrain::ChunkArea> passes;
+	std::unique_ptr<terrain::SplitPlanner> planner;
+	// What the terrain and image of a pass over that many chunks take
+	const auto areaCost = [&splitImage, &mappedCanvas, bitmapBytes](const size_t chunksX, const size_t chunksZ) {
+		size_t subBitmapX, subBitmapY;
+		uint64_t needed = terrain::calcTerrainSize(chunksX, chunksZ);
+		if (splitImage) {
+			// Parts still being written in the background keep their image until they are done
+			needed += draw::calcImageSize(chunksX, chunksZ, Global::MapsizeY, subBitmapX, subBitmapY, true) * (1 + Global::settings.pipelineDepth);
+		} else if (!mappedCanvas) {
+			needed += bitmapBytes;
+		}
+		return needed;
+	};
+	// All a pass needs, scaled by what the passes so far actually used
+	double passScale = 1.0;
+	uint64_t decodeSize = terrain::calcDecodeSize();
+	const auto passCost = [&areaCost, &passScale, &decodeSize](const size_t chunksX, const size_t chunksZ) {
+		return static_cast<uint64_t>(static_cast<double>(areaCost(chunksX, chunksZ)) * passScale) + decodeSize;
+	};
+	const uint64_t wholeTerrainBytes = terrain::calcTerrainSize(Global::ToChunkX - Global::FromChunkX, Global::ToChunkZ - Global::FromChunkZ);
+	// All views are drawn from the same terrain, so there are no passes for them
+	if (!views.empty() && memlimit && memlimit < bitmapBytes + wholeTerrainBytes) {
+		std::cerr << "-views and -variants need the whole terrain and one image in memory, raise -mem; rendering one image\n";
+		Global::settings.nightmode = views.front().night;
+		views.clear();
+	}
+	// A finished view is written while the next one is drawn, if there is room for its image
+	const bool overlapWrites = views.size() > 1 && (!memlimit || memlimit >= 2 * bitmapBytes + wholeTerrainBytes);
+	if (!Global::settings.streaming && memlimit && memlimit < bitmapBytes + wholeTerrainBytes) {
 		// If we'd need more mem than allowed, we have to render groups of chunks...
-		if (memlimit < bitmapBytes + 220 * uint64_t(1024 * 1024)) {
+		if (memlimit < bitmapBytes + MIN_PASS_MEMORY) {
 			// Warn about using incremental rendering if user didn't set limit manually
 			if (!memlimitSet && sizeof(size_t) > 4) {
 				std::cerr << " ***** PLEASE NOTE *****\n"
@@ -377,38 +766,56 @@ int main(int argc, char **argv)
 			}
 			// ...or even use disk caching
 			splitImage = true;
-		}
-		// Split up map more and more, until the mem requirements are satisfied
-		for (numSplitsX = 1, numSplitsZ = 2;;) {
-			const size_t subAreaX = ((Global::TotalToChunkX - Global::TotalFromChunkX) + (numSplitsX - 1)) / numSplitsX;
-			size_t subAreaZ = ((Global::TotalToChunkZ - Global::TotalFromChunkZ) + (numSplitsZ - 1)) / numSplitsZ;
-			size_t subBitmapX, subBitmapY;
-			if (splitImage && draw::calcImageSize(subAreaX, subAreaZ, Global::MapsizeY, subBitmapX, subBitmapY, true) + terrain::calcTerrainSize(subAreaX, subAreaZ) <= memlimit) {
-				break; // Found a suitable partitioning
-			} else if (!splitImage && bitmapBytes + terrain::calcTerrainSize(subAreaX, subAreaZ) <= memlimit) {
-				break; // Found a suitable partitioning
-			}
-			//
-			if (numSplitsZ > numSplitsX) {
-				++numSplitsX;
-			} else {
-				++numSplitsZ;
+			// A mapped canvas takes the whole image, so only the terrain has to be split
+			if (Global::settings.mappedCanvas && tilePath.empty()) {
+				splitImage = false;
+				mappedCanvas = true;
+			} else if (Global::settings.mappedCanvas) {
+				std::cerr << "-mmap doesn't work with -split yet, composing the tiles from parts\n";
 			}
 		}
+		// Split up the chunks that exist until every pass fits into the limit
+		planner = std::make_unique<terrain::SplitPlanner>(Global::TotalFromChunkX, Global::TotalFromChunkZ, Global::TotalToChunkX, Global::TotalToChunkZ);
+		terrain::scanChunkHeaders(filename, Global::TotalFromChunkX, Global::TotalFromChunkZ, Global::TotalToChunkX, Global::TotalToChunkZ, [&planner](const int x, const int z) {
+			planner->addChunk(x, z);
+		});
+		// Now that the region files are known
+		decodeSize = terrain::calcDecodeSize();
+		if (memlimit < passCost(1, 1)) {
+			std::cerr << "Need at least " << passCost(1, 1) / MIB + 1 << " MiB of RAM to render a map of that height.\n";
+			return 1;
+		}
+		passes = planner->plan(passCost, memlimit, Global::settings.orientation);
+		incremental = true;
+		std::cout << "Rendering " << planner->chunks() << " chunks in " << passes.size() << " passes\n";
 	}
 
 	// Always same random seed, as this is only used for block noise, which should give the same result for the same input every time
 	srand(1337);
 
 	if (outfile.empty()) {
-		outfile = "output.png";
+		outfile = std::string("output") + image::ImageEncoder::extension();
 	}
 
 	// open output file only if not doing the tiled output
 	//std::fstream fileHandle;
 	std::unique_ptr<image::PNGWriter> pngWriter;
-	if (tilePath.empty()) {
-		if (!splitImage) {
+	if (!views.empty()) {
+		// Each view draws into an image of its own, see drawViews
+	} else if (tilePath.empty()) {
+		if (Global::settings.streaming) {
+			pngWriter = std::make_unique<image::StreamingPNGWriter>();
+			pngWriter->reserve(bitmapX, bitmapY);
+			// Rows are scaled as they are written
+			if (scaleImage != 1.0) {
+				pngWriter->resize(scaleImage);
+			}
+		} else if (mappedCanvas) {
+			pngWriter = std::make_unique<image::MappedPNGWriter>();
+			if (!pngWriter->reserve(bitmapX, bitmapY)) {
+				return 1;
+			}
+		} else if (!splitImage) {
 			pngWriter = std::make_unique<image::PNGWriter>();
 			pngWriter->reserve(bitmapX, bitmapY);
 		} else {
@@ -431,15 +838,47 @@ int main(int argc, char **argv)
 		brightnessLookup[y] = ((100.0f / (1.0f + expf(-(1.3f * (float(y) * std::min(Global::MapsizeY, size_t(200U)) / Global::MapsizeY) / 16.0f) + 6.0f))) - 91);   // thx Donkey Kong
 	}
 
+	// Memory the passes left to render leave. With -pipeline half of it goes to the region files of the next pass,
+	// read while the current one is drawn, the rest keeps the decoded chunks for the passes after this one
+	uint64_t readAheadBudget = 0;
+	const auto shareSpareMemory = [&]() {
+		uint64_t largestPass = 0;
+		for (size_t i = gCurrentPass; i < passes.size(); ++i) {
+			largestPass = std::max(largestPass, passCost(static_cast<size_t>(passes[i].toX - passes[i].fromX), static_cast<size_t>(passes[i].toZ - passes[i].fromZ)));
+		}
+		const uint64_t spareMemory = largestPass < memlimit ? memlimit - largestPass : 0;
+		readAheadBudget = Global::settings.pipelineDepth != 0 ? spareMemory / 2 : 0;
+		terrain::setChunkCacheBudget(spareMemory - readAheadBudget);
+	};
+	if (incremental) {
+		shareSpareMemory();
+	}
+	const auto readAhead = [&]() {
+		const terrain::ChunkArea* next = peekNextArea(passes);
+		if (Global::settings.pipelineDepth != 0 && incremental && readAheadBudget != 0 && next) {
+			// Including the chunks around it, like loadTerrain will see it
+			terrain::prefetchRegions(filename, next->fromX - 1, next->fromZ - 1, next->toX + 1, next->toZ + 1, readAheadBudget);
+		}
+	};
+	// Biggest areaCost of the passes so far, their terrain stays allocated for the ones after them
+	uint64_t largestArea = 0;
+	// Time spent in the stages of all passes
+	double loadSeconds = 0, prepareSeconds = 0, drawSeconds = 0, writeSeconds = 0;
+	// The cave overlay of a -hell render, taken before the nether is uncovered. See keepCaveBand
+	terrain::TerrainVector caveBand;
+
 	// Now here's the loop rendering all the required parts of the image.
 	// All the vars previously used to define bounds will be set on each loop,
 	// to create something like a virtual window inside the map.
 	for (;;) {
+		memory::startPeak();
 
 		int bitmapStartX = 3, bitmapStartY = 5;
-		if (numSplitsX) { // virtual window is set here
-			// Set current chunk bounds according to number of splits. returns true if everything has been rendered already
-			if (prepareNextArea(numSplitsX, numSplitsZ, bitmapStartX, bitmapStartY)) {
+		// Offset of the blocks inside a partial image
+		int partOffsetX = -2, partOffsetY = 0;
+		if (incremental) { // virtual window is set here
+			// Set current chunk bounds to the next pass. returns true if everything has been rendered already
+			if (prepareNextArea(passes, bitmapStartX, bitmapStartY)) {
 				break;
 			}
 			// if image is split up, prepare memory block for next part
@@ -450,13 +889,23 @@ int main(int argc, char **argv)
 				if (sizex <= 0 || sizey <= 0) continue; // Don't know if this is right, might also be that the size calulation is plain wrong
 
 				image::CachedPNGWriter* cpngw = dynamic_cast<image::CachedPNGWriter*>(pngWriter.get());
-				const auto ret = cpngw->addPart(bitmapStartX - cropLeft, bitmapStartY - cropTop, sizex, sizey);
+				// With a reduced resolution the part has to start on a reduced pixel, the remainder moves into the part
+				const int partX = draw::reducePos(bitmapStartX - cropLeft);
+				const int partY = draw::reducePos(bitmapStartY - cropTop);
+				partOffsetX += (bitmapStartX - cropLeft) - (partX << Global::settings.renderShift);
+				partOffsetY += (bitmapStartY - cropTop) - (partY << Global::settings.renderShift);
+				const auto ret = cpngw->addPart(partX, partY,
+					static_cast<int>(draw::reduceSize(static_cast<size_t>(sizex + partOffsetX + 2))),
+					static_cast<int>(draw::reduceSize(static_cast<size_t>(sizey + partOffsetY))));
 				if (ret == -1) {
 					std::cerr << "Error creating partial image to render.\n";
 					return 1;
 				} else if (ret == 1) {
 					continue;
 				}
+				// Parts reaching over the top or left edge of the image are cut there, which moves their blocks too
+				partOffsetX += std::min(partX, 0) * (1 << Global::settings.renderShift);
+				partOffsetY += std::min(partY, 0) * (1 << Global::settings.renderShift);
 			}
 		}
 
@@ -477,11 +926,22 @@ int main(int argc, char **argv)
 			Global::MapsizeZ = (Global::ToChunkX - Global::FromChunkX) * CHUNKSIZE_X;
 		}
 
+		if (Global::settings.streaming) {
+			const auto streamStart = std::chrono::steady_clock::now();
+			if (!drawStreaming(filename, outfile, brightnessLookup, bitmapStartX - cropLeft, bitmapStartY - cropTop, dynamic_cast<image::StreamingPNGWriter*>(pngWriter.get()))) {
+				return 1;
+			}
+			std::cout << "Streaming took " << secondsSince(streamStart) << "s\n";
+			break;
+		}
+
 		// Load world or part of world
-		if (numSplitsX == 0 && wholeworld && !terrain::loadEntireTerrain()) {
+		auto stageStart = std::chrono::steady_clock::now();
+		double passLoad = 0, passPrepare = 0, passDraw = 0, passWrite = 0;
+		if (!incremental && wholeworld && !terrain::loadEntireTerrain()) {
 			std::cerr << "Error loading terrain from '" << filename << "'\n";
 			return 1;
-		} else if (numSplitsX != 0 || !wholeworld) {
+		} else if (incremental || !wholeworld) {
 			int numberOfChunks;
 			const bool result = terrain::loadTerrain(filename, numberOfChunks);
 
@@ -489,149 +949,122 @@ int main(int argc, char **argv)
 				std::cout << "Section is empty, skipping...\n";
 				image::CachedPNGWriter* cpngw = dynamic_cast<image::CachedPNGWriter*>(pngWriter.get());
 				cpngw->discardPart();
+				readAhead();
 				continue;
-			} else if (numberOfChunks == 0 && numSplitsX != 0) {
+			} else if (numberOfChunks == 0 && incremental) {
 				std::cout << "Section is empty, skipping...\n";
+				readAhead();
 				continue;
 			} else if (!result) {
 				std::cerr << "Could not load Section\n";
 			}
 		}
+		passLoad += secondsSince(stageStart);
+		const bool blendCaves = Global::settings.blendUnderground && !Global::settings.underground;
+		readAhead();
+		stageStart = std::chrono::steady_clock::now();
 
 		if (Global::settings.hell || Global::settings.serverHell) {
+			if (blendCaves) {
+				keepCaveBand(caveBand);
+			}
 			terrain::uncoverNether();
 		}
 
 		// If underground mode, remove blocks that don't seem to belong to caves
 		if (Global::settings.underground) {
-			undergroundMode(false);
+			undergroundMode();
+		}
+
+		if (!views.empty()) {
+			std::cout << "Loading took " << passLoad << "s\n";
+			if (!drawViews(views, outfile, brightnessLookup, caveBand, bitmapStartX, bitmapStartY, scaleImage, overlapWrites)) {
+				return 1;
+			}
+			break;
 		}
 
 		optimizeTerrain();
+		passPrepare += secondsSince(stageStart);
+		stageStart = std::chrono::steady_clock::now();
 
 		// Finally, render terrain to file
-		std::cout << "Drawing map...\n";
-		for (size_t x = CHUNKSIZE_X; x < Global::MapsizeX - CHUNKSIZE_X; ++x) { //iterate over all blocks, ignore outer Chunks
-			helper::printProgress(x - CHUNKSIZE_X, Global::MapsizeX);
-			for (size_t z = CHUNKSIZE_Z; z < Global::MapsizeZ - CHUNKSIZE_Z; ++z) {
-				const int bmpPosX = int((Global::MapsizeZ - z - CHUNKSIZE_Z) * 2 + (x - CHUNKSIZE_X) * 2 + (splitImage ? -2 : bitmapStartX - cropLeft));
-				int bmpPosY = int(Global::MapsizeY * Global::OffsetY + z + x - CHUNKSIZE_Z - CHUNKSIZE_X + (splitImage ? 0 : bitmapStartY - cropTop)) + 2 - (HEIGHTAT(x, z) & 0xFF) * Global::OffsetY;
-				const unsigned int max = (HEIGHTAT(x, z) & 0xFF00) >> 8;
-				for (unsigned int y = int8_t(HEIGHTAT(x, z)); y < max; ++y) {
-					bmpPosY -= Global::OffsetY;
-					const StateID_t c = BLOCKAT(x, y, z);
-					if (c == AIR) {
-						continue;
-					}
-
-					//float col = float(y) * .78f - 91;
-					float brightnessAdjustment = brightnessLookup[y];
-					if (Global::settings.blendUnderground) {
-						brightnessAdjustment -= 168;
-					}
-					// we use light if...
-					if (Global::settings.nightmode // nightmode is active, or
-						|| (Global::settings.skylight // skylight is used and
-							&& (!BLOCK_AT_MAPEDGE(x, z))  // block is not edge of map (or if it is, has non-opaque block above)
-							)) {
-						int l = GETLIGHTAT(x, y, z);  // find out how much light hits that block
-						if (l == 0 && y + 1 == Global::MapsizeY) {
-							l = (Global::settings.nightmode ? 3 : 15);   // quickfix: assume maximum strength at highest level
-						} else {
-							const bool up = y + 1 < Global::MapsizeY;
-							if (x + 1 < Global::MapsizeX && (!up || BLOCKAT(x + 1, y + 1, z) == 0)) {
-								l = std::max(l, GETLIGHTAT(x + 1, y, z));
-								if (x + 2 < Global::MapsizeX) l = std::max(l, GETLIGHTAT(x + 2, y, z) - 1);
-							}
-							if (z + 1 < Global::MapsizeZ && (!up || BLOCKAT(x, y + 1, z + 1) == 0)) {
-								l = std::max(l, GETLIGHTAT(x, y, z + 1));
-								if (z + 2 < Global::MapsizeZ) l = std::max(l, GETLIGHTAT(x, y, z + 2) - 1);
-							}
-							if (up) l = std::max(l, GETLIGHTAT(x, y + 1, z));
-							//if (y + 2 < Global::MapsizeY) l = MAX(l, GETLIGHTAT(x, y + 2, z) - 1);
-						}
-						if (!Global::settings.skylight) { // Night
-							brightnessAdjustment -= static_cast<float>(100 - l * 8);
-						} else { // Day
-							brightnessAdjustment -= static_cast<float>(210 - l * 14);
-						}
-					}
-
-					// Edge detection (this means where terrain goes 'down' and the side of the block is not visible)
-					if (y != 0) {
-						const StateID_t b = BLOCKAT(x - 1, y - 1, z - 1);
-						if ((y + 1 < Global::MapsizeY)  // In bounds?
-							&& BLOCKAT(x, y + 1, z) == AIR  // Only if block above is air
-							&& BLOCKAT(x - 1, y + 1, z - 1) == AIR  // and block above and behind is air
-							&& (b == AIR || b == c)   // block behind (from pov) this one is same type or air
-							&& (BLOCKAT(x - 1, y, z) == AIR || BLOCKAT(x, y, z - 1) == AIR)) {   // block TL/TR from this one is air = edge
-							brightnessAdjustment += 13;
-						}
-					}
-
-					draw::setPixel(bmpPosX, bmpPosY, c, brightnessAdjustment, pngWriter.get());
-				}
-			}
-		}
-		helper::printProgress(10, 10);
+		drawTerrain(brightnessLookup, splitImage ? partOffsetX : bitmapStartX - cropLeft, splitImage ? partOffsetY : bitmapStartY - cropTop, pngWriter.get());
+		passDraw += secondsSince(stageStart);
 		// Bitmap creation complete
 		// unless using....
 		// Underground overlay mode
-		if (Global::settings.blendUnderground && !Global::settings.underground) {
-			// Load map data again, since block culling removed most of the blocks
-			if (numSplitsX == 0 && wholeworld && !terrain::loadEntireTerrain()) {
-				std::cerr << "Error loading terrain from '" << filename << "'\n";
-				return 1;
-			} else if (numSplitsX != 0 || !wholeworld) {
-				int i;
-				if (!terrain::loadTerrain(filename, i)) {
-					std::cerr << "Error loading terrain from '" << filename << "'\n";
-					return 1;
-				}
-			}
-
-			undergroundMode(true);
-			optimizeTerrain();
-
-			std::cout << "Creating cave overlay...\n";
-			for (size_t x = CHUNKSIZE_X; x < Global::MapsizeX - CHUNKSIZE_X; ++x) {
-				helper::printProgress(x - CHUNKSIZE_X, Global::MapsizeX);
-				for (size_t z = CHUNKSIZE_Z; z < Global::MapsizeZ - CHUNKSIZE_Z; ++z) {
-					const int bmpPosX = (static_cast<int>(Global::MapsizeZ) - static_cast<int>(z) - CHUNKSIZE_Z) * 2 + (static_cast<int>(x) - CHUNKSIZE_X) * 2 + (splitImage ? -2 : bitmapStartX) - cropLeft;
-					int bmpPosY = static_cast<int>(Global::MapsizeY) * Global::OffsetY + static_cast<int>(z) + static_cast<int>(x) - CHUNKSIZE_Z - CHUNKSIZE_X + (splitImage ? 0 : bitmapStartY) - cropTop;
-					for (unsigned int y = 0; y < std::min(Global::MapsizeY, size_t(64U)); ++y) {
-						const StateID_t c = BLOCKAT(x, y, z);
-						if (c != AIR) { // If block is not air (colors[c][3] != 0)
-							draw::blendPixel(bmpPosX, bmpPosY, c, float(y + 30) * .0048f, pngWriter.get());
-						}
-						bmpPosY -= Global::OffsetY;
-					}
-				}
-			}
-			helper::printProgress(10, 10);
+		if (blendCaves) {
+			// Occlusion only set the height map, so the blocks are all still there
+			stageStart = std::chrono::steady_clock::now();
+			drawCaveOverlay(caveBand, (splitImage ? partOffsetX : bitmapStartX) - cropLeft, (splitImage ? partOffsetY : bitmapStartY) - cropTop, pngWriter.get());
+			passDraw += secondsSince(stageStart);
 		} // End blend-underground
 		// If disk caching is used, save part to disk
 		if (splitImage) {
-			if (tilePath.empty() && scaleImage != 1.0) {
-				terrain::deallocateTerrain();
-				pngWriter->resize(scaleImage);
-			}
-
+			stageStart = std::chrono::steady_clock::now();
 			if (!pngWriter->write("")) {
 				std::cerr << "Error saving partially rendered image.\n";
 				return 1;
 			}
+			passWrite = secondsSince(stageStart);
+		}
+		if (incremental) {
+			std::cout << "Pass stages: load " << passLoad << "s, prepare " << passPrepare << "s, draw " << passDraw << "s, write " << passWrite << "s\n";
+			// Plan the passes left with what this one really used, if that was more than expected
+			largestArea = std::max(largestArea, areaCost(static_cast<size_t>(Global::ToChunkX - Global::FromChunkX - 2), static_cast<size_t>(Global::ToChunkZ - Global::FromChunkZ - 2)));
+			const uint64_t planned = static_cast<uint64_t>(static_cast<double>(largestArea) * passScale) + decodeSize;
+			const uint64_t used = memory::workingPeak();
+			std::cout << "Pass memory: " << used / MIB << " MiB used, " << planned / MIB << " MiB planned\n";
+			if (used > planned && gCurrentPass < passes.size()) {
+				const uint64_t decodeUsed = memory::peak(memory::MEM_DECODE);
+				decodeSize = std::max(decodeSize, decodeUsed);
+				passScale = std::max(passScale, static_cast<double>(used - std::min(used, decodeUsed)) / static_cast<double>(largestArea));
+				const std::vector<terrain::ChunkArea> left(passes.begin() + static_cast<std::ptrdiff_t>(gCurrentPass), passes.end());
+				passes.resize(gCurrentPass);
+				const auto replanned = planner->replan(left);
+				passes.insert(passes.end(), replanned.begin(), replanned.end());
+				std::cout << "Pass needed more memory than planned, the " << left.size() << " passes left are now " << replanned.size() << '\n';
+				// The terrain of this pass would stay as big otherwise
+				terrain::releaseTerrain();
+				largestArea = 0;
+				shareSpareMemory();
+			}
 		}
+		loadSeconds += passLoad;
+		prepareSeconds += passPrepare;
+		drawSeconds += passDraw;
+		writeSeconds += passWrite;
 		// No incremental rendering at all, so quit the loop
-		if (numSplitsX == 0) {
+		if (!incremental) {
 			break;
 		}
 	}
 	// Drawing complete, now either just save the image or compose it if disk caching was used
 	terrain::deallocateTerrain();
+	if (incremental) {
+		std::cout << "Render stages: load " << loadSeconds << "s, prepare " << prepareSeconds << "s, draw " << drawSeconds << "s, write " << writeSeconds << 's';
+		if (splitImage && Global::settings.pipelineDepth != 0) {
+			// The parts are written while the next ones are drawn, the write stage above is only the time spent waiting
+			image::CachedPNGWriter* cpngw = dynamic_cast<image::CachedPNGWriter*>(pngWriter.get());
+			if (!cpngw->finishParts()) {
+				return 1;
+			}
+			std::cout << " (" << cpngw->writeSeconds() << "s in the background, " << cpngw->stallSeconds() << "s waited for)";
+		}
+		std::cout << '\n';
+		if (Global::settings.pipelineDepth != 0) {
+			terrain::printPrefetchStats();
+		}
+		terrain::printChunkCacheStats();
+	} else if (!Global::settings.streaming && views.empty()) {
+		std::cout << "Render stages: load " << loadSeconds << "s, prepare " << prepareSeconds << "s, draw " << drawSeconds << "s\n";
+	}
 	// Saving
-	if (!splitImage) {
-		if (tilePath.empty() && scaleImage != 1.0) {
+	if (!views.empty()) {
+		// drawViews wrote them already
+	} else if (!splitImage) {
+		if (tilePath.empty() && scaleImage != 1.0 && !Global::settings.streaming) {
 			pngWriter->resize(scaleImage);
 		}
 
@@ -646,10 +1079,141 @@ int main(int argc, char **argv)
 		}
 	}
 
+	memory::printReport(memlimit);
 	std::cout << "Job complete.\n";
 	return 0;
 }
 
+void drawTerrain(const std::vector<float>& brightnessLookup, const int offsetX, const int offsetY, image::PNGWriter* pngWriter)
+{
+	std::cout << "Drawing map...\n";
+	const auto drawDenseColumn = [&](const size_t x, const size_t z) {
+		drawColumn(DenseTerrain(), brightnessLookup, x, z, HEIGHTAT(x, z), offsetX, offsetY, pngWriter);
+	};
+	if (Global::settings.terrainLayout == LAYOUT_BRICKS) {
+		// Brick by brick, so the columns and their neighbours stay in cache. Diagonals of bricks from the back
+		// paint the columns in the same order as going x by x does, see drawStreaming
+		const size_t bricksX = Global::MapsizeX / CHUNKSIZE_X, bricksZ = Global::MapsizeZ / CHUNKSIZE_Z;
+		for (size_t diagonal = 2; diagonal + 3 < bricksX + bricksZ; ++diagonal) { // ignore outer Chunks
+			helper::printProgress(diagonal - 2, bricksX + bricksZ - 5);
+			const size_t fromX = diagonal + 2 > bricksZ ? diagonal + 2 - bricksZ : 1;
+			const size_t toX = std::min(diagonal, bricksX - 1);
+			for (size_t brickX = fromX; brickX < toX; ++brickX) {
+				const size_t brickZ = diagonal - brickX;
+				for (size_t x = brickX * CHUNKSIZE_X; x < (brickX + 1) * CHUNKSIZE_X; ++x) {
+					for (size_t z = brickZ * CHUNKSIZE_Z; z < (brickZ + 1) * CHUNKSIZE_Z; ++z) {
+						drawDenseColumn(x, z);
+					}
+				}
+			}
+		}
+	} else {
+		for (size_t x = CHUNKSIZE_X; x < Global::MapsizeX - CHUNKSIZE_X; ++x) { //iterate over all blocks, ignore outer Chunks
+			helper::printProgress(x - CHUNKSIZE_X, Global::MapsizeX);
+			for (size_t z = CHUNKSIZE_Z; z < Global::MapsizeZ - CHUNKSIZE_Z; ++z) {
+				drawDenseColumn(x, z);
+			}
+		}
+	}
+	helper::printProgress(10, 10);
+}
+
+void keepCaveBand(terrain::TerrainVector& caveBand)
+{
+	// Numbered like the columns of the terrain, so it reads the same in every orientation
+	const size_t height = std::min(Global::MapsizeY, size_t(CAVE_OVERLAY_HEIGHT));
+	caveBand.resize(Global::MapsizeX * Global::MapsizeZ * height);
+	for (size_t x = CHUNKSIZE_X; x < Global::MapsizeX - CHUNKSIZE_X; ++x) {
+		for (size_t z = CHUNKSIZE_Z; z < Global::MapsizeZ - CHUNKSIZE_Z; ++z) {
+			std::copy_n(&BLOCKAT(x, 0, z), height, &caveBand[COLUMNAT(x, z) * height]);
+		}
+	}
+}
+
+void drawCaveOverlay(const terrain::TerrainVector& caveBand, const int offsetX, const int offsetY, image::PNGWriter* pngWriter)
+{
+	std::cout << "Creating cave overlay...\n";
+	const size_t height = std::min(Global::MapsizeY, size_t(CAVE_OVERLAY_HEIGHT));
+	for (size_t x = CHUNKSIZE_X; x < Global::MapsizeX - CHUNKSIZE_X; ++x) {
+		helper::printProgress(x - CHUNKSIZE_X, Global::MapsizeX);
+		for (size_t z = CHUNKSIZE_Z; z < Global::MapsizeZ - CHUNKSIZE_Z; ++z) {
+			const int bmpPosX = (static_cast<int>(Global::MapsizeZ) - static_cast<int>(z) - CHUNKSIZE_Z) * 2 + (static_cast<int>(x) - CHUNKSIZE_X) * 2 + offsetX;
+			int bmpPosY = static_cast<int>(Global::MapsizeY) * Global::OffsetY + static_cast<int>(z) + static_cast<int>(x) - CHUNKSIZE_Z - CHUNKSIZE_X + offsetY;
+			const StateID_t* column = caveBand.empty() ? &BLOCKAT(x, 0, z) : &caveBand[COLUMNAT(x, z) * height];
+			for (unsigned int y = 0; y < height; ++y) {
+				const StateID_t c = column[y];
+				// Torches are left out, the top layer keeps them
+				if (c != AIR && (y + 1 == height || !helper::isTorch(c))) {
+					draw::blendPixel(bmpPosX, bmpPosY, c, float(y + 30) * .0048f, pngWriter);
+				}
+				bmpPosY -= Global::OffsetY;
+			}
+		}
+	}
+	helper::printProgress(10, 10);
+}
+
+bool drawViews(const std::vector<View>& views, const std::string& outfile, const std::vector<float>& brightnessLookup, const terrain::TerrainVector& caveBand, const int offsetX, const int offsetY, const double scaleImage, const bool overlapWrites)
+{
+	const auto writeView = [scaleImage](std::unique_ptr<image::PNGWriter> pngWriter, const std::string& file) {
+		if (scaleImage != 1.0) {
+			pngWriter->resize(scaleImage);
+		}
+		return pngWriter->write(file);
+	};
+	std::cout << "Rendering " << views.size() << " views from one load of the terrain\n";
+	// The view before this one, while it is still being written
+	std::future<bool> writing;
+	const View* optimizedFor = nullptr;
+	for (const View& view : views) {
+		const std::string file = viewFile(outfile, view.suffix);
+		std::cout << "Rendering view " << file << '\n';
+		// Occlusion only sets the height map, the blocks stay, so the terrain just has to be looked at from the other side.
+		// Day and night of one side share the height map
+		auto stageStart = std::chrono::steady_clock::now();
+		Global::settings.orientation = view.orientation;
+		Global::settings.nightmode = view.night;
+		if (!optimizedFor || optimizedFor->orientation != view.orientation) {
+			terrain::orientTerrain(view.orientation);
+			optimizeTerrain();
+			optimizedFor = &view;
+		}
+		const double prepareSeconds = secondsSince(stageStart);
+
+		stageStart = std::chrono::steady_clock::now();
+		auto pngWriter = std::make_unique<image::PNGWriter>();
+		pngWriter->reserve(view.bitmapX, view.bitmapY);
+		// Same noise as rendering this view alone
+		srand(1337);
+		drawTerrain(brightnessLookup, offsetX - view.cropLeft, offsetY - view.cropTop, pngWriter.get());
+		if (Global::settings.blendUnderground) {
+			drawCaveOverlay(caveBand, offsetX - view.cropLeft, offsetY - view.cropTop, pngWriter.get());
+		}
+		std::cout << "View stages: prepare " << prepareSeconds << "s, draw " << secondsSince(stageStart) << "s\n";
+
+		if (writing.valid() && !writing.get()) {
+			return false;
+		}
+		if (overlapWrites) {
+			writing = std::async(std::launch::async, writeView, std::move(pngWriter), file);
+		} else if (!writeView(std::move(pngWriter), file)) {
+			return false;
+		}
+	}
+	return !writing.valid() || writing.get();
+}
+
+std::string viewFile(const std::string& file, const std::string& suffix)
+{
+	// Before the extension, if the name has one
+	const size_t dot = file.find_last_of('.');
+	const size_t slash = file.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return file + suffix;
+	}
+	return file.substr(0, dot) + suffix + file.substr(dot);
+}
+
 void optimizeTerrain()
 {
 	std::cout << "Optimizing terrain...\n";
@@ -768,119 +1332,174 @@ size_t optimizeTerrainMulti(const size_t startX, const size_t startZ)
 
 }
 
-void undergroundMode(bool explore)
+/*
+ optimizeTerrainMulti for the columns of one chunk of a -stream render, the rays only start STREAM_LOOKAHEAD blocks
+ in front of the chunk. Blocks that are hidden by ones further away are drawn anyway, and painted over later.
+*/
+size_t optimizeChunk(const terrain::ChunkWindow& window, const size_t chunkX, const size_t chunkZ)
 {
-	// This wipes out all blocks that are not caves/tunnels
-	//int cnt[256];
-	//memset(cnt, 0, sizeof(cnt));
-	std::cout << "Exploring underground...\n";
-	if (explore) {
-		terrain::clearLightmap();
-		for (size_t x = CHUNKSIZE_X; x < Global::MapsizeX - CHUNKSIZE_X; ++x) {
-			helper::printProgress(x - CHUNKSIZE_X, Global::MapsizeX);
-			for (size_t z = CHUNKSIZE_Z; z < Global::MapsizeZ - CHUNKSIZE_Z; ++z) {
-				for (size_t y = 0; y < std::min(Global::MapsizeY, size_t(64U)) - 1; y++) {
-					if (helper::isTorch(BLOCKAT(x, y, z))) {
-						// Torch
-						BLOCKAT(x, y, z) = AIR;
-						for (int ty = int(y) - 9; ty < int(y) + 9; ty += 2) { // The trick here is to only take into account
-							if (ty < 0) {
-								continue;   // areas around torches.
-							}
-							if (ty >= int(Global::MapsizeY) - 1) {
-								break;
-							}
-							for (int tz = int(z) - 18; tz < int(z) + 18; ++tz) {
-								if (tz < CHUNKSIZE_Z) {
-									continue;
-								}
-								if (tz >= int(Global::MapsizeZ) - CHUNKSIZE_Z) {
-									break;
-								}
-								for (int tx = int(x) - 18; tx < int(x) + 18; ++tx) {
-									if (tx < CHUNKSIZE_X) {
-										continue;
-									}
-									if (tx >= int(Global::MapsizeX) - CHUNKSIZE_X) {
-										break;
-									}
-									SETLIGHTNORTH(tx, ty, tz) = 0xFF;
-								}
-							}
-						}
-						// /
+	terrain::ChunkSlot* slot = window.slot(chunkX, chunkZ);
+	const size_t fromX = chunkX * CHUNKSIZE_X, fromZ = chunkZ * CHUNKSIZE_Z;
+	// Last columns that are drawn, like the rays of optimizeTerrain start there
+	const size_t lastX = Global::MapsizeX - CHUNKSIZE_X - 1, lastZ = Global::MapsizeZ - CHUNKSIZE_Z - 1;
+	size_t removedBlocks{ 0 };
+	std::vector<bool> blocked(Global::MapsizeY);
+
+	for (int line = 1 - CHUNKSIZE_Z; line < CHUNKSIZE_X; ++line) { // x - z inside the chunk
+		// Front column of the line in the chunk
+		size_t x = fromX + static_cast<size_t>(line >= 0 ? CHUNKSIZE_X - 1 : CHUNKSIZE_X - 1 + line);
+		size_t z = fromZ + static_cast<size_t>(line >= 0 ? CHUNKSIZE_Z - 1 - line : CHUNKSIZE_Z - 1);
+		const size_t ahead = std::min({ STREAM_LOOKAHEAD, lastX - x, lastZ - z });
+		x += ahead;
+		z += ahead;
+		std::fill(blocked.begin(), blocked.end(), false);
+		size_t numMoves{ 0 };
+
+		while (x >= fromX && z >= fromZ) {
+			const StateID_t* column = window.column(x, z);
+			const bool inChunk = (x < fromX + CHUNKSIZE_X && z < fromZ + CHUNKSIZE_Z);
+			size_t highest = 0, lowest = 0xFF;
+			for (size_t y = 0; column && y < Global::MapsizeY; ++y) { // Go up
+				const StateID_t block = column[y];
+				if (!blocked[(y + numMoves) % Global::MapsizeY]) {
+					if (block != AIR && lowest == 0xFF) { // if it's not air, this is the lowest block to draw
+						lowest = y;
 					}
+					if (Global::colorMap[block].isSolidBlock) {
+						blocked[(y + numMoves) % Global::MapsizeY] = true;
+					}
+					if (block != AIR) highest = y;
+				} else if (inChunk && block != AIR) {
+					++removedBlocks;
 				}
 			}
+			if (inChunk) {
+				slot->heights[(z - fromZ) + (x - fromX) * CHUNKSIZE_Z] = ((static_cast<uint16_t>(highest & 0xff) + 1) << 8) | static_cast<uint16_t>(lowest & 0xff);
+			}
+			blocked[numMoves % Global::MapsizeY] = false;
+			numMoves += 1;
+			x -= 1;
+			z -= 1;
 		}
 	}
-	for (size_t x = 0; x < Global::MapsizeX; ++x) {
-		helper::printProgress(x + Global::MapsizeX * (explore ? 1 : 0), Global::MapsizeX * (explore ? 2 : 1));
-		for (size_t z = 0; z < Global::MapsizeZ; ++z) {
-			size_t ground = 0;
-			size_t cave = 0;
-			for (int y = static_cast<int>(Global::MapsizeY) - 1; y >= 0; --y) {
-				StateID_t c = BLOCKAT(x, y, z);
-				if (c != AIR && cave > 0) { // Found a cave, leave floor
-					if (helper::isGrass(c) || helper::isLeave(c) || helper::isSnow(c) || GETLIGHTAT(x, y, z) == 0) {
-						c = AIR; // But never count snow or leaves
-					} //else cnt[*c]++;
-					if (!helper::isWater(c)) {
-						--cave;
-					}
-				} else if (c != AIR) { // Block is not air, count up "ground"
-					c = AIR;
-					if (/*c != LOG &&*/ !helper::isLeave(c) && !helper::isSnow(c) && /*c != WOOD &&*/ !helper::isWater(c)) {
-						++ground;
-					}
-				} else if (ground < 3) { // Block is air, if there was not enough ground above, don't treat that as a cave
-					ground = 0;
-				} else { // Thats a cave, draw next two blocks below it
-					cave = 2;
+	return removedBlocks;
+}
+
+/*
+ -stream: draws the whole area in one go, but only keeps a few diagonals of chunks and the rows of the image they
+ reach. The blocks of a column only overlap columns with x - z one apart, so drawing the diagonals from the back and
+ the chunks of each one x by x paints them in the same order the loop over the whole terrain does, except for the
+ random noise. Once a diagonal is drawn, nothing that comes later reaches the rows above its front, those are written.
+*/
+bool drawStreaming(const std::string& fromPath, const std::string& outfile, const std::vector<float>& brightnessLookup, const int offsetX, const int offsetY, image::StreamingPNGWriter* pngWriter)
+{
+	terrain::ChunkWindow window(fromPath);
+	// The blocks of a diagonal reach from its back to the height of the map above its front
+	if (!pngWriter->begin(outfile, draw::reduceSize(Global::MapsizeY * static_cast<size_t>(Global::OffsetY) + (CHUNKSIZE_X + CHUNKSIZE_Z) * 2) + 2)) {
+		return false;
+	}
+	const size_t diagonals = window.diagonals();
+	size_t loaded = 0, removedBlocks = 0;
+	std::cout << "Drawing map in " << diagonals << " diagonals...\n";
+	for (size_t diagonal = 0; diagonal < diagonals; ++diagonal) {
+		helper::printProgress(diagonal, diagonals);
+		// Light needs the diagonal in front of this one, the occlusion the two in front
+		for (; loaded < std::min(diagonal + 3, diagonals); ++loaded) {
+			window.load(loaded);
+		}
+		// Chunks around the area are only there for light and edges
+		const size_t fromX = diagonal + 2 > window.chunksZ() ? diagonal + 2 - window.chunksZ() : 1;
+		const size_t toX = std::min(diagonal, window.chunksX() - 1);
+		for (size_t chunkX = fromX; chunkX < toX; ++chunkX) {
+			const size_t chunkZ = diagonal - chunkX;
+			if (!window.slot(chunkX, chunkZ)) {
+				continue;
+			}
+			removedBlocks += optimizeChunk(window, chunkX, chunkZ);
+			const auto& heights = window.slot(chunkX, chunkZ)->heights;
+			for (size_t x = chunkX * CHUNKSIZE_X; x < (chunkX + 1) * CHUNKSIZE_X; ++x) {
+				for (size_t z = chunkZ * CHUNKSIZE_Z; z < (chunkZ + 1) * CHUNKSIZE_Z; ++z) {
+					drawColumn(window, brightnessLookup, x, z, heights[(z % CHUNKSIZE_Z) + (x % CHUNKSIZE_X) * CHUNKSIZE_Z], offsetX, offsetY, pngWriter);
 				}
 			}
 		}
+		// Blocks of later diagonals start at x + z = (diagonal + 1) * 16, on the row their top is drawn at
+		const int done = int((diagonal + 1) * CHUNKSIZE_X) - CHUNKSIZE_Z - CHUNKSIZE_X + offsetY + 2;
+		if (done > 0 && !pngWriter->flushRows(static_cast<size_t>(draw::reducePos(done)))) {
+			return false;
+		}
+		// Edge detection looks at x - 1 and z - 1, that can be two diagonals back
+		if (diagonal > 1) {
+			window.drop(diagonal - 2);
+		}
 	}
 	helper::printProgress(10, 10);
+	std::cout << "Drew " << window.loadedChunks() << " chunks, removed " << removedBlocks << " hidden blocks\n";
+	return true;
 }
 
-bool prepareNextArea(int splitX, int splitZ, int &bitmapStartX, int &bitmapStartY)
+void undergroundMode()
+{
+	// This wipes out all blocks that are not caves/tunnels
+	//int cnt[256];
+	//memset(cnt, 0, sizeof(cnt));
+	std::cout << "Exploring underground...\n";
+	terrain::runColumnPass("Finding caves", 0, Global::MapsizeX, [](const size_t fromX, const size_t toX) {
+		size_t removed = 0;
+		for (size_t x = fromX; x < toX; ++x) {
+			for (size_t z = 0; z < Global::MapsizeZ; ++z) {
+				size_t ground = 0;
+				size_t cave = 0;
+				for (int y = static_cast<int>(Global::MapsizeY) - 1; y >= 0; --y) {
+					StateID_t& c = BLOCKAT(x, y, z);
+					if (c != AIR && cave > 0) { // Found a cave, leave floor
+						if (!helper::isWater(c)) {
+							--cave;
+						}
+						if (helper::isGrass(c) || helper::isLeave(c) || helper::isSnow(c) || GETLIGHTAT(x, y, z) == 0) {
+							c = AIR; // But never count snow or leaves
+							++removed;
+						} //else cnt[*c]++;
+					} else if (c != AIR) { // Block is not air, count up "ground"
+						if (/*c != LOG &&*/ !helper::isLeave(c) && !helper::isSnow(c) && /*c != WOOD &&*/ !helper::isWater(c)) {
+							++ground;
+						}
+						c = AIR;
+						++removed;
+					} else if (ground < 3) { // Block is air, if there was not enough ground above, don't treat that as a cave
+						ground = 0;
+					} else { // Thats a cave, draw next two blocks below it
+						cave = 2;
+					}
+				}
+			}
+		}
+		return removed;
+	});
+}
+
+bool prepareNextArea(const std::vector<terrain::ChunkArea>& passes, int &bitmapStartX, int &bitmapStartY)
 {
-	static int currentAreaX = -1;
-	static int currentAreaZ = 0;
 	// move on to next part and stop if we're done
-	++currentAreaX;
-	if (currentAreaX >= splitX) {
-		currentAreaX = 0;
-		++currentAreaZ;
-	}
-	if (currentAreaZ >= splitZ) {
+	if (gCurrentPass >= passes.size()) {
 		return true;
 	}
-	// For bright map edges
+	const terrain::ChunkArea& area = passes[gCurrentPass++];
+	Global::FromChunkX = area.fromX;
+	Global::FromChunkZ = area.fromZ;
+	Global::ToChunkX = area.toX;
+	Global::ToChunkZ = area.toZ;
+	// For bright map edges, the edges of the whole area that are at the bottom of the image
+	const bool lastX = (Global::settings.orientation == North || Global::settings.orientation == West ? area.toX == Global::TotalToChunkX : area.fromX == Global::TotalFromChunkX);
+	const bool lastZ = (Global::settings.orientation == North || Global::settings.orientation == East ? area.toZ == Global::TotalToChunkZ : area.fromZ == Global::TotalFromChunkZ);
 	if (Global::settings.orientation == West || Global::settings.orientation == East) {
-		gAtBottomRight = (currentAreaZ + 1 == splitZ);
-		gAtBottomLeft = (currentAreaX + 1 == splitX);
+		gAtBottomRight = lastZ;
+		gAtBottomLeft = lastX;
 	} else {
-		gAtBottomLeft = (currentAreaZ + 1 == splitZ);
-		gAtBottomRight = (currentAreaX + 1 == splitX);
-	}
-	// Calc size of area to be rendered (in chunks)
-	const int subAreaX = ((Global::TotalToChunkX - Global::TotalFromChunkX) + (splitX - 1)) / splitX;
-	const int subAreaZ = ((Global::TotalToChunkZ - Global::TotalFromChunkZ) + (splitZ - 1)) / splitZ;
-	// Adjust values for current frame. order depends on map orientation
-	Global::FromChunkX = Global::TotalFromChunkX + subAreaX * (Global::settings.orientation == North || Global::settings.orientation == West ? currentAreaX : splitX - (currentAreaX + 1));
-	Global::FromChunkZ = Global::TotalFromChunkZ + subAreaZ * (Global::settings.orientation == North || Global::settings.orientation == East ? currentAreaZ : splitZ - (currentAreaZ + 1));
-	Global::ToChunkX = Global::FromChunkX + subAreaX;
-	Global::ToChunkZ = Global::FromChunkZ + subAreaZ;
-	// Bounds checking
-	if (Global::ToChunkX > Global::TotalToChunkX) {
-		Global::ToChunkX = Global::TotalToChunkX;
-	}
-	if (Global::ToChunkZ > Global::TotalToChunkZ) {
-		Global::ToChunkZ = Global::TotalToChunkZ;
+		gAtBottomLeft = lastZ;
+		gAtBottomRight = lastX;
 	}
-	std::cout << "Pass " << currentAreaX + (currentAreaZ * splitX) + 1 << " of " << splitX * splitZ << "...\n";
+	std::cout << "Pass " << gCurrentPass << " of " << passes.size() << " (" << area.chunks << " chunks)...\n";
 	// Calulate pixel offsets in bitmap. Forgot how this works right after writing it, really.
 	if (Global::settings.orientation == North) {
 		bitmapStartX = (((Global::TotalToChunkZ - Global::TotalFromChunkZ) * CHUNKSIZE_Z) * 2 + 3)   // Center of image..
@@ -914,6 +1533,12 @@ bool prepareNextArea(int splitX, int splitZ, int &bitmapStartX, int &bitmapStart
 	return false; // not done yet, return false
 }
 
+// Chunk area of the pass after the current one, nullptr if there is none
+const terrain::ChunkArea* peekNextArea(const std::vector<terrain::ChunkArea>& passes)
+{
+	return gCurrentPass < passes.size() ? &passes[gCurrentPass] : nullptr;
+}
+
 void writeInfoFile(const std::string& file, int xo, int yo, size_t bitmapX, size_t bitmapY)
 {
 	nlohmann::json data;
@@ -938,10 +1563,13 @@ void writeInfoFile(const std::string& file, int xo, int yo, size_t bitmapX, size
 	}
 	yo += 4;
 
-	data["origin"]["x"] = xo;
-	data["origin"]["y"] = yo;
+	data["origin"]["x"] = draw::reducePos(xo);
+	data["origin"]["y"] = draw::reducePos(yo);
 
 	data["geometry"]["scaling"] = Global::OffsetY;
+	if (Global::settings.renderShift) {
+		data["geometry"]["reduction"] = 1 << Global::settings.renderShift;
+	}
 	data["geometry"]["orientation"] = direction;
 
 	data["image"]["x"] = bitmapX;
@@ -956,6 +1584,11 @@ void writeInfoFile(const std::string& file, int xo, int yo, size_t bitmapX, size
 /**
  * Round down to the nearest multiple of 16
  */
+static double secondsSince(const std::chrono::steady_clock::time_point& start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 static inline int floorChunkX(const int val)
 {
 	return val & ~(CHUNKSIZE_X - 1);
@@ -994,12 +1627,29 @@ void printHelp(const std::string& binary)
 		<< "  -mem VAL      sets the amount of memory (in MiB) used for rendering. mcmap\n"
 		<< "                will use incremental rendering or disk caching to stick to\n"
 		<< "                this limit. Default is 1800.\n"
+		<< "  -scratch DIR  disk cached parts are kept below DIR, a fast disk or tmpfs helps;\n"
+		<< "                default is the system temp directory\n"
+		<< "  -mmap         with -mem: draw images that don't fit into memory into a memory\n"
+		<< "                mapped file below -scratch instead of composing them from parts\n"
+		<< "  -pipeline VAL with -mem: overlap the passes, up to VAL finished parts are\n"
+		<< "                written to disk while the next one is drawn and its region files\n"
+		<< "                are read ahead. Every part in flight counts against -mem\n"
+		<< "  -layout NAME  order of the terrain in memory: columns (default) goes x by x,\n"
+		<< "                bricks keeps 16x16 columns together and draws brick by brick\n"
+		<< "  -stream       draw the map from the back in diagonals of chunks and write each\n"
+		<< "                row of the image once it's done, so only a few diagonals and rows\n"
+		<< "                are in memory, whatever the size of the map. -mem is ignored\n"
 		<< "  -colors NAME  loads user defined colors from file 'NAME'\n"
 		<< "  -threads VAL  uses VAL number of threads to load and optimize the world\n"
 		<< "                uses this with a high mem limit for best performance\n"
 		<< "  -north -east -south -west\n"
 		<< "                controls which direction will point to the *top left* corner\n"
 		<< "                it only makes sense to pass one of them; East is default\n"
+		<< "  -views LIST   render several of them from one load of the world, ie: -views\n"
+		<< "                north,east,south,west writes output-north.png, output-east.png...\n"
+		<< "  -variants LIST\n"
+		<< "                same for day and night, ie: -variants day,night. Together with\n"
+		<< "                -views every view is rendered in every variant\n"
 		<< "  -blendall     always use blending mode for blocks\n"
 		<< "  -hell         render the hell/nether dimension of the given world\n"
 		<< "  -end          render the end dimension of the given world\n"
@@ -1007,7 +1657,22 @@ void printHelp(const std::string& binary)
 		<< "  -info NAME    Write information about map to file 'NAME' in JSON format\n"
 		<< "                use -infoonly to not render the world\n"
 		<< "  -split PATH   create tiled output (128x128 to 4096x4096) in given PATH\n"
+		<< "  -pyramid      with -split: write 256x256 tiles for every zoom level as z/x/y\n"
+		<< "  -dedup [M]    with -split: skip empty tiles, identical tiles are written once and\n"
+		<< "                hardlinked (M = link, default) or listed in duplicates.json (M = manifest)\n"
+		<< "  -archive      with -split: PATH is a single archive file instead of a folder\n"
+		<< "  -extract A F  write all tiles of archive A as files into folder F and exit\n"
 		<< "  -scale VAL    scales the resulting image by VAL. VAL in range 1-100\n"
+		<< "  -scalefull    with -scale: always render at full resolution and resize afterwards,\n"
+		<< "                otherwise blocks are drawn at 1/2, 1/4, ... size directly\n"
+		<< "  -scalefilter F\n"
+		<< "                filter used by -scale: bicubic (default) or area, which averages\n"
+		<< "                all covered pixels and looks better below 50%\n"
+		<< "  -format F     output format: png (default), qoi or raw (rgba with a 16 byte header)\n"
+		<< "  -palette      write 8 bit indexed png files, colors get slightly quantized\n"
+		<< "  -pngfast      use a fast single pass png encoder, files get a bit bigger\n"
+		<< "  -pnglevel VAL zlib compression level (0-9) used for png files\n"
+		<< "  -pngfilter F  png row filter: none, sub, up, avg, paeth or all (default)\n"
 		<< "  -marker c x z currently not working\n"
 		<< "\n    WORLDPATH is the path of the desired world.\n\n"
 		////////////////////////////////////////////////////////////////////////////////
@@ -9,9 +9,16 @@
 #include <cstring>
 #include <algorithm>
 #include <filesystem>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <functional>
 
 #include "ThreadPool.h"
 #include "worldloader.h"
+#include "ChunkCache.h"
+#include "ColumnPass.h"
+#include "MemoryTracker.h"
 #include "filesystem.h"
 #include "nbt.h"
 #include "colors.h"
@@ -20,15 +27,44 @@
 namespace
 {
 	static terrain::World world;
+
+	using RegionData = memory::TrackedVector<uint8_t, memory::MEM_DECODE>;
+	using RegionFiles = std::map<std::string, memory::TrackedVector<uint8_t, memory::MEM_READAHEAD>>;
+	// Region files read ahead by prefetchRegions, the ones still being read and the ones loadTerrain uses
+	std::future<RegionFiles> prefetching;
+	RegionFiles prefetched;
+	std::atomic<uint64_t> prefetchNanos{ 0 };
+	std::atomic<uint64_t> prefetchBytes{ 0 };
+	std::atomic<size_t> prefetchFiles{ 0 };
+	std::atomic<size_t> prefetchHits{ 0 };
+	// Decoded chunks shared by the passes of an incremental render, see setChunkCacheBudget
+	terrain::ChunkCache chunkCache;
+	// Biggest region file scanChunkHeaders came across, see calcDecodeSize
+	uint64_t largestRegionFile = 0;
 }
 
 namespace terrain
 {
 	size_t getPalletIndex(const std::vector<uint64_t>& arr, const size_t index, const bool denselyPacked);
-	bool loadChunk(const std::vector<uint8_t>& buffer);
-	bool load113Chunk(const NBTtag* level, const int32_t chunkX, const int32_t chunkZ, const size_t dataVersion);
+	bool decodeChunk(const std::vector<uint8_t>& buffer, const bool anyPass, DecodedChunk& chunk);
+	bool decode113Chunk(const NBTtag* level, const size_t dataVersion, DecodedChunk& chunk);
+	bool placeChunk(const DecodedChunk& chunk);
 	void allocateTerrain();
-	bool loadRegion(const std::string& file, const bool mustExist, int &loadedChunks);
+	bool loadRegion(const std::string& file, const int originX, const int originZ, const bool mustExist, int &loadedChunks);
+	// Inflates and decodes the chunks of a region file, except the ones 'known' already has, and hands them to 'decoded'
+	bool forEachChunk(const std::string& file, const int originX, const int originZ, const bool mustExist, const bool anyPass,
+		const std::function<bool(int, int)>& known, const std::function<void(const std::shared_ptr<const DecodedChunk>&)>& decoded);
+	bool usesLight();
+	size_t uncoverNetherColumn(StateID_t* top);
+	template<typename Buffer>
+	bool readRegionFile(const std::string& file, Buffer& data);
+
+	// Offset of chunk 'index' (x + z * REGIONSIZE) in its region file, 0 if it doesn't exist
+	inline uint32_t chunkOffset(const uint8_t* header, const size_t index)
+	{
+		const uint8_t* entry = header + index * 4;
+		return (helper::swap_endian<uint32_t>(entry[0] + (entry[1] << 8) + (entry[2] << 16)) >> 8) * 4096;
+	}
 	inline void lightCave(const int x, const int y, const int z);
 
 	WorldFormat getWorldFormat(const std::string& worldPath)
@@ -113,8 +149,7 @@ namespace terrain
 			}
 			// Check for existing chunks in region and update bounds
 			for (size_t i = 0; i < REGIONSIZE * REGIONSIZE; ++i) {
-				const uint32_t offset = (helper::swap_endian<uint32_t>(buffer[i] + (buffer[i + 1] << 8) + (buffer[i + 2] << 16)) >> 8) * 4096;
-				if (offset == 0) continue;
+				if (chunkOffset(buffer.data(), i) == 0) continue;
 
 				const int valX = region.x + static_cast<int>(i % REGIONSIZE);
 				const int valZ = region.z + static_cast<int>(i / REGIONSIZE);
@@ -140,26 +175,31 @@ namespace terrain
 		return true;
 	}
 
-	bool loadChunk(const std::vector<uint8_t>& buffer)
+	/*
+	 Inflated chunk -> 'chunk'. Only chunks inside the current pass are decoded, with 'anyPass' all chunks of
+	 the render are, the others end up invalid. False if the chunk is too broken to even tell its position.
+	*/
+	bool decodeChunk(const std::vector<uint8_t>& buffer, const bool anyPass, DecodedChunk& chunk)
 	{
+		chunk.valid = false;
 		if (buffer.size() == 0) { // File
 			std::cerr << "No data in NBT file.\n";
 			return false;
 		}
-		NBT chunk(buffer);
-		if (!chunk.good()) {
+		NBT nbt(buffer);
+		if (!nbt.good()) {
 			std::cerr << "Error loading chunk.\n";
 			return false; // chunk does not exist
 		}
 
-		const auto dataVersionOpt = chunk.getInt("DataVersion");
+		const auto dataVersionOpt = nbt.getInt("DataVersion");
 		if (!dataVersionOpt.has_value()) {
 			std::cerr << "No DataVersion in Chunk\n";
 			return false;
 		}
 		const size_t dataVersion = static_cast<size_t>(dataVersionOpt.value());
 
-		const auto levelOpt = chunk.getCompound("Level");
+		const auto levelOpt = nbt.getCompound("Level");
 		if (!levelOpt.has_value()) {
 			std::cerr << "No level\n";
 			return false;
@@ -172,11 +212,16 @@ namespace terrain
 			std::cerr << "No pos\n";
 			return false;
 		}
-		const int32_t chunkX = chunkXOpt.value();
-		const int32_t chunkZ = chunkZOpt.value();
+		chunk.x = chunkXOpt.value();
+		chunk.z = chunkZOpt.value();
 
 		// Check if chunk is in desired bounds (not a chunk where the filename tells a different position)
-		if (chunkX < Global::FromChunkX || chunkX >= Global::ToChunkX || chunkZ < Global::FromChunkZ || chunkZ >= Global::ToChunkZ) {
+		if (anyPass) {
+			// The chunks around the whole area are loaded by the passes at its edges
+			if (chunk.x < Global::TotalFromChunkX - 1 || chunk.x > Global::TotalToChunkX || chunk.z < Global::TotalFromChunkZ - 1 || chunk.z > Global::TotalToChunkZ) {
+				return true;
+			}
+		} else if (chunk.x < Global::FromChunkX || chunk.x >= Global::ToChunkX || chunk.z < Global::FromChunkZ || chunk.z >= Global::ToChunkZ) {
 			return false; // Nope, its not...
 		}
 
@@ -190,37 +235,35 @@ namespace terrain
 			const auto statusOpt = level->getString("Status");
 			if (!statusOpt.has_value()) {
 				std::cerr << "could not find Status in Chunk\n";
-				return false;
+				return true;
 			}
 			const std::string status = statusOpt.value();
 			//Check if we use light
 			if (Global::light.empty()) {
 				if (status != "empty") {
-					return load113Chunk(level, chunkX, chunkZ, dataVersion);
+					chunk.valid = decode113Chunk(level, dataVersion, chunk);
 				}
 			} else {
 				if (dataVersion > 1631) { //1.13.2
-					return load113Chunk(level, chunkX, chunkZ, dataVersion); //try to load them in 1.14.x 
+					chunk.valid = decode113Chunk(level, dataVersion, chunk); //try to load them in 1.14.x 
 				} else {
 					if (status >= "finalized" && status != "liquid_carved") {
-						return load113Chunk(level, chunkX, chunkZ, dataVersion);
+						chunk.valid = decode113Chunk(level, dataVersion, chunk);
 					}
 				}
 			}
-			return false;
 		} else {
 			static bool showedWarning = false;
 			if (!showedWarning) {
 				std::cerr << "found chunk in 1.12.2 or older format, this is no longer supported. Update to 1.13.2+\n";
 				showedWarning = true;
 			}
-
-			return false;
 		}
+		return true;
 	}
 
-	//Loads 1.13.2+ chunks
-	bool load113Chunk(const NBTtag* level, const int32_t chunkX, const int32_t chunkZ, const size_t dataVersion)
+	//Decodes 1.13.2+ chunks
+	bool decode113Chunk(const NBTtag* level, const size_t dataVersion, DecodedChunk& chunk)
 	{
 		const auto sectionsOpt = level->getList("Sections");
 		if (!sectionsOpt.has_value()) {
@@ -231,11 +274,6 @@ namespace terrain
 		if (sections->empty())
 			return false;
 
-		const int offsetz = (chunkZ - Global::FromChunkZ) * CHUNKSIZE_Z; //Blocks into world, from lowest point
-		const int offsetx = (chunkX - Global::FromChunkX) * CHUNKSIZE_X; //Blocks into world, from lowest point
-		const size_t yoffsetsomething = (Global::MapminY + SECTION_Y * 10000) % SECTION_Y;
-		assert(yoffsetsomething == 0); //I don't now what this variable does. Always 0
-
 		for (const auto sec : *sections) {
 			const auto yOffsetOpt = sec.getByte("Y");
 			if (!yOffsetOpt.has_value()) {
@@ -245,31 +283,30 @@ namespace terrain
 			const int32_t yo = yOffsetOpt.value();
 
 			if (yo < Global::sectionMin || yo > Global::sectionMax) continue; //sub-Chunk out of bounds, continue
-			int32_t yoffset = (SECTION_Y * (yo - Global::sectionMin)) - static_cast<int32_t>(yoffsetsomething); //Blocks into render zone in Y-Axis
-			if (yoffset < 0) yoffset = 0;
 
 			const auto blockStatesOpt = sec.getLongArray("BlockStates");
 			if (!blockStatesOpt.has_value()) {
 				continue;
 			}
+			DecodedSection section;
+			section.y = yo;
+			section.denselyPacked = dataVersion < 2529; //snapshot 20w17a = data version 2529
 			const uint64_t* beginPtr = reinterpret_cast<const uint64_t*>(blockStatesOpt.value().m_data);
-			std::vector<uint64_t> blockStates(beginPtr, beginPtr + blockStatesOpt.value().m_len);
+			section.blockStates.assign(beginPtr, beginPtr + blockStatesOpt.value().m_len);
 
-			PrimArray<uint8_t> lightdata;
 			if (Global::settings.nightmode || Global::settings.skylight) { // If nightmode, we need the light information too
 				// If there is no light in this section the byte array ist not stored
 				const auto lightdataOpt = sec.getByteArray("BlockLight");
 				if (lightdataOpt.has_value()) {
-					lightdata = lightdataOpt.value();
+					section.blockLight.assign(lightdataOpt.value().m_data, lightdataOpt.value().m_data + lightdataOpt.value().m_len);
 				}
 			}
 
-			PrimArray<uint8_t> skydata;
 			if (Global::settings.skylight) {
 				// If there is no light in this section the byte array ist not stored
 				const auto skydataOpt = sec.getByteArray("SkyLight");
 				if (skydataOpt.has_value()) {
-					skydata = skydataOpt.value();
+					section.skyLight.assign(skydataOpt.value().m_data, skydataOpt.value().m_data + skydataOpt.value().m_len);
 				}
 			}
 
@@ -279,7 +316,7 @@ namespace terrain
 			}
 			const auto palette = paletteOpt.value();
 
-			std::vector<StateID_t> idList;
+			std::vector<StateID_t>& idList = section.palette;
 			for (const auto state : *palette) {
 				const auto blockNameOpt = state.getString("Name");
 				if (!blockNameOpt.has_value()) {
@@ -329,30 +366,43 @@ namespace terrain
 				}
 				idList.push_back(blockID);
 			}
+			chunk.sections.push_back(std::move(section));
+		}
+
+		return true;
+	}
+
+	// Copies a decoded chunk into the terrain, returns whether it counts as loaded
+	bool placeChunk(const DecodedChunk& chunk)
+	{
+		const int32_t chunkX = chunk.x;
+		const int32_t chunkZ = chunk.z;
+		if (chunkX < Global::FromChunkX || chunkX >= Global::ToChunkX || chunkZ < Global::FromChunkZ || chunkZ >= Global::ToChunkZ) {
+			return false;
+		}
+
+		const int offsetz = (chunkZ - Global::FromChunkZ) * CHUNKSIZE_Z; //Blocks into world, from lowest point
+		const int offsetx = (chunkX - Global::FromChunkX) * CHUNKSIZE_X; //Blocks into world, from lowest point
+		const size_t yoffsetsomething = (Global::MapminY + SECTION_Y * 10000) % SECTION_Y;
+		assert(yoffsetsomething == 0); //I don't now what this variable does. Always 0
+
+		for (const auto& section : chunk.sections) {
+			const int32_t yo = section.y;
+			int32_t yoffset = (SECTION_Y * (yo - Global::sectionMin)) - static_cast<int32_t>(yoffsetsomething); //Blocks into render zone in Y-Axis
+			if (yoffset < 0) yoffset = 0;
+
+			const std::vector<uint64_t>& blockStates = section.blockStates;
+			const std::vector<StateID_t>& idList = section.palette;
+			const PrimArray<uint8_t> lightdata(section.blockLight.data(), section.blockLight.size());
+			const PrimArray<uint8_t> skydata(section.skyLight.data(), section.skyLight.size());
 
 			//Now IDList is build up, no run through all block in sub-Chunk
 			for (int x = 0; x < CHUNKSIZE_X; ++x) {
 				for (int z = 0; z < CHUNKSIZE_Z; ++z) {
-					StateID_t* targetBlock = nullptr;
+					const size_t worldX = static_cast<size_t>(x + offsetx), worldY = static_cast<size_t>(yoffset), worldZ = static_cast<size_t>(z + offsetz);
+					StateID_t* targetBlock = &WORLDBLOCKAT(worldX, worldY, worldZ);
 					uint8_t* lightByte = nullptr;
-
-					if (Global::settings.orientation == East) {
-						targetBlock = &BLOCKEAST(x + offsetx, yoffset, z + offsetz); //BLOCKEAST
-						if (Global::settings.skylight || Global::settings.nightmode) lightByte = &SETLIGHTEAST(x + offsetx, yoffset, z + offsetz);
-						//if (g_UseBiomes) BIOMEEAST(x + offsetx, z + offsetz) = biomesdata[x + (z * CHUNKSIZE_X)];
-					} else if (Global::settings.orientation == North) {
-						targetBlock = &BLOCKNORTH(x + offsetx, yoffset, z + offsetz);
-						if (Global::settings.skylight || Global::settings.nightmode) lightByte = &SETLIGHTNORTH(x + offsetx, yoffset, z + offsetz);
-						//if (g_UseBiomes) BIOMENORTH(x + offsetx, z + offsetz) = biomesdata[x + (z * CHUNKSIZE_X)];
-					} else if (Global::settings.orientation == South) {
-						targetBlock = &BLOCKSOUTH(x + offsetx, yoffset, z + offsetz);
-						if (Global::settings.skylight || Global::settings.nightmode) lightByte = &SETLIGHTSOUTH(x + offsetx, yoffset, z + offsetz);
-						//if (g_UseBiomes) BIOMESOUTH(x + offsetx, z + offsetz) = biomesdata[x + (z * CHUNKSIZE_X)];
-					} else {
-						targetBlock = &BLOCKWEST(x + offsetx, yoffset, z + offsetz);
-						if (Global::settings.skylight || Global::settings.nightmode) lightByte = &SETLIGHTWEST(x + offsetx, yoffset, z + offsetz);
-						//if (g_UseBiomes) BIOMEWEST(x + offsetx, z + offsetz) = biomesdata[x + (z * CHUNKSIZE_X)];
-					}
+					if (Global::settings.skylight || Global::settings.nightmode) lightByte = &WORLDLIGHTAT(worldX, worldY, worldZ);
 					//set targetBlock
 					for (size_t y = 0; y < SECTION_Y; ++y) {
 						// In bounds check
@@ -360,7 +410,7 @@ namespace terrain
 						if (Global::sectionMax == yo && y + yoffset >= Global::MapsizeY) break;
 
 						const size_t block1D = x + (z + (y * CHUNKSIZE_Z)) * CHUNKSIZE_X;
-						const size_t IDLIstIndex = getPalletIndex(blockStates, block1D, dataVersion < 2529); //snapshot 20w17a = data version 2529
+						const size_t IDLIstIndex = getPalletIndex(blockStates, block1D, section.denselyPacked);
 						const StateID_t block = idList[IDLIstIndex];
 						*targetBlock = block;
 						targetBlock++;
@@ -395,20 +445,27 @@ namespace terrain
 
 		}
 
-		return true;
+		return chunk.valid;
 	}
 
 	uint64_t calcTerrainSize(const size_t chunksX, const size_t chunksZ)
 	{
-		uint64_t size = sizeof(StateID_t) * (chunksX + 2) * CHUNKSIZE_X * (chunksZ + 2) * CHUNKSIZE_Z * (Global::MapsizeY);
+		// Same sizes allocateTerrain uses, including the chunks around the area
+		const uint64_t columns = (chunksX + 2) * CHUNKSIZE_X * (chunksZ + 2) * CHUNKSIZE_Z;
+		uint64_t size = columns * (sizeof(StateID_t) * Global::MapsizeY + sizeof(uint16_t));
 
-		if (Global::settings.nightmode || Global::settings.underground || Global::settings.blendUnderground || Global::settings.skylight) {
-			size += size / 4;
+		if (usesLight()) {
+			size += columns * ((Global::MapsizeY + (Global::MapminY % 2 == 0 ? 1 : 2)) / 2);
+		}
+		// -blendcave keeps the blocks under the nether ceiling apart, see keepCaveBand
+		if (Global::settings.blendUnderground && (Global::settings.hell || Global::settings.serverHell)) {
+			size += columns * sizeof(StateID_t) * std::min<uint64_t>(Global::MapsizeY, CAVE_OVERLAY_HEIGHT);
 		}
 
 		return size;
 	}
 
+
 	/*
 		Calculates overdraw on all 4 sites
 	*/
@@ -522,6 +579,7 @@ namespace terrain
 	{
 		const size_t heightMapSize = Global::MapsizeX * Global::MapsizeZ;
 		Global::Terrainsize = Global::MapsizeX * Global::MapsizeY * Global::MapsizeZ;
+		layoutTerrain(Global::settings.terrainLayout);
 
 		if (Global::heightMap.size() < heightMapSize) {
 			Global::heightMap.clear();
@@ -539,7 +597,7 @@ namespace terrain
 
 		std::fill_n(Global::terrain.begin(), Global::Terrainsize, static_cast<StateID_t>(0U));// Preset: Air
 
-		if (Global::settings.nightmode || Global::settings.underground || Global::settings.blendUnderground || Global::settings.skylight) {
+		if (usesLight()) {
 			const size_t lightsize = Global::MapsizeZ * Global::MapsizeX * ((Global::MapsizeY + (Global::MapminY % 2 == 0 ? 1 : 2)) / 2);
 			std::cout << ", lightmap " << std::setprecision(5) << float(lightsize / float(1024 * 1024)) << "MiB";
 			if (Global::light.size() < lightsize || Global::light.size() * 0.9f > lightsize) {
@@ -548,19 +606,133 @@ namespace terrain
 				Global::light.resize(lightsize);
 			}
 
-			// Preset: all bright / dark depending on night or day
-			if (Global::settings.nightmode) {
-				std::fill_n(Global::light.begin(), lightsize, static_cast<uint8_t>(0x11));
-			} else if (Global::settings.underground) {
-				std::fill_n(Global::light.begin(), lightsize, static_cast<uint8_t>(0x00));
-			} else {
-				std::fill_n(Global::light.begin(), lightsize, static_cast<uint8_t>(0xFF));
-			}
+			std::fill_n(Global::light.begin(), lightsize, initialLight());
 		}
 		std::cout << '\n';
 	}
 
-	void deallocateTerrain()
+	void layoutTerrain(const TerrainLayout layout)
+	{
+		// The terrain is stored the way the world lies, the orientation only turns the tables COLUMNAT uses
+		const size_t width = static_cast<size_t>(Global::ToChunkX - Global::FromChunkX) * CHUNKSIZE_X;
+		const size_t depth = static_cast<size_t>(Global::ToChunkZ - Global::FromChunkZ) * CHUNKSIZE_Z;
+		Global::worldX.resize(width);
+		Global::worldZ.resize(depth);
+		if (layout == LAYOUT_COLUMNS) {
+			for (size_t x = 0; x < width; ++x) {
+				Global::worldX[x] = x * depth;
+			}
+			for (size_t z = 0; z < depth; ++z) {
+				Global::worldZ[z] = z;
+			}
+		} else {
+			// The bits of x and z inside a brick take turns, x the odd ones. So the columns next to each other in
+			// any direction, and the ones on a diagonal, are mostly close together. The area is a multiple of 16
+			const auto spread = [](const size_t bits) {
+				return (bits & 1) | ((bits & 2) << 1) | ((bits & 4) << 2) | ((bits & 8) << 3);
+			};
+			constexpr size_t brickColumns = CHUNKSIZE_X * CHUNKSIZE_Z;
+			for (size_t x = 0; x < width; ++x) {
+				Global::worldX[x] = (x / CHUNKSIZE_X) * (depth / CHUNKSIZE_Z) * brickColumns + (spread(x % CHUNKSIZE_X) << 1);
+			}
+			for (size_t z = 0; z < depth; ++z) {
+				Global::worldZ[z] = (z / CHUNKSIZE_Z) * brickColumns + spread(z % CHUNKSIZE_Z);
+			}
+		}
+		orientTerrain(Global::settings.orientation);
+	}
+
+	void orientTerrain(const Orientation orientation)
+	{
+		orientColumns(orientation, Global::worldX, Global::worldZ, Global::columnX, Global::columnZ);
+		Global::MapsizeX = Global::columnX.size();
+		Global::MapsizeZ = Global::columnZ.size();
+	}
+
+	void orientColumns(const Orientation orientation, const std::vector<size_t>& worldX, const std::vector<size_t>& worldZ,
+		std::vector<size_t>& columnX, std::vector<size_t>& columnZ)
+	{
+		// View x, z shows world x, z (North), width - 1 - x, depth - 1 - z (South),
+		// width - 1 - z, x (East) or z, depth - 1 - x (West). Both tables add up, so each axis turns on its own
+		const bool swapped = (orientation == East || orientation == West);
+		const std::vector<size_t>& alongX = swapped ? worldZ : worldX;
+		const std::vector<size_t>& alongZ = swapped ? worldX : worldZ;
+		const bool reverseX = (orientation == South || orientation == West);
+		const bool reverseZ = (orientation == South || orientation == East);
+		columnX.resize(alongX.size());
+		columnZ.resize(alongZ.size());
+		for (size_t x = 0; x < columnX.size(); ++x) {
+			columnX[x] = alongX[reverseX ? alongX.size() - 1 - x : x];
+		}
+		for (size_t z = 0; z < columnZ.size(); ++z) {
+			columnZ[z] = alongZ[reverseZ ? alongZ.size() - 1 - z : z];
+		}
+	}
+
+	uint8_t initialLight()
+	{
+		if (Global::settings.nightmode) {
+			return 0x11;
+		} else if (Global::settings.underground) {
+			return 0x00;
+		}
+		return 0xFF;
+	}
+
+	bool usesLight()
+	{
+		return Global::settings.nightmode || Global::settings.underground || Global::settings.skylight;
+	}
+
+	void placeChunkAlone(const DecodedChunk& chunk, TerrainVector& blocks, LightVector& light)
+	{
+		// placeChunk works on the terrain of the current area, so that becomes this one chunk for a moment
+		const int fromX = Global::FromChunkX, fromZ = Global::FromChunkZ, toX = Global::ToChunkX, toZ = Global::ToChunkZ;
+		const size_t mapsizeX = Global::MapsizeX, mapsizeZ = Global::MapsizeZ, terrainsize = Global::Terrainsize;
+		Global::FromChunkX = chunk.x;
+		Global::FromChunkZ = chunk.z;
+		Global::ToChunkX = chunk.x + 1;
+		Global::ToChunkZ = chunk.z + 1;
+		Global::MapsizeX = CHUNKSIZE_X;
+		Global::MapsizeZ = CHUNKSIZE_Z;
+		Global::Terrainsize = CHUNKSIZE_X * CHUNKSIZE_Z * Global::MapsizeY;
+		// Chunk windows index their chunks x by x, whatever the layout of the terrain is
+		std::vector<size_t> columnX, columnZ, worldX, worldZ;
+		Global::columnX.swap(columnX);
+		Global::columnZ.swap(columnZ);
+		Global::worldX.swap(worldX);
+		Global::worldZ.swap(worldZ);
+		layoutTerrain(LAYOUT_COLUMNS);
+
+		blocks.assign(Global::Terrainsize, static_cast<StateID_t>(AIR));
+		if (usesLight()) {
+			light.assign(CHUNKSIZE_X * CHUNKSIZE_Z * ((Global::MapsizeY + (Global::MapminY % 2 == 0 ? 1 : 2)) / 2), initialLight());
+		}
+		Global::terrain.swap(blocks);
+		Global::light.swap(light);
+		placeChunk(chunk);
+		if (Global::settings.hell || Global::settings.serverHell) {
+			for (size_t column = 0; column < CHUNKSIZE_X * CHUNKSIZE_Z; ++column) {
+				uncoverNetherColumn(&WORLDBLOCKAT(column / CHUNKSIZE_Z, Global::MapsizeY - 1, column % CHUNKSIZE_Z));
+			}
+		}
+		Global::terrain.swap(blocks);
+		Global::light.swap(light);
+
+		Global::columnX.swap(columnX);
+		Global::columnZ.swap(columnZ);
+		Global::worldX.swap(worldX);
+		Global::worldZ.swap(worldZ);
+		Global::FromChunkX = fromX;
+		Global::FromChunkZ = fromZ;
+		Global::ToChunkX = toX;
+		Global::ToChunkZ = toZ;
+		Global::MapsizeX = mapsizeX;
+		Global::MapsizeZ = mapsizeZ;
+		Global::Terrainsize = terrainsize;
+	}
+
+	void releaseTerrain()
 	{
 		Global::heightMap.clear();
 		Global::heightMap.shrink_to_fit();
@@ -570,9 +742,27 @@ namespace terrain
 		Global::light.shrink_to_fit();
 	}
 
-	void clearLightmap()
+	void deallocateTerrain()
+	{
+		releaseTerrain();
+		if (prefetching.valid()) {
+			prefetching.wait();
+			prefetching = std::future<RegionFiles>();
+		}
+		prefetched.clear();
+		chunkCache.clear();
+	}
+
+	void setChunkCacheBudget(const uint64_t bytes)
+	{
+		chunkCache.setBudget(bytes);
+	}
+
+	void printChunkCacheStats()
 	{
-		std::fill(Global::light.begin(), Global::light.end(), static_cast<uint8_t>(0x00));
+		if (chunkCache.enabled()) {
+			chunkCache.printStats();
+		}
 	}
 
 	/**
@@ -600,6 +790,15 @@ namespace terrain
 #define REGION_HEADER_SIZE REGIONSIZE * REGIONSIZE * 4
 #define DECOMPRESSED_BUFFER 1000 * 1024
 #define COMPRESSED_BUFFER 100 * 1024
+#define REGION_FILE_GUESS 8 * 1024 * 1024 // typical size of a fully generated region file
+
+	uint64_t calcDecodeSize()
+	{
+		// Every loading thread holds a whole region file, the inflated chunk and the copy it is parsed from
+		const uint64_t loaders = Global::threadPool ? Global::threadPool->size() : 1;
+		return loaders * (2 * DECOMPRESSED_BUFFER + (largestRegionFile != 0 ? largestRegionFile : REGION_FILE_GUESS));
+	}
+
 	/**
 	 * Load all the 32x32-region-files containing chunks information
 	 */
@@ -620,7 +819,7 @@ namespace terrain
 				Region& region = (*it);
 				results.emplace_back(Global::threadPool->enqueue([](Region reg) {
 					int i = 0;
-					return loadRegion(reg.filename, true, i);
+					return loadRegion(reg.filename, reg.x, reg.z, true, i);
 				}, region));
 
 			}
@@ -642,7 +841,7 @@ namespace terrain
 				Region& region = (*it);
 				helper::printProgress(count++, max);
 				int i;
-				result |= loadRegion(region.filename, true, i);
+				result |= loadRegion(region.filename, region.x, region.z, true, i);
 			}
 			helper::printProgress(10, 10);
 			return result;
@@ -660,6 +859,10 @@ namespace terrain
 			return false;
 		}
 		allocateTerrain();
+		// Region files of this area that were read while the last one was drawn
+		if (prefetching.valid()) {
+			prefetched = prefetching.get();
+		}
 
 		std::cout << "Loading all chunks..\n";
 		bool result = false;
@@ -673,9 +876,9 @@ namespace terrain
 				for (int z = floorRegion(Global::FromChunkZ); z <= floorRegion(Global::ToChunkZ); z += REGIONSIZE) {
 					const std::string path = fromPath + "/region/r." + std::to_string(int(x / REGIONSIZE)) + '.' + std::to_string(int(z / REGIONSIZE)) + ".mca";
 
-					results.emplace_back(Global::threadPool->enqueue([&atomicLoadedChunks](const std::string _path) {
+					results.emplace_back(Global::threadPool->enqueue([&atomicLoadedChunks, x, z](const std::string _path) {
 						int load = 0;
-						const bool r = loadRegion(_path, false, load);
+						const bool r = loadRegion(_path, x, z, false, load);
 						atomicLoadedChunks += load;
 						return r;
 					}, path));
@@ -699,7 +902,7 @@ namespace terrain
 				const int maxZ = floorRegion(Global::ToChunkZ);
 				for (int z = floorRegion(Global::FromChunkZ); z <= maxZ; z += REGIONSIZE) {
 					const std::string path = fromPath + "/region/r." + std::to_string(x / REGIONSIZE) + '.' + std::to_string(z / REGIONSIZE) + ".mca";
-					const bool b = loadRegion(path, false, loadedChunks);
+					const bool b = loadRegion(path, x, z, false, loadedChunks);
 					result |= b;
 				}
 				helper::printProgress(size_t(x + tmpMin), size_t(floorRegion(Global::ToChunkX) + tmpMin));
@@ -709,25 +912,160 @@ namespace terrain
 		return result;
 	}
 
-	bool loadRegion(const std::string& file, const bool mustExist, int &loadedChunks)
+	void prefetchRegions(const std::string& fromPath, const int fromChunkX, const int fromChunkZ, const int toChunkX, const int toChunkZ, const uint64_t budget)
 	{
-		using chunkMap = std::map<uint32_t, uint32_t>;
-		std::vector<uint8_t> buffer(COMPRESSED_BUFFER);
-		std::vector<uint8_t> decompressedBuffer(DECOMPRESSED_BUFFER);
-		std::ifstream rp(file, std::ios::binary);
+		// Whatever the last area didn't use is stale now, drop it before reading the next one
+		if (prefetching.valid()) {
+			prefetching.wait();
+		}
+		prefetched.clear();
+		std::vector<std::string> files;
+		for (int x = floorRegion(fromChunkX); x <= floorRegion(toChunkX); x += REGIONSIZE) {
+			for (int z = floorRegion(fromChunkZ); z <= floorRegion(toChunkZ); z += REGIONSIZE) {
+				files.push_back(fromPath + "/region/r." + std::to_string(int(x / REGIONSIZE)) + '.' + std::to_string(int(z / REGIONSIZE)) + ".mca");
+			}
+		}
+		// Not on the thread pool, that one is busy loading and optimizing the current area
+		prefetching = std::async(std::launch::async, [files, budget]() {
+			const auto start = std::chrono::steady_clock::now();
+			RegionFiles result;
+			uint64_t used = 0;
+			for (const auto& file : files) {
+				std::error_code ec;
+				const uint64_t size = std::filesystem::file_size(file, ec);
+				if (ec) {
+					continue;
+				}
+				if (used + size > budget) {
+					break; // The rest is read by loadTerrain as usual
+				}
+				RegionFiles::mapped_type data;
+				if (readRegionFile(file, data)) {
+					used += data.size();
+					result.emplace(file, std::move(data));
+				}
+			}
+			prefetchBytes += used;
+			prefetchFiles += result.size();
+			prefetchNanos += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			return result;
+		});
+	}
+
+	bool scanChunkHeaders(const std::string& fromPath, const int fromChunkX, const int fromChunkZ, const int toChunkX, const int toChunkZ, const std::function<void(int, int)>& chunk)
+	{
+		std::vector<uint8_t> header(REGION_HEADER_SIZE);
+		bool found = false;
+		for (int x = floorRegion(fromChunkX); x < toChunkX; x += REGIONSIZE) {
+			for (int z = floorRegion(fromChunkZ); z < toChunkZ; z += REGIONSIZE) {
+				const std::string file = fromPath + "/region/r." + std::to_string(int(x / REGIONSIZE)) + '.' + std::to_string(int(z / REGIONSIZE)) + ".mca";
+				std::ifstream fh(file, std::ios::binary);
+				if (fh.fail() || !fh.read(reinterpret_cast<char*>(header.data()), REGION_HEADER_SIZE)) {
+					continue;
+				}
+				found = true;
+				std::error_code ec;
+				const uint64_t size = std::filesystem::file_size(file, ec);
+				if (!ec) {
+					largestRegionFile = std::max(largestRegionFile, size);
+				}
+				for (size_t i = 0; i < REGIONSIZE * REGIONSIZE; ++i) {
+					const int chunkX = x + static_cast<int>(i % REGIONSIZE);
+					const int chunkZ = z + static_cast<int>(i / REGIONSIZE);
+					if (chunkOffset(header.data(), i) != 0 && chunkX >= fromChunkX && chunkX < toChunkX && chunkZ >= fromChunkZ && chunkZ < toChunkZ) {
+						chunk(chunkX, chunkZ);
+					}
+				}
+			}
+		}
+		return found;
+	}
+
+	void printPrefetchStats()
+	{
+		const double seconds = static_cast<double>(prefetchNanos.load()) / 1e9;
+		const double mib = static_cast<double>(prefetchBytes.load()) / (1024.0 * 1024.0);
+		std::cout << "Read ahead " << prefetchFiles.load() << " region files (" << mib << " MiB) in " << seconds << "s, "
+			<< prefetchHits.load() << " region loads were served from them\n";
+	}
+
+	template<typename Buffer>
+	bool readRegionFile(const std::string& file, Buffer& data)
+	{
+		std::ifstream rp(file, std::ios::binary | std::ios::ate);
 		if (rp.fail()) {
+			return false;
+		}
+		const std::streamoff size = rp.tellg();
+		if (size < 0) {
+			return false;
+		}
+		data.resize(static_cast<size_t>(size));
+		rp.seekg(0);
+		rp.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(size));
+		return !rp.fail();
+	}
+
+	bool loadRegion(const std::string& file, const int originX, const int originZ, const bool mustExist, int &loadedChunks)
+	{
+		const bool caching = chunkCache.enabled();
+		return forEachChunk(file, originX, originZ, mustExist, caching, [caching, &loadedChunks](const int chunkX, const int chunkZ) {
+			if (!caching) {
+				return false;
+			}
+			const auto cached = chunkCache.find(chunkX, chunkZ);
+			if (!cached) {
+				return false;
+			}
+			if (placeChunk(*cached)) {
+				loadedChunks++;
+			}
+			return true;
+		}, [caching, &loadedChunks](const std::shared_ptr<const DecodedChunk>& chunk) {
+			if (caching) {
+				chunkCache.insert(chunk);
+			}
+			if (placeChunk(*chunk)) {
+				loadedChunks++;
+			}
+		});
+	}
+
+	bool decodeRegion(const std::string& fromPath, const int regionX, const int regionZ, const std::function<void(const std::shared_ptr<const DecodedChunk>&)>& decoded)
+	{
+		const std::string path = fromPath + "/region/r." + std::to_string(regionX) + '.' + std::to_string(regionZ) + ".mca";
+		return forEachChunk(path, regionX * REGIONSIZE, regionZ * REGIONSIZE, false, false, [](const int, const int) { return false; }, decoded);
+	}
+
+	bool forEachChunk(const std::string& file, const int originX, const int originZ, const bool mustExist, const bool anyPass,
+		const std::function<bool(int, int)>& known, const std::function<void(const std::shared_ptr<const DecodedChunk>&)>& decoded)
+	{
+		using chunkMap = std::map<uint32_t, uint32_t>;
+		// The whole file is read in one go, unless it was read ahead already
+		RegionData fileData;
+		const uint8_t* region = nullptr;
+		size_t regionSize = 0;
+		const auto ahead = prefetched.find(file);
+		if (ahead != prefetched.end()) {
+			region = ahead->second.data();
+			regionSize = ahead->second.size();
+			++prefetchHits;
+		} else if (!readRegionFile(file, fileData)) {
 			if (mustExist) std::cerr << "Error opening region file " << file << '\n';
 			return false;
+		} else {
+			region = fileData.data();
+			regionSize = fileData.size();
 		}
-		rp.read(reinterpret_cast<char*>(buffer.data()), REGIONSIZE * REGIONSIZE * 4);
-		if (rp.fail()) {
+		RegionData decompressedBuffer(DECOMPRESSED_BUFFER);
+		if (regionSize < REGION_HEADER_SIZE) {
 			std::cerr << "Header too short in " << file << '\n';
 			return false;
 		}
 		// Sort chunks using a map, so we access the file as sequential as possible
 		chunkMap localChunks;
-		for (uint32_t i = 0; i < REGION_HEADER_SIZE; i += 4) {
-			const uint32_t offset = (helper::swap_endian<uint32_t>(buffer[i] + (buffer[i + 1] << 8) + (buffer[i + 2] << 16)) >> 8) * 4096;
+		for (uint32_t i = 0; i < REGIONSIZE * REGIONSIZE; ++i) {
+			const uint32_t offset = chunkOffset(region, i);
 			if (offset == 0) continue;
 			localChunks[offset] = i;
 		}
@@ -736,28 +1074,29 @@ namespace terrain
 		}
 		z_stream zlibStream;
 		for (chunkMap::iterator ci = localChunks.begin(); ci != localChunks.end(); ++ci) {
-			uint32_t offset = ci->first;
-
-			rp.seekg(offset);
-			if (rp.fail()) {
-				std::cerr << "Error seeking to chunk in region file " << file << '\n';
+			const size_t offset = ci->first;
+			// Position the header gives, the chunk itself tells the one that counts
+			const int chunkX = originX + static_cast<int>(ci->second % REGIONSIZE);
+			const int chunkZ = originZ + static_cast<int>(ci->second / REGIONSIZE);
+			if (known(chunkX, chunkZ)) {
 				continue;
 			}
-			rp.read(reinterpret_cast<char*>(buffer.data()), 5);
-			if (rp.fail()) {
+
+			if (offset + 5 > regionSize) {
 				std::cerr << "Error reading chunk size from region file " << file << '\n';
 				continue;
 			}
-			size_t len = helper::swap_endian<uint32_t>(*reinterpret_cast<uint32_t*>(buffer.data()));
-			uint8_t version = buffer[4];
+			uint32_t header;
+			std::memcpy(&header, region + offset, sizeof(header));
+			size_t len = helper::swap_endian<uint32_t>(header);
+			uint8_t version = region[offset + 4];
 			if (len == 0) continue;
 			len--;
 			if (len > COMPRESSED_BUFFER) {
 				std::cerr << "Chunk too big in " << file << '\n';
 				continue;
 			}
-			rp.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(len));
-			if (rp.fail()) {
+			if (offset + 5 + len > regionSize) {
 				std::cerr << "Not enough input for chunk in " << file << '\n';
 				continue;
 			}
@@ -766,7 +1105,7 @@ namespace terrain
 				zlibStream.next_out = decompressedBuffer.data();
 				zlibStream.avail_out = DECOMPRESSED_BUFFER;
 				zlibStream.avail_in = static_cast<uInt>(len);
-				zlibStream.next_in = buffer.data();
+				zlibStream.next_in = const_cast<Bytef*>(region + offset + 5);
 
 				inflateInit2(&zlibStream, 32 + MAX_WBITS);
 				int status = inflate(&zlibStream, Z_FINISH); // decompress in one step
@@ -786,9 +1125,18 @@ namespace terrain
 				continue;
 			}
 			std::vector<uint8_t> buf(decompressedBuffer.begin(), decompressedBuffer.begin() + len);
-			if (loadChunk(buf)) {
-				loadedChunks++;
+			const memory::Reservation parsing(memory::MEM_DECODE, len);
+			auto chunk = std::make_shared<DecodedChunk>();
+			if (!decodeChunk(buf, anyPass, *chunk)) {
+				if (!anyPass) {
+					continue;
+				}
+				// Hand on broken chunks too, so a cache doesn't inflate them again for the next pass
+				chunk->x = chunkX;
+				chunk->z = chunkZ;
+				chunk->sections.clear();
 			}
+			decoded(chunk);
 		}
 		return true;
 	}
@@ -869,39 +1217,13 @@ namespace terrain
 					if (tx < CHUNKSIZE_X) {
 						continue;
 					}
-					if (Global::settings.orientation == East) {
-						if (tx >= int(Global::MapsizeZ) - CHUNKSIZE_Z) {
-							break;
-						}
-						if (tz >= int(Global::MapsizeX) - CHUNKSIZE_X) {
-							break;
-						}
-						SETLIGHTEAST(tx, oty, tz) = 0xFF;
-					} else if (Global::settings.orientation == North) {
-						if (tx >= int(Global::MapsizeX) - CHUNKSIZE_X) {
-							break;
-						}
-						if (tz >= int(Global::MapsizeZ) - CHUNKSIZE_Z) {
-							break;
-						}
-						SETLIGHTNORTH(tx, oty, tz) = 0xFF;
-					} else if (Global::settings.orientation == South) {
-						if (tx >= int(Global::MapsizeX) - CHUNKSIZE_X) {
-							break;
-						}
-						if (tz >= int(Global::MapsizeZ) - CHUNKSIZE_Z) {
-							break;
-						}
-						SETLIGHTSOUTH(tx, oty, tz) = 0xFF;
-					} else {
-						if (tx >= int(Global::MapsizeZ) - CHUNKSIZE_Z) {
-							break;
-						}
-						if (tz >= int(Global::MapsizeX) - CHUNKSIZE_X) {
-							break;
-						}
-						SETLIGHTWEST(tx, oty, tz) = 0xFF;
+					if (tx >= static_cast<int>(Global::worldX.size()) - CHUNKSIZE_X) {
+						break;
+					}
+					if (tz >= static_cast<int>(Global::worldZ.size()) - CHUNKSIZE_Z) {
+						break;
 					}
+					WORLDLIGHTAT(static_cast<size_t>(tx), static_cast<size_t>(oty), static_cast<size_t>(tz)) = 0xFF;
 				}
 			}
 		}
@@ -909,38 +1231,47 @@ namespace terrain
 
 	void uncoverNether()
 	{
-		const int cap = (static_cast<int>(Global::MapsizeY) - Global::MapminY) - 57;
-		const int to = (static_cast<int>(Global::MapsizeY) - Global::MapminY) - 52;
 		std::cout << "Uncovering Nether...\n";
-		for (size_t x = CHUNKSIZE_X; x < Global::MapsizeX - CHUNKSIZE_X; ++x) {
-			helper::printProgress(x - CHUNKSIZE_X, Global::MapsizeX);
-			for (size_t z = CHUNKSIZE_Z; z < Global::MapsizeZ - CHUNKSIZE_Z; ++z) {
-				// Remove blocks on top, otherwise there is not much to see here
-				int massive = 0;
-				StateID_t* bp = &Global::terrain[((z + (x * Global::MapsizeZ) + 1) * Global::MapsizeY) - 1];
-				int i;
-				for (i = 0; i < to; ++i) { // Go down 74 blocks from the ceiling to see if there is anything except solid
-					if (massive && (*bp == AIR || helper::isLava(*bp))) {
-						if (--massive == 0) {
-							break;   // Ignore caves that are only 2 blocks high
-						}
-					}
-					if (*bp != AIR && !helper::isLava(*bp)) {
-						massive = 3;
-					}
-					--bp;
-				}
-				// So there was some cave or anything before going down 70 blocks, everything above will get removed
-				// If not, only 45 blocks starting at the ceiling will be removed
-				if (i > cap) {
-					i = cap - 25;   // TODO: Make this configurable
+		runColumnPass("Uncovering Nether", CHUNKSIZE_X, Global::MapsizeX - CHUNKSIZE_X, [](const size_t fromX, const size_t toX) {
+			size_t removed = 0;
+			for (size_t x = fromX; x < toX; ++x) {
+				for (size_t z = CHUNKSIZE_Z; z < Global::MapsizeZ - CHUNKSIZE_Z; ++z) {
+					removed += uncoverNetherColumn(&BLOCKAT(x, Global::MapsizeY - 1, z));
 				}
-				bp = &Global::terrain[((z + (x * Global::MapsizeZ) + 1) * Global::MapsizeY) - 1];
-				for (int j = 0; j < i; ++j) {
-					*bp-- = AIR;
+			}
+			return removed;
+		});
+	}
+
+	// Column of the terrain, 'top' points to its highest block. Returns the blocks it cleared
+	size_t uncoverNetherColumn(StateID_t* top)
+	{
+		const int cap = (static_cast<int>(Global::MapsizeY) - Global::MapminY) - 57;
+		const int to = (static_cast<int>(Global::MapsizeY) - Global::MapminY) - 52;
+		// Remove blocks on top, otherwise there is not much to see here
+		int massive = 0;
+		StateID_t* bp = top;
+		int i;
+		for (i = 0; i < to; ++i) { // Go down 74 blocks from the ceiling to see if there is anything except solid
+			if (massive && (*bp == AIR || helper::isLava(*bp))) {
+				if (--massive == 0) {
+					break;   // Ignore caves that are only 2 blocks high
 				}
 			}
+			if (*bp != AIR && !helper::isLava(*bp)) {
+				massive = 3;
+			}
+			--bp;
+		}
+		// So there was some cave or anything before going down 70 blocks, everything above will get removed
+		// If not, only 45 blocks starting at the ceiling will be removed
+		if (i > cap) {
+			i = cap - 25;   // TODO: Make this configurable
+		}
+		bp = top;
+		for (int j = 0; j < i; ++j) {
+			*bp-- = AIR;
 		}
-		helper::printProgress(10, 10);
+		return static_cast<size_t>(std::max(i, 0));
 	}
 }
\ No newline at end of file
@@ -4,17 +4,51 @@
 #include <list>
 #include <map>
 #include <vector>
+#include <functional>
+#include <memory>
 #include "defines.h"
 #include "globals.h"
+#include "ChunkCache.h"
 
 namespace terrain
 {
 	WorldFormat getWorldFormat(const std::string& worldPath);
 	bool scanWorldDirectory(const std::string& fromPath);
 	bool loadTerrain(const std::string& fromPath, int &loadedChunks);
+	// Reads the region files of the given chunk area in the background, the next loadTerrain takes them from
+	// memory. Files that would push the total over 'budget' bytes are left to loadTerrain.
+	void prefetchRegions(const std::string& fromPath, const int fromChunkX, const int fromChunkZ, const int toChunkX, const int toChunkZ, const uint64_t budget);
+	void printPrefetchStats();
+	// Calls 'chunk' for every chunk of the area the region file headers list, false if there are no region files at all
+	bool scanChunkHeaders(const std::string& fromPath, const int fromChunkX, const int fromChunkZ, const int toChunkX, const int toChunkZ, const std::function<void(int, int)>& chunk);
+	// Chunks decoded by one pass of an incremental render are kept for the next ones, up to 'bytes'. 0 disables that
+	void setChunkCacheBudget(const uint64_t bytes);
+	void printChunkCacheStats();
 	bool loadEntireTerrain();
+	// Decodes the chunks of region file r.regionX.regionZ inside the current area, without placing them anywhere
+	bool decodeRegion(const std::string& fromPath, const int regionX, const int regionZ, const std::function<void(const std::shared_ptr<const DecodedChunk>&)>& decoded);
+	using TerrainVector = memory::TrackedVector<StateID_t, memory::MEM_TERRAIN>;
+	using LightVector = memory::TrackedVector<uint8_t, memory::MEM_LIGHT>;
+	// Terrain and light of a single chunk, laid out like Global::terrain and Global::light of an area of just that
+	// chunk with LAYOUT_COLUMNS, so x by x in the world whatever the orientation is. Nether ceilings are removed right away
+	void placeChunkAlone(const DecodedChunk& chunk, TerrainVector& blocks, LightVector& light);
+	// Bytes the terrain, light and height map of an area of chunksX * chunksZ chunks take
 	uint64_t calcTerrainSize(const size_t chunksX, const size_t chunksZ);
-	void clearLightmap();
+	// Bytes the threads loading regions need besides, whatever the size of the area. Knows the region files after scanChunkHeaders
+	uint64_t calcDecodeSize();
+	// Fills Global::worldX and worldZ for the current area, then orients it like Settings::orientation.
+	// allocateTerrain does that for Settings::terrainLayout
+	void layoutTerrain(const TerrainLayout layout);
+	// Turns the view of the laid out terrain to 'orientation': Global::columnX, columnZ and the Mapsize.
+	// The terrain stays as it is, so one loaded area can be looked at from all sides
+	void orientTerrain(const Orientation orientation);
+	// Tables of the view for 'orientation' from those of the world, like orientTerrain does with the globals
+	void orientColumns(const Orientation orientation, const std::vector<size_t>& worldX, const std::vector<size_t>& worldZ,
+		std::vector<size_t>& columnX, std::vector<size_t>& columnZ);
+	// Preset of the lightmap: all bright / dark depending on night or day
+	uint8_t initialLight();
+	// Frees the terrain of the last pass, the next one allocates what it needs. deallocateTerrain drops caches as well
+	void releaseTerrain();
 	void deallocateTerrain();
 	void calcBitmapOverdraw(int &left, int &right, int &top, int &bottom); //Calculates overdraw on all 4 sites
 	//void loadBiomeMap(const std::string& path); //no longer supported